@@ -0,0 +1,384 @@
+﻿#include "UserFlusher.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "UserSnapshotFile.h"
+#include "utilities/FileUtils.h"
+#include "utilities/JsonHelper.h"
+
+namespace
+{
+    // Small logs aren't worth compacting, however few users there are.
+    constexpr std::size_t MIN_RECORDS_BEFORE_COMPACTION = 1024;
+
+    // Flushes smaller than this are written uncompressed.
+    constexpr std::size_t MIN_COMPRESSED_BATCH = 512;
+
+    // Cuts a torn record off the end of a log, so the next record appended starts on a line of its own.
+    void truncateTornRecord(const std::string& filename, const std::uintmax_t validBytes)
+    {
+        std::error_code error;
+        const std::uintmax_t fileSize = std::filesystem::file_size(filename, error);
+        if (error) return;
+
+        if (validBytes < fileSize)
+        {
+            std::filesystem::resize_file(filename, validBytes, error);
+        }
+        else if (validBytes > fileSize)
+        {
+            // The last record is whole but lost its line break.
+            std::ofstream(filename, std::ios::binary | std::ios::app) << '\n';
+        }
+    }
+}
+
+UserFlusher::UserFlusher(std::map<std::string, User, std::less<>>& users, std::shared_mutex& usersMutex, std::string snapshotFilename, std::string logFilename)
+    : users(users), usersMutex(usersMutex), snapshotFilename(std::move(snapshotFilename)), logFilename(std::move(logFilename))
+{
+}
+
+UserFlusher::~UserFlusher()
+{
+    stop();
+    close();
+}
+
+void UserFlusher::useStore(KeyValueStore& store)
+{
+    this->store = &store;
+}
+
+void UserFlusher::setCompression(const Compression::Codec codec)
+{
+    this->codec = codec;
+}
+
+StatusResponse UserFlusher::open()
+{
+    std::lock_guard flushLock(flushMutex);
+
+    if (store != nullptr)
+    {
+        storeOpen = true;
+        return { true, "Saving users to the " + store->describe() };
+    }
+
+    std::size_t replayedRecords = 0;
+    std::uintmax_t validBytes = 0;
+    bool tornRecord = false;
+
+    if (std::ifstream file(logFilename, std::ios::binary); file.is_open())
+    {
+        // Flushes written with compression on are blocks of records; the rest are plain lines.
+        validBytes = Compression::readLogLines(file, [&](const std::string_view line)
+        {
+            try
+            {
+                const json record = json::parse(line);
+
+                if (record.value("op", "") == "put")
+                {
+                    if (User user = JsonHelper::jsonToUser(record.at("user")); !user.username.empty())
+                    {
+                        std::string username = user.username;
+                        users.insert_or_assign(std::move(username), std::move(user));
+                    }
+                }
+                else if (record.value("op", "") == "delete")
+                {
+                    users.erase(record.value("user", ""));
+                }
+            }
+            catch (const json::exception&)
+            {
+                // A crash in the middle of a flush leaves a torn last record behind.
+                tornRecord = true;
+                return false;
+            }
+
+            replayedRecords++;
+            return true;
+        });
+
+        file.close();
+        truncateTornRecord(logFilename, validBytes);
+    }
+
+    logFile = fopen(logFilename.c_str(), "ab");
+    if (logFile == nullptr)
+    {
+        return { false, "Could not open the user log " + logFilename };
+    }
+
+    logRecords = replayedRecords;
+
+    return { true, "Replayed " + std::to_string(replayedRecords) + " user log records" + (tornRecord ? " (ignored a torn record)" : "") +
+        (codec == Compression::Codec::None ? "" : ", compressing with " + Compression::codecName(codec)) };
+}
+
+StatusResponse UserFlusher::close()
+{
+    std::lock_guard flushLock(flushMutex);
+
+    if (store != nullptr)
+    {
+        if (!storeOpen) return { true, "User store already closed" };
+        storeOpen = false;
+        return flushToStore(false);
+    }
+
+    if (logFile == nullptr) return { true, "User log already closed" };
+
+    const StatusResponse status = flushLocked(false);
+
+    fclose(logFile);
+    logFile = nullptr;
+
+    return status;
+}
+
+void UserFlusher::markDirty(const std::string& username)
+{
+    std::lock_guard lock(dirtyMutex);
+    dirtyUsers.insert(username);
+}
+
+void UserFlusher::start(const std::chrono::seconds interval)
+{
+    std::lock_guard lock(stopMutex);
+    if (running) return;
+
+    running = true;
+    flushThread = std::thread(&UserFlusher::flushLoop, this, interval);
+}
+
+void UserFlusher::stop()
+{
+    {
+        std::lock_guard lock(stopMutex);
+        if (!running) return;
+        running = false;
+    }
+
+    stopCondition.notify_all();
+    if (flushThread.joinable()) { flushThread.join(); }
+}
+
+StatusResponse UserFlusher::flush()
+{
+    std::lock_guard flushLock(flushMutex);
+    return flushLocked(false);
+}
+
+StatusResponse UserFlusher::compact()
+{
+    std::lock_guard flushLock(flushMutex);
+    return flushLocked(true);
+}
+
+void UserFlusher::flushLoop(const std::chrono::seconds interval)
+{
+    while (true)
+    {
+        {
+            std::unique_lock lock(stopMutex);
+            if (stopCondition.wait_for(lock, interval, [this] { return !running; })) break;
+        }
+
+        if (const StatusResponse status = flush(); !status.message.empty())
+        {
+            std::cout << status.message << std::endl;
+        }
+    }
+}
+
+StatusResponse UserFlusher::flushLocked(const bool forceCompaction)
+{
+    if (store != nullptr)
+    {
+        return storeOpen ? flushToStore(forceCompaction) : StatusResponse { false, "User store is not open" };
+    }
+
+    if (logFile == nullptr)
+    {
+        return { false, "User log is not open" };
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::set<std::string> dirty;
+    std::string records;
+    std::map<std::string, User, std::less<>> allUsers;
+    bool compacting;
+
+    {
+        std::shared_lock usersLock(usersMutex);
+
+        {
+            std::lock_guard lock(dirtyMutex);
+            dirty.swap(dirtyUsers);
+        }
+
+        for (const std::string& username : dirty)
+        {
+            json record;
+            if (const auto userIt = users.find(username); userIt != users.end())
+            {
+                record["op"] = "put";
+                record["user"] = JsonHelper::userToJson(userIt->second);
+            }
+            else
+            {
+                record["op"] = "delete";
+                record["user"] = username;
+            }
+
+            records += record.dump() + "\n";
+        }
+
+        // The users are copied together with the changes, so after compaction the log and snapshot agree.
+        compacting = forceCompaction || logRecords + dirty.size() > std::max(MIN_RECORDS_BEFORE_COMPACTION, users.size());
+        if (compacting) { allUsers = users; }
+    }
+
+    if (!compacting && dirty.empty())
+    {
+        return { true, "" };
+    }
+
+    if (!records.empty() && (!writeRecords(records) || !FileUtils::syncFile(logFile)))
+    {
+        // Keeps the changes for the next attempt.
+        std::lock_guard lock(dirtyMutex);
+        dirtyUsers.insert(dirty.begin(), dirty.end());
+        return { false, "Could not write the user log " + logFilename };
+    }
+
+    logRecords += dirty.size();
+
+    const auto flushTime = std::chrono::steady_clock::now();
+    const auto flushMs = std::chrono::duration_cast<std::chrono::milliseconds>(flushTime - startTime).count();
+
+    if (!compacting)
+    {
+        return { true, "Flushed " + std::to_string(dirty.size()) + " changed users in " + std::to_string(flushMs) + " ms" };
+    }
+
+    // A failed write never replaces the last good snapshot.
+    const StatusResponse saveStatus = UserSnapshotFile::save(snapshotFilename, allUsers, codec);
+    if (!saveStatus.success)
+    {
+        return { false, "Flushed " + std::to_string(dirty.size()) + " changed users, but compaction failed: " + saveStatus.message };
+    }
+
+    // Everything in the log is in the snapshot now. A crash before this point just replays it again.
+    fclose(logFile);
+    logFile = fopen(logFilename.c_str(), "wb");
+    if (logFile == nullptr)
+    {
+        return { false, "Could not reopen the user log " + logFilename };
+    }
+
+    const std::size_t compactedRecords = logRecords;
+    logRecords = 0;
+
+    const std::string compression = codec == Compression::Codec::None
+        ? ""
+        : "; log " + logStats.describe() + "; " + saveStatus.message;
+    logStats = {};
+
+    const auto endTime = std::chrono::steady_clock::now();
+    const auto totalMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+
+    return { true, "Flushed " + std::to_string(dirty.size()) + " changed users and compacted " + std::to_string(compactedRecords) +
+        " log records into " + std::to_string(allUsers.size()) + " users in " + std::to_string(totalMs) + " ms" + compression };
+}
+
+bool UserFlusher::writeRecords(const std::string& records)
+{
+    // A block header would outweigh what compressing a few records saves, so they're written as plain lines.
+    if (codec == Compression::Codec::None || records.size() < MIN_COMPRESSED_BATCH)
+    {
+        if (codec != Compression::Codec::None)
+        {
+            logStats.rawBytes += records.size();
+            logStats.storedBytes += records.size();
+        }
+
+        return fwrite(records.data(), 1, records.size(), logFile) == records.size();
+    }
+
+    std::string encodedRecords;
+    Compression::appendLineBlocks(codec, records, encodedRecords, &logStats);
+    return fwrite(encodedRecords.data(), 1, encodedRecords.size(), logFile) == encodedRecords.size();
+}
+
+StatusResponse UserFlusher::flushToStore(const bool allUsers)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::set<std::string> dirty;
+    std::vector<std::pair<std::string, std::optional<std::string>>> changes;
+
+    {
+        std::shared_lock usersLock(usersMutex);
+
+        {
+            std::lock_guard lock(dirtyMutex);
+            dirty.swap(dirtyUsers);
+        }
+
+        if (allUsers)
+        {
+            for (const auto& [username, user] : users) { dirty.insert(username); }
+        }
+
+        for (const std::string& username : dirty)
+        {
+            if (const auto userIt = users.find(username); userIt != users.end())
+            {
+                changes.emplace_back(username, JsonHelper::userToJson(userIt->second).dump());
+            }
+            else
+            {
+                changes.emplace_back(username, std::nullopt);
+            }
+        }
+    }
+
+    if (changes.empty())
+    {
+        return { true, "" };
+    }
+
+    StatusResponse status { true, "" };
+    for (const auto& [username, value] : changes)
+    {
+        status = value.has_value() ? store->put(username, value.value()) : store->remove(username);
+        if (!status.success) break;
+    }
+
+    if (status.success)
+    {
+        status = store->flush();
+    }
+
+    if (!status.success)
+    {
+        // Writing a user again is harmless, so every change is kept for the next attempt.
+        std::lock_guard lock(dirtyMutex);
+        dirtyUsers.insert(dirty.begin(), dirty.end());
+        return { false, "Could not write the changed users to the " + store->describe() + ": " + status.message };
+    }
+
+    const auto endTime = std::chrono::steady_clock::now();
+    const auto totalMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+
+    return { true, "Flushed " + std::to_string(changes.size()) + " changed users to the " + store->describe() +
+        " in " + std::to_string(totalMs) + " ms" };
+}
@@ -0,0 +1,89 @@
+﻿#ifndef USERFLUSHER_H
+#define USERFLUSHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "storage/KeyValueStore.h"
+#include "structs/StatusResponse.h"
+#include "structs/User.h"
+#include "utilities/Compression.h"
+
+// Saves the users in the background. Only users changed since the last flush are appended to a log,
+// so a crash loses at most one flush interval of changes. Once the log holds more records than there
+// are users, it's compacted into the binary snapshot and started again. With a key-value store in use,
+// the changed users are written to it instead, and it takes care of its own compaction.
+class UserFlusher
+{
+public:
+
+    UserFlusher(std::map<std::string, User, std::less<>>& users, std::shared_mutex& usersMutex, std::string snapshotFilename, std::string logFilename);
+
+    ~UserFlusher();
+
+    // Saves to a key-value store instead of the log and snapshot. Call it before open().
+    void useStore(KeyValueStore& store);
+
+    // Compresses the log records and the snapshot with the given codec. Call it before open().
+    void setCompression(Compression::Codec codec);
+
+    // Applies the log on top of the loaded users and opens it for appending.
+    StatusResponse open();
+
+    // Flushes the remaining changes and closes the log.
+    StatusResponse close();
+
+    // Flags a user as changed. Call it whenever a user is created, changed or removed.
+    void markDirty(const std::string& username);
+
+    // Starts flushing at a fixed interval.
+    void start(std::chrono::seconds interval);
+
+    // Stops the background thread. Doesn't flush.
+    void stop();
+
+    // Appends the changed users to the log now. The message is empty if nothing had changed.
+    StatusResponse flush();
+
+    // Writes every user to the snapshot, or the store, and empties the log.
+    StatusResponse compact();
+
+private:
+
+    void flushLoop(std::chrono::seconds interval);
+    StatusResponse flushLocked(bool forceCompaction);
+    StatusResponse flushToStore(bool allUsers);
+
+    // Appends records to the log, compressing them if that's on. Call it holding flushMutex.
+    bool writeRecords(const std::string& records);
+
+    std::map<std::string, User, std::less<>>& users;
+    std::shared_mutex& usersMutex;
+    std::string snapshotFilename;
+    std::string logFilename;
+
+    std::mutex dirtyMutex;
+    std::set<std::string> dirtyUsers;
+
+    std::mutex flushMutex; // Guards the log file.
+    FILE* logFile = nullptr;
+    std::size_t logRecords = 0;
+    Compression::Codec codec = Compression::Codec::None;
+    Compression::Stats logStats; // Since the last compaction.
+    KeyValueStore* store = nullptr;
+    bool storeOpen = false;
+
+    std::thread flushThread;
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool running = false;
+};
+
+#endif //USERFLUSHER_H
@@ -0,0 +1,277 @@
+﻿#include "UserSnapshotFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <ranges>
+#include <thread>
+#include <vector>
+
+#include "utilities/AtomicFileWriter.h"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'U', 'S', 'N', 'P' };
+
+    struct FileHeader
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t userCount;
+        std::uint32_t reserved;
+        std::uint64_t usersOffset;
+        std::uint64_t stringsOffset;
+        std::uint64_t stringsSize;
+    };
+
+    struct UserRecord
+    {
+        std::uint32_t usernameOffset;
+        std::uint32_t usernameLength;
+        std::uint32_t passwordHashOffset;
+        std::uint32_t passwordHashLength;
+        std::int32_t energy;
+        std::uint8_t type;
+        std::uint8_t isAdmin;
+        std::uint16_t reserved;
+    };
+
+    // Below this many users per thread, starting the threads costs more than it saves.
+    constexpr std::size_t MIN_USERS_PER_THREAD = 4096;
+
+    static_assert(sizeof(FileHeader) == 40);
+    static_assert(sizeof(UserRecord) == 24);
+
+    // Copies a record out of the mapping, which makes no promises about alignment.
+    template<typename T>
+    T readRecord(const char* data, const std::size_t offset)
+    {
+        T record;
+        std::memcpy(&record, data + offset, sizeof(T));
+        return record;
+    }
+}
+
+StatusResponse UserSnapshotFile::open(const std::string& filename)
+{
+    close();
+
+    if (!file.open(filename))
+    {
+        return { false, "No binary snapshot found at " + filename };
+    }
+
+    const auto fail = [this, &filename](const std::string& reason) -> StatusResponse
+    {
+        close();
+        return { false, "Invalid binary snapshot " + filename + ": " + reason };
+    };
+
+    if (file.size() < sizeof(FileHeader)) return fail("file is too small");
+
+    const auto header = readRecord<FileHeader>(file.data(), 0);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return fail("unknown file type");
+    if (header.version != VERSION) return fail("unsupported version " + std::to_string(header.version));
+
+    const std::uint64_t size = file.size();
+    if (header.usersOffset > size || (size - header.usersOffset) / sizeof(UserRecord) < header.userCount ||
+        header.stringsOffset > size || size - header.stringsOffset < header.stringsSize)
+    {
+        return fail("section out of bounds");
+    }
+
+    userCount = header.userCount;
+    usersOffset = header.usersOffset;
+    stringsOffset = header.stringsOffset;
+    stringsSize = header.stringsSize;
+
+    // Checked once here, so lookups can trust every record afterwards.
+    std::string_view previousUsername;
+    for (std::size_t i = 0; i < userCount; ++i)
+    {
+        const auto record = readRecord<UserRecord>(file.data(), usersOffset + i * sizeof(UserRecord));
+        if (record.usernameOffset > stringsSize || stringsSize - record.usernameOffset < record.usernameLength ||
+            record.passwordHashOffset > stringsSize || stringsSize - record.passwordHashOffset < record.passwordHashLength)
+        {
+            return fail("user record " + std::to_string(i) + " out of bounds");
+        }
+
+        const std::string_view username = getUsername(i);
+        if (i > 0 && username <= previousUsername)
+        {
+            return fail("users are not sorted by username");
+        }
+
+        previousUsername = username;
+    }
+
+    const std::string decompression = file.getDecodeStats().has_value()
+        ? ", decompressed " + file.getDecodeStats()->describe()
+        : "";
+
+    return { true, "Mapped binary snapshot " + filename + " (" + std::to_string(userCount) + " users" + decompression + ")" };
+}
+
+void UserSnapshotFile::close()
+{
+    file.close();
+    userCount = 0;
+    usersOffset = 0;
+    stringsOffset = 0;
+    stringsSize = 0;
+}
+
+std::size_t UserSnapshotFile::getUserCount() const
+{
+    return userCount;
+}
+
+std::string_view UserSnapshotFile::getString(const std::uint32_t offset, const std::uint32_t length) const
+{
+    return { file.data() + stringsOffset + offset, length };
+}
+
+std::string_view UserSnapshotFile::getUsername(const std::size_t index) const
+{
+    const auto record = readRecord<UserRecord>(file.data(), usersOffset + index * sizeof(UserRecord));
+    return getString(record.usernameOffset, record.usernameLength);
+}
+
+User UserSnapshotFile::readUser(const std::size_t index) const
+{
+    const auto record = readRecord<UserRecord>(file.data(), usersOffset + index * sizeof(UserRecord));
+
+    User user;
+    user.username = getString(record.usernameOffset, record.usernameLength);
+    user.passwordHash = getString(record.passwordHashOffset, record.passwordHashLength);
+    user.energy = record.energy;
+    user.type = static_cast<UserType>(record.type);
+    user.isAdmin = record.isAdmin != 0;
+    return user;
+}
+
+std::optional<User> UserSnapshotFile::findUser(const std::string_view username) const
+{
+    std::size_t low = 0;
+    std::size_t high = userCount;
+
+    while (low < high)
+    {
+        const std::size_t middle = low + (high - low) / 2;
+        const std::string_view middleUsername = getUsername(middle);
+
+        if (middleUsername == username) return readUser(middle);
+        if (middleUsername < username) { low = middle + 1; }
+        else { high = middle; }
+    }
+
+    return std::nullopt;
+}
+
+StatusResponse UserSnapshotFile::loadAll(std::map<std::string, User, std::less<>>& users) const
+{
+    users.clear();
+
+    // The records are already sorted, so every insert lands at the end of the map.
+    for (std::size_t i = 0; i < userCount; ++i)
+    {
+        User user = readUser(i);
+        std::string username = user.username;
+        users.emplace_hint(users.end(), std::move(username), std::move(user));
+    }
+
+    return { true, "Loaded " + std::to_string(users.size()) + " users from the binary snapshot" };
+}
+
+StatusResponse UserSnapshotFile::save(const std::string& filename, const std::map<std::string, User, std::less<>>& users,
+                                      const Compression::Codec codec)
+{
+    // std::map iterates in username order, which is the order lookups expect.
+    std::vector<const User*> orderedUsers;
+    orderedUsers.reserve(users.size());
+    for (const User& user : users | std::views::values) { orderedUsers.push_back(&user); }
+
+    const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(
+        std::thread::hardware_concurrency(), orderedUsers.size() / MIN_USERS_PER_THREAD));
+    const std::size_t chunkSize = (orderedUsers.size() + chunkCount - 1) / chunkCount;
+
+    // Works out where each chunk's strings start, so every thread can fill its part of the buffer on its own.
+    std::vector<std::size_t> chunkStrings(chunkCount + 1, 0);
+    for (std::size_t i = 0; i < orderedUsers.size(); ++i)
+    {
+        chunkStrings[i / chunkSize + 1] += orderedUsers[i]->username.size() + orderedUsers[i]->passwordHash.size();
+    }
+    for (std::size_t chunk = 1; chunk <= chunkCount; ++chunk)
+    {
+        chunkStrings[chunk] += chunkStrings[chunk - 1];
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.userCount = static_cast<std::uint32_t>(orderedUsers.size());
+    header.usersOffset = sizeof(FileHeader);
+    header.stringsOffset = header.usersOffset + orderedUsers.size() * sizeof(UserRecord);
+    header.stringsSize = chunkStrings[chunkCount];
+
+    std::string buffer(header.stringsOffset + header.stringsSize, '\0');
+    std::memcpy(buffer.data(), &header, sizeof(FileHeader));
+
+    const auto fillChunk = [&](const std::size_t chunk)
+    {
+        const std::size_t begin = std::min(orderedUsers.size(), chunk * chunkSize);
+        const std::size_t end = std::min(orderedUsers.size(), begin + chunkSize);
+        auto nextString = static_cast<std::uint32_t>(chunkStrings[chunk]);
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const User& user = *orderedUsers[i];
+
+            UserRecord record{};
+            record.usernameOffset = nextString;
+            record.usernameLength = static_cast<std::uint32_t>(user.username.size());
+            record.passwordHashOffset = record.usernameOffset + record.usernameLength;
+            record.passwordHashLength = static_cast<std::uint32_t>(user.passwordHash.size());
+            record.energy = user.energy;
+            record.type = static_cast<std::uint8_t>(user.type);
+            record.isAdmin = user.isAdmin ? 1 : 0;
+            std::memcpy(buffer.data() + header.usersOffset + i * sizeof(UserRecord), &record, sizeof(UserRecord));
+
+            char* strings = buffer.data() + header.stringsOffset;
+            std::memcpy(strings + record.usernameOffset, user.username.data(), record.usernameLength);
+            std::memcpy(strings + record.passwordHashOffset, user.passwordHash.data(), record.passwordHashLength);
+
+            nextString = record.passwordHashOffset + record.passwordHashLength;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        workers.emplace_back(fillChunk, chunk);
+    }
+
+    fillChunk(0);
+    for (std::thread& worker : workers) { worker.join(); }
+
+    // A failed write never replaces the last good snapshot.
+    AtomicFileWriter output(filename);
+    output.setCompression(codec);
+    if (!output.open())
+    {
+        return { false, "Could not open " + filename };
+    }
+
+    output.write(buffer);
+    if (const StatusResponse status = output.commit(); !status.success)
+    {
+        return status;
+    }
+
+    const std::string compression = codec == Compression::Codec::None
+        ? ""
+        : ", " + Compression::codecName(codec) + " " + output.getStats().describe();
+
+    return { true, "Saved " + std::to_string(users.size()) + " users (" + std::to_string(buffer.size()) + " bytes" +
+        compression + ") to " + filename };
+}
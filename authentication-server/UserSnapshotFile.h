@@ -0,0 +1,61 @@
+﻿#ifndef USERSNAPSHOTFILE_H
+#define USERSNAPSHOTFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "structs/StatusResponse.h"
+#include "structs/User.h"
+#include "utilities/Compression.h"
+#include "utilities/MappedFile.h"
+
+// The binary user snapshot. The file is mapped into memory and users are read straight out of it,
+// either all at once on startup or one at a time by username.
+//
+// Layout (little-endian):
+//   header       magic "USNP", version, user count and the offsets of the sections below
+//   users        fixed-size records sorted by username, so the table doubles as the lookup index
+//   strings      the usernames and password hashes, referenced by offset and length
+class UserSnapshotFile
+{
+public:
+
+    static constexpr std::uint32_t VERSION = 1;
+
+    // Maps a snapshot file and checks that every record lies within it.
+    StatusResponse open(const std::string& filename);
+    void close();
+
+    [[nodiscard]] std::size_t getUserCount() const;
+    [[nodiscard]] std::string_view getUsername(std::size_t index) const;
+
+    // Reads one user.
+    [[nodiscard]] User readUser(std::size_t index) const;
+
+    // Looks a user up by username without loading anyone else.
+    [[nodiscard]] std::optional<User> findUser(std::string_view username) const;
+
+    // Loads every user.
+    StatusResponse loadAll(std::map<std::string, User, std::less<>>& users) const;
+
+    // Writes users to a snapshot file, filling in the records on several threads.
+    // The file is only replaced once the new one is complete and on disk.
+    static StatusResponse save(const std::string& filename, const std::map<std::string, User, std::less<>>& users,
+                               Compression::Codec codec = Compression::Codec::None);
+
+private:
+
+    [[nodiscard]] std::string_view getString(std::uint32_t offset, std::uint32_t length) const;
+
+    MappedFile file;
+    std::size_t userCount = 0;
+    std::size_t usersOffset = 0;
+    std::size_t stringsOffset = 0;
+    std::size_t stringsSize = 0;
+};
+
+#endif //USERSNAPSHOTFILE_H
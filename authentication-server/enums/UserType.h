@@ -1,6 +1,8 @@
 ﻿#ifndef USERTYPE_H
 #define USERTYPE_H
 
+#include <string_view>
+
 enum class UserType : std::uint8_t
 {
     Freemium = 50,
@@ -10,7 +12,7 @@ enum class UserType : std::uint8_t
     Platinum = 150
 };
 
-inline std::optional<UserType> stringToUserType(const std::string& string)
+inline std::optional<UserType> stringToUserType(const std::string_view string)
 {
     if (string == "Freemium") return UserType::Freemium;
     if (string == "Bronze") return UserType::Bronze;
@@ -5,24 +5,63 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <shared_mutex>
 #include <fstream>
+#include <filesystem>
+#include <memory>
 #include <random>
 #include <windows.h>
 #include <nlohmann/json.hpp>
 
 #include "Structs/JsonMessage.h"
 #include "Structs/User.h"
+#include "UserFlusher.h"
+#include "UserSnapshotFile.h"
+#include "storage/JsonFileStore.h"
+#include "storage/LogStructuredStore.h"
+#include "utilities/ActionTable.h"
+#include "utilities/CannedResponse.h"
+#include "utilities/CommandLineUtils.h"
+#include "utilities/Compression.h"
 #include "utilities/HashUtils.h"
 #include "utilities/JsonHelper.h"
+#include "utilities/RandomUtils.h"
+#include "utilities/ResponseWriter.h"
+#include "utilities/WireProtocol.h"
 
 namespace
 {
     const std::string USERS_FILE = "users.json";
-
-    std::map<std::string, User> users;
+    const std::string USERS_SNAPSHOT_FILE = "users.bin";
+    const std::string USERS_LOG_FILE = "users.log";
+    const std::string USERS_STORE_DIRECTORY = "users.db";
+
+    // The key-value store the users are saved to, if one was picked with --storage.
+    std::unique_ptr<KeyValueStore> userStore;
+
+    // Where to also write the users as JSON on shutdown, if anywhere.
+    std::optional<std::string> jsonExportFilename;
+
+    // How the snapshot, the log and the JSON export are compressed.
+    Compression::Codec fileCodec = Compression::Codec::None;
+
+    // The most common errors, serialised once at startup.
+    const CannedResponse INVALID_TOKEN(false, "Invalid authentication token");
+    const CannedResponse INVALID_PASSWORD(false, "Invalid password");
+    const CannedResponse USER_NOT_FOUND(false, "User not found");
+    const CannedResponse USER_EXISTS(false, "User already exists");
+    const CannedResponse PLAYER_NOT_FOUND(false, "Player not found");
+    const CannedResponse TARGET_NOT_FOUND(false, "Target user not found");
+    const CannedResponse NOT_ADMIN(false, "Insufficient permissions. Admin access required");
+
+    std::map<std::string, User, std::less<>> users;
+    std::shared_mutex usersMutex; // Guards the users map and every user in it.
+    UserFlusher userFlusher(users, usersMutex, USERS_SNAPSHOT_FILE, USERS_LOG_FILE);
+
+    // How often the changed users are written to the log, which bounds what a crash can lose.
+    std::chrono::seconds flushInterval { 5 };
     std::atomic serverRunning{ true };
     SOCKET listenSocket = INVALID_SOCKET;
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
 
     // Shuts the server down gracefully.
     void performShutdown()
@@ -31,8 +70,19 @@ namespace
 
         std::cout << "\nShutting down the authentication server..." << std::endl;
 
-        const StatusResponse status = JsonHelper::saveUsersToFile(USERS_FILE, users);
-        std::cout << status.message << std::endl;
+        // Only the users changed since the last background flush need saving.
+        userFlusher.stop();
+        const StatusResponse status = userFlusher.close();
+        std::cout << (status.message.empty() ? "No unsaved user changes" : status.message) << std::endl;
+
+        if (jsonExportFilename.has_value())
+        {
+            std::shared_lock usersLock(usersMutex);
+            const StatusResponse exportStatus = JsonHelper::saveUsersToFile(jsonExportFilename.value(), users, fileCodec);
+            std::cout << exportStatus.message << std::endl;
+        }
+
+        if (userStore != nullptr) { userStore->close(); }
 
         if (listenSocket != INVALID_SOCKET)
         {
@@ -103,12 +153,13 @@ namespace
         adminUser.isAdmin = true;
 
         users[adminUsername] = adminUser;
+        userFlusher.markDirty(adminUsername);
     }
 
     // Verifies that passwords are valid.
     // They must be between 8 and 20 characters and contain, at least, one uppercase and one lowercase letter,
     // a digit, and a special character.
-    bool isValidPassword(const std::string& password)
+    bool isValidPassword(const std::string_view password)
     {
         if (password.length() < 8 || password.length() > 20)
         {
@@ -129,271 +180,338 @@ namespace
     }
 
     // Validates the user's auth token (very simplified!).
-    bool validateToken(const std::string& token, const std::string& username)
+    bool validateToken(const std::string_view token, const std::string_view username)
     {
-        const std::string expectedPrefix = "AUTH_" + username + "_";
-        return token.substr(0, expectedPrefix.length()) == expectedPrefix;
+        // Tokens look like AUTH_<username>_<time>.
+        constexpr std::string_view prefix = "AUTH_";
+        return token.starts_with(prefix)
+            && token.substr(prefix.size()).starts_with(username)
+            && token.substr(prefix.size() + username.size()).starts_with('_');
     }
 
     // Handles the 'register' command.
-    std::string handleRegister(const std::string& username, const std::string& password)
+    void handleRegister(ResponseWriter& response, const std::string_view username, const std::string_view password)
     {
-        if (users.contains(username))
         {
-            return JsonHelper::createResponse(false, "User already exists");
+            std::shared_lock usersLock(usersMutex);
+            if (users.contains(username))
+            {
+                return response.reply(USER_EXISTS);
+            }
         }
 
         if (!isValidPassword(password))
         {
-            return JsonHelper::createResponse(false, "Password must be 8-20 chars with upper, lower, digit, and special char");
+            return response.reply(false, "Password must be 8-20 chars with upper, lower, digit, and special char");
         }
 
+        // Hashing is slow, so it's done before taking the lock.
         User newUser;
         newUser.username = username;
         newUser.passwordHash = HashUtils::hashPassword(password);
         newUser.type = UserType::Freemium;
         newUser.energy = 100;
 
-        users[username] = newUser;
+        std::unique_lock usersLock(usersMutex);
+
+        // Someone else may have registered the name in the meantime.
+        if (users.contains(username))
+        {
+            return response.reply(USER_EXISTS);
+        }
+
+        users[newUser.username] = newUser;
+        userFlusher.markDirty(newUser.username);
 
         std::cout << "New user registered: " << username << std::endl;
-        return JsonHelper::createResponse(true, "User registered successfully");
+        return response.reply(true, "User registered successfully");
     }
 
     // Handles the 'login' command.
-    std::string handleLogin(const std::string& username, const std::string& password)
+    void handleLogin(ResponseWriter& response, const std::string_view username, const std::string_view password)
     {
+        std::shared_lock usersLock(usersMutex);
+
         const auto it = users.find(username);
 
         if (it == users.end())
         {
-            return JsonHelper::createResponse(false, "User not found");
+            return response.reply(USER_NOT_FOUND);
         }
 
         if (const User& user = it->second; !HashUtils::verifyPassword(password, user.passwordHash))
         {
-            return JsonHelper::createResponse(false, "Invalid password");
+            return response.reply(INVALID_PASSWORD);
         }
 
         // Generates the auth token.
-        const std::string token = "AUTH_" + username + "_" + std::to_string(time(nullptr));
+        const std::string token = "AUTH_" + it->first + "_" + std::to_string(time(nullptr));
 
         const User& user = it->second;
-        json responseData;
-        responseData["max_connections"] = user.type;
 
         std::cout << "User logged in: " << username << " (Type: " << userTypeToString(user.type)
               << ", Max connections: " << static_cast<int>(user.type) << ")" << std::endl;
-        return JsonHelper::createResponse(true, "Login successful", token);
+
+        response.begin(true, "Login successful")
+            .field("token", token);
+        response.end();
     }
 
     // Handles the 'check_energy' command.
-    std::string handleCheckEnergy(const std::string& username, const std::string& token)
+    void handleCheckEnergy(ResponseWriter& response, const std::string_view username, const std::string_view token)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::unique_lock usersLock(usersMutex);
 
         const auto it = users.find(username);
         if (it == users.end())
         {
-            return JsonHelper::createResponse(false, "User not found");
+            return response.reply(USER_NOT_FOUND);
         }
 
         User& user = it->second;
 
         std::uniform_int_distribution energyCost(1, 2);
-        int cost = energyCost(rng);
+        int cost = energyCost(RandomUtils::generator());
 
         if (user.energy < cost)
         {
-            json responseData;
-            responseData["current_energy"] = user.energy;
-            responseData["required_energy"] = cost;
-            return JsonHelper::createResponse(false, "Insufficient energy", token, responseData);
+            response.begin(false, "Insufficient energy")
+                .field("token", token)
+                .beginData()
+                .field("current_energy", user.energy)
+                .field("required_energy", cost);
+            response.end();
+            return;
         }
 
         user.energy -= cost;
-
-        json responseData;
-        responseData["energy_cost"] = cost;
-        responseData["remaining_energy"] = user.energy;
-        responseData["username"] = username;
+        userFlusher.markDirty(it->first);
 
         std::cout << "Energy deducted for " << username << ": -" << cost << " (remaining: " << user.energy << ")" << std::endl;
 
-        return JsonHelper::createResponse(true, "Energy deducted successfully", token, responseData);
+        response.begin(true, "Energy deducted successfully")
+            .field("token", token)
+            .beginData()
+            .field("energy_cost", cost)
+            .field("remaining_energy", user.energy)
+            .field("username", username);
+        response.end();
     }
 
     // Handles the 'get_user_info' command.
-    std::string handleGetUserInfo(const std::string& username, const std::string& token)
+    void handleGetUserInfo(ResponseWriter& response, const std::string_view username, const std::string_view token)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::shared_lock usersLock(usersMutex);
 
         const auto it = users.find(username);
         if (it == users.end())
         {
-            return JsonHelper::createResponse(false, "User not found");
+            return response.reply(USER_NOT_FOUND);
         }
 
         const User& user = it->second;
 
-        json responseData;
-        responseData["username"] = user.username;
-        responseData["type"] = userTypeToString(user.type);
-        responseData["energy"] = user.energy;
-        responseData["connection_limit"] = user.type;
-
-        return JsonHelper::createResponse(true, "User info retrieved", token, responseData);
+        response.begin(true, "User info retrieved")
+            .field("token", token)
+            .beginData()
+            .field("username", user.username)
+            .field("type", userTypeToString(user.type))
+            .field("energy", user.energy)
+            .field("connection_limit", static_cast<int>(user.type));
+        response.end();
     }
 
     // Handles the 'remove_user' command.
-    std::string handleRemoveUser(const std::string& username, const std::string& token, const std::string& targetUser)
+    void handleRemoveUser(ResponseWriter& response, const std::string_view username, const std::string_view token, const std::string_view targetUser)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::unique_lock usersLock(usersMutex);
 
         const auto it = users.find(username);
         if (it == users.end())
         {
-            return JsonHelper::createResponse(false, "User not found");
+            return response.reply(USER_NOT_FOUND);
         }
 
         if (!it->second.isAdmin)
         {
-            return JsonHelper::createResponse(false, "Insufficient permissions. Admin access required");
+            return response.reply(NOT_ADMIN);
         }
 
         if (targetUser == username)
         {
-            return JsonHelper::createResponse(false, "You may not remove yourself");
+            return response.reply(false, "You may not remove yourself");
         }
 
         const auto targetIt = users.find(targetUser);
         if (targetIt == users.end())
         {
-            return JsonHelper::createResponse(false, "Target user not found");
+            return response.reply(TARGET_NOT_FOUND);
         }
 
+        userFlusher.markDirty(targetIt->first);
         users.erase(targetIt);
 
-        json responseData;
-        responseData["removed_user"] = targetUser;
-        responseData["remaining_users"] = users.size();
-
-        return JsonHelper::createResponse(true, "User removed successfully: " + targetUser, token, responseData);
+        response.begin(true, {"User removed successfully: ", targetUser})
+            .field("token", token)
+            .beginData()
+            .field("removed_user", targetUser)
+            .field("remaining_users", users.size());
+        response.end();
     }
 
     // Handles the 'modify_type' command.
-    std::string handleModifyType(const std::string& username, const std::string& token, const std::string& targetUser, const std::string& newType)
+    void handleModifyType(ResponseWriter& response, const std::string_view username, const std::string_view token, const std::string_view targetUser, const std::string_view newType)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::unique_lock usersLock(usersMutex);
 
         const auto it = users.find(username);
         if (it == users.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         if (!it->second.isAdmin)
         {
-            return JsonHelper::createResponse(false, "Insufficient permissions. Admin access required");
+            return response.reply(NOT_ADMIN);
         }
 
         if (targetUser == username)
         {
-            return JsonHelper::createResponse(false, "You may not modify your type");
+            return response.reply(false, "You may not modify your type");
         }
 
         const auto targetIt = users.find(targetUser);
         if (targetIt == users.end())
         {
-            return JsonHelper::createResponse(false, "Target user not found");
+            return response.reply(TARGET_NOT_FOUND);
         }
 
         const std::optional<UserType> newUserTypeOpt = stringToUserType(newType);
         if (!newUserTypeOpt.has_value())
         {
-            return JsonHelper::createResponse(false, "Invalid player type. Valid types: Freemium, Bronze, Silver, Gold, Platinum");
+            return response.reply(false, "Invalid player type. Valid types: Freemium, Bronze, Silver, Gold, Platinum");
         }
 
         const UserType newUserType = newUserTypeOpt.value();
         targetIt->second.type = newUserType;
+        userFlusher.markDirty(targetIt->first);
+
+        response.begin(true, {"User type modified successfully: ", targetUser, " -> ", newType})
+            .field("token", token)
+            .beginData()
+            .field("target_user", targetUser)
+            .field("new_type", userTypeToString(newUserType));
+        response.end();
+    }
 
-        json responseData;
-        responseData["target_user"] = targetUser;
-        responseData["new_type"] = userTypeToString(newUserType);
-
-        return JsonHelper::createResponse(true, "User type modified successfully: " + targetUser + " -> " + newType, token, responseData);
+    // What handleClient needs to know to run an action.
+    struct Action
+    {
+        std::string_view name;
+        void (*handler)(ResponseWriter& response, const JsonMessage& msg);
+
+        // Whether the request's token has to be valid for its username.
+        bool needsAuth;
+    };
+
+    // Adding an action only takes an entry here.
+    constexpr ActionTable ACTIONS(std::array<Action, 6>{{
+        {"register", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleRegister(response, msg.username, msg.password); }, false},
+        {"login", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleLogin(response, msg.username, msg.password); }, false},
+        {"check_energy", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleCheckEnergy(response, msg.username, msg.authToken); }, true},
+        {"get_user_info", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleGetUserInfo(response, msg.username, msg.authToken); }, true},
+        {"remove_user", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleRemoveUser(response, msg.username, msg.authToken, msg.targetUser); }, true},
+        {"modify_type", [](ResponseWriter& response, const JsonMessage& msg)
+            { handleModifyType(response, msg.username, msg.authToken, msg.targetUser, msg.newType); }, true}
+    }});
+
+    // Sends a finished response.
+    void sendResponse(const SOCKET clientSocket, ResponseWriter& response)
+    {
+        const std::string_view bytes = response.finish();
+        send(clientSocket, bytes.data(), static_cast<int>(bytes.size()), 0);
     }
 
     // Handles client connections.
     void handleClient(const SOCKET clientSocket, const int clientId)
     {
         std::cout << "Client " << clientId << " connected" << std::endl;
+        RandomUtils::seedThread(clientId);
 
         char buffer[1024];
         std::string messageBuffer;
+        WireProtocol::TextScan messageScan; // How far the JSON in messageBuffer has been scanned.
+        std::string completeMessage; // Requests are parsed in place here, so it must outlive the parsed message.
+
+        // How messages are encoded, switched with the set_protocol action.
+        WireProtocol::Format protocol = WireProtocol::Format::Json;
+
+        // Responses are written here, so its capacity is reused from one message to the next.
+        std::string responseBuffer;
 
         while (serverRunning) // Handles the client until they disconnect.
         {
-            if (const int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0); bytesReceived > 0)
+            if (const int bytesReceived = recv(clientSocket, buffer, sizeof(buffer), 0); bytesReceived > 0)
             {
-                buffer[bytesReceived] = '\0';
-                messageBuffer += std::string(buffer);
+                // Binary messages can hold zero bytes, so the exact length is appended.
+                messageBuffer.append(buffer, bytesReceived);
 
-                // Looks for the complete JSON message.
-                if (const size_t pos = messageBuffer.find('}'); pos != std::string::npos)
+                // Handles every complete message received so far before waiting for more.
+                WireProtocol::FrameResult frame;
+                while ((frame = WireProtocol::takeMessage(messageBuffer, protocol, completeMessage, messageScan)) == WireProtocol::FrameResult::Complete)
                 {
-                    std::string completeMessage = messageBuffer.substr(0, pos + 1);
-                    messageBuffer = messageBuffer.substr(pos + 1);
-
-                    std::cout << "Client " << clientId << " sent: " << completeMessage << std::endl;
-
-                    // Parses messages sent by the user.
-                    JsonMessage msg = JsonHelper::parseMessage(completeMessage);
-                    std::string response;
-
-                    if (msg.action == "register")
+                    if (protocol == WireProtocol::Format::Json)
                     {
-                        response = handleRegister(msg.username, msg.password);
+                        std::cout << "Client " << clientId << " sent: " << completeMessage << std::endl;
                     }
-                    else if (msg.action == "login")
-                    {
-                        response = handleLogin(msg.username, msg.password);
-                    }
-                    else if (msg.action == "check_energy")
+                    else
                     {
-                        response = handleCheckEnergy(msg.username, msg.authToken);
+                        std::cout << "Client " << clientId << " sent a " << completeMessage.size() << " byte "
+                                  << WireProtocol::formatName(protocol) << " message" << std::endl;
                     }
-                    else if (msg.action == "get_user_info")
+
+                    // Parses messages sent by the user.
+                    JsonMessage msg = JsonHelper::parseMessage(completeMessage, protocol);
+                    ResponseWriter response(responseBuffer, protocol);
+
+                    if (msg.action == "set_protocol")
                     {
-                        response = handleGetUserInfo(msg.username, msg.authToken);
+                        // The reply still goes out in the old format.
+                        const std::optional<WireProtocol::Format> newProtocol = WireProtocol::parseFormat(msg.protocol);
+                        if (newProtocol.has_value()) { response.reply(true, {"Switched to ", msg.protocol}); }
+                        else { response.reply(false, {"Unknown protocol: ", msg.protocol}); }
+
+                        sendResponse(clientSocket, response);
+                        if (newProtocol.has_value()) { protocol = newProtocol.value(); }
+                        continue;
                     }
-                    else if (msg.action == "remove_user")
+
+                    if (const Action* action = ACTIONS.find(msg.action); action == nullptr)
                     {
-                        response = handleRemoveUser(msg.username, msg.authToken, msg.targetUser);
+                        response.reply(false, {"Unknown action: ", msg.action});
                     }
-                    else if (msg.action == "modify_type")
+                    else if (action->needsAuth && !validateToken(msg.authToken, msg.username))
                     {
-                        response = handleModifyType(msg.username, msg.authToken, msg.targetUser, msg.newType);
+                        response.reply(INVALID_TOKEN);
                     }
                     else
                     {
-                        response = JsonHelper::createResponse(false, "Unknown action: " + msg.action);
+                        action->handler(response, msg);
                     }
 
                     // Sends the response back.
-                    send(clientSocket, response.c_str(), static_cast<int>(response.length()), 0);
+                    sendResponse(clientSocket, response);
+                }
+
+                if (frame == WireProtocol::FrameResult::TooLarge)
+                {
+                    std::cout << "Client " << clientId << " sent a message too large to accept" << std::endl;
+                    break;
                 }
             }
             else if (bytesReceived == 0)
@@ -442,13 +560,144 @@ int main(int argc, char* argv[])
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
-    // Loads users from the file.
-    std::cout << "Loading user data..." << std::endl;
-    const StatusResponse status = JsonHelper::loadUsersFromFile(USERS_FILE, users);
-    std::cout << status.message << "\n" << std::endl;
+    // Seeds the random rolls. Starting again with the same --seed replays the same rolls per client.
+    std::uint64_t rootSeed = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (const std::optional<std::string> seedOption = CommandLineUtils::getOption(argc, argv, "seed"); seedOption.has_value())
+    {
+        try
+        {
+            rootSeed = std::stoull(seedOption.value());
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid seed '" << seedOption.value() << "', using a random one" << std::endl;
+        }
+    }
+
+    RandomUtils::setRootSeed(rootSeed);
+    std::cout << "Random seed: " << rootSeed << std::endl;
+
+    jsonExportFilename = CommandLineUtils::getOption(argc, argv, "export-json");
+
+    if (const std::optional<std::string> intervalOption = CommandLineUtils::getOption(argc, argv, "flush-interval"); intervalOption.has_value())
+    {
+        try
+        {
+            flushInterval = std::chrono::seconds(std::max(1LL, std::stoll(intervalOption.value())));
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid flush interval '" << intervalOption.value() << "', using the default" << std::endl;
+        }
+    }
+
+    // Compresses the snapshot, the log and the JSON export: "none", "builtin", "lz4", "zstd" or "auto".
+    // Files are read back whichever codec wrote them.
+    if (const std::optional<std::string> compressionOption = CommandLineUtils::getOption(argc, argv, "compression"); compressionOption.has_value())
+    {
+        if (const std::optional<Compression::Codec> codec = Compression::parseCodec(compressionOption.value()); codec.has_value())
+        {
+            fileCodec = codec.value();
+        }
+        else
+        {
+            std::cout << "Unknown or unavailable compression '" << compressionOption.value() << "', leaving files uncompressed" << std::endl;
+        }
+    }
+
+    userFlusher.setCompression(fileCodec);
+
+    // Saves the users to a key-value store instead of the binary snapshot: "lsm" for the log-structured
+    // store, "json" for the JSON file.
+    std::string userStorePath;
+    if (const std::optional<std::string> storageOption = CommandLineUtils::getOption(argc, argv, "storage"); storageOption.has_value())
+    {
+        if (storageOption.value() == "lsm")
+        {
+            userStore = std::make_unique<LogStructuredStore>(USERS_STORE_DIRECTORY);
+            userStorePath = USERS_STORE_DIRECTORY;
+        }
+        else if (storageOption.value() == "json")
+        {
+            userStore = std::make_unique<JsonFileStore>(USERS_FILE);
+            userStorePath = USERS_FILE;
+        }
+        else
+        {
+            std::cout << "Unknown storage '" << storageOption.value() << "', using the binary snapshot" << std::endl;
+        }
+    }
+
+    // Loads users from the key-value store, if one is used and already exists.
+    bool snapshotLoaded = false;
+    if (userStore != nullptr)
+    {
+        std::cout << "Opening the " << userStore->describe() << "..." << std::endl;
+        const bool storeExisted = std::filesystem::exists(userStorePath);
+
+        const StatusResponse storeStatus = userStore->open();
+        std::cout << storeStatus.message << std::endl;
+        if (!storeStatus.success)
+        {
+            ExitProcess(EXIT_FAILURE);
+        }
+
+        userFlusher.useStore(*userStore);
+
+        if (storeExisted)
+        {
+            userStore->scan([](const std::string& username, const std::string& value)
+            {
+                try
+                {
+                    users.emplace(username, JsonHelper::jsonToUser(json::parse(value)));
+                }
+                catch (const std::exception& exception)
+                {
+                    std::cout << "Skipping the unreadable user '" << username << "': " << exception.what() << std::endl;
+                }
+            });
+            std::cout << "Loaded " << users.size() << " users from the store" << std::endl;
+            snapshotLoaded = true;
+        }
+        else
+        {
+            // Compaction below copies everyone loaded into the new store.
+            std::cout << "The store is new, so the existing users are imported into it" << std::endl;
+        }
+    }
+
+    // Loads users from the binary snapshot, or imports the JSON file if there isn't one yet.
+    if (!snapshotLoaded)
+    {
+        std::cout << "Loading user data..." << std::endl;
+
+        UserSnapshotFile snapshotFile;
+        const StatusResponse mapStatus = snapshotFile.open(USERS_SNAPSHOT_FILE);
+        std::cout << mapStatus.message << std::endl;
+
+        const StatusResponse status = mapStatus.success
+            ? snapshotFile.loadAll(users)
+            : JsonHelper::loadUsersFromFile(USERS_FILE, users);
+        std::cout << status.message << std::endl;
+        snapshotLoaded = mapStatus.success && userStore == nullptr;
+    }
+
+    // Recovers the changes flushed after the last compaction.
+    const StatusResponse logStatus = userFlusher.open();
+    std::cout << logStatus.message << "\n" << std::endl;
 
     ensureAdminAccountExists();
 
+    // Imported users only exist in memory until they're written to a snapshot or the store.
+    if (!snapshotLoaded)
+    {
+        const StatusResponse compactStatus = userFlusher.compact();
+        std::cout << compactStatus.message << std::endl;
+    }
+
+    userFlusher.start(flushInterval);
+
     // Initialises Winsock (version 2.2).
     WSADATA wsaData;
     if (const int result = WSAStartup(MAKEWORD(2, 2), &wsaData); result != 0)
@@ -0,0 +1,38 @@
+﻿#ifndef JSONFILESTORE_H
+#define JSONFILESTORE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "KeyValueStore.h"
+
+// Keeps every record in memory and writes them all out as one JSON array on flush.
+// Values must be JSON objects holding a "username" field.
+class JsonFileStore : public KeyValueStore
+{
+public:
+
+    explicit JsonFileStore(std::string filename);
+
+    StatusResponse open() override;
+    void close() override;
+
+    std::optional<std::string> get(const std::string& key) override;
+    StatusResponse put(const std::string& key, const std::string& value) override;
+    StatusResponse remove(const std::string& key) override;
+    StatusResponse scan(const Visitor& visit) override;
+    StatusResponse flush() override;
+
+    [[nodiscard]] std::string describe() const override;
+
+private:
+
+    std::string filename;
+
+    std::mutex storeMutex;
+    std::map<std::string, std::string> records;
+    bool changed = false;
+};
+
+#endif //JSONFILESTORE_H
@@ -1,20 +1,40 @@
-﻿#ifndef JSONMESSAGE_H
-#define JSONMESSAGE_H
+﻿#ifndef MESSAGE_H
+#define MESSAGE_H
 
-#include <string>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
 
+// A parsed request. The fields point into the message it was parsed from, which must outlive them.
 struct JsonMessage
 {
-    std::string action;
-    std::string username;
-    std::string password;
-    std::string authToken;
-    std::string response;
-    std::string targetUser;
-    std::string newType;
+    std::string_view action;
+    std::string_view username;
+    std::string_view password;
+    std::string_view authToken;
+    std::string_view response;
+    std::string_view targetUser;
+    std::string_view newType;
+    std::string_view protocol;
     bool success;
 
     JsonMessage() : success(false) {}
 };
 
-#endif //JSONMESSAGE_H
+// The keys requests are sent with, in the order they're read.
+inline constexpr std::array<std::pair<std::string_view, std::string_view JsonMessage::*>, 7> JSON_MESSAGE_TEXT_FIELDS = {{
+    {"action", &JsonMessage::action},
+    {"username", &JsonMessage::username},
+    {"password", &JsonMessage::password},
+    {"token", &JsonMessage::authToken},
+    {"target_user", &JsonMessage::targetUser},
+    {"new_type", &JsonMessage::newType},
+    {"protocol", &JsonMessage::protocol}
+}};
+
+inline constexpr std::array<std::pair<std::string_view, bool JsonMessage::*>, 0> JSON_MESSAGE_FLAG_FIELDS = {};
+
+inline constexpr std::array<std::pair<std::string_view, std::uint64_t JsonMessage::*>, 0> JSON_MESSAGE_NUMBER_FIELDS = {};
+
+#endif //MESSAGE_H
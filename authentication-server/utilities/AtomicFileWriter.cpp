@@ -0,0 +1,204 @@
+﻿#include "AtomicFileWriter.h"
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "FileUtils.h"
+
+namespace
+{
+    // Below this many items per thread, starting the threads costs more than it saves.
+    constexpr std::size_t MIN_ITEMS_PER_SHARD = 256;
+
+    // How many items each thread serialises per batch, which bounds how much is held in memory.
+    constexpr std::size_t ITEMS_PER_SHARD = 4096;
+}
+
+AtomicFileWriter::AtomicFileWriter(std::string filename)
+    : filename(std::move(filename)), temporaryFilename(this->filename + ".tmp")
+{
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    discard();
+}
+
+void AtomicFileWriter::setCompression(const Compression::Codec codec)
+{
+    this->codec = codec;
+}
+
+bool AtomicFileWriter::open()
+{
+    discard();
+
+    file = fopen(temporaryFilename.c_str(), "wb");
+    failed = file == nullptr;
+    return !failed;
+}
+
+bool AtomicFileWriter::write(const std::string_view data)
+{
+    if (codec == Compression::Codec::None) return writeToFile(data);
+
+    pending.append(data);
+    return pending.size() < Compression::BLOCK_SIZE || writePending(false);
+}
+
+bool AtomicFileWriter::writeInShards(const std::size_t itemCount, const ShardSerializer& serialize)
+{
+    const std::size_t threadCount = std::max<std::size_t>(1, std::min<std::size_t>(
+        std::thread::hardware_concurrency(), itemCount / MIN_ITEMS_PER_SHARD));
+    const std::size_t batchSize = threadCount * ITEMS_PER_SHARD;
+
+    std::vector<std::string> shards(threadCount);
+    std::vector<std::string> compressedShards(threadCount);
+    std::vector<Compression::Stats> shardStats(threadCount);
+    std::vector<std::exception_ptr> errors(threadCount);
+
+    // Shards are compressed on their own threads, so whatever was written before goes out first.
+    if (codec != Compression::Codec::None && !writePending(true)) return false;
+    for (std::size_t batchBegin = 0; batchBegin < itemCount; batchBegin += batchSize)
+    {
+        const std::size_t batchEnd = std::min(itemCount, batchBegin + batchSize);
+        const std::size_t shardSize = (batchEnd - batchBegin + threadCount - 1) / threadCount;
+
+        const auto serializeShard = [&](const std::size_t shard)
+        {
+            const std::size_t begin = std::min(batchEnd, batchBegin + shard * shardSize);
+            const std::size_t end = std::min(batchEnd, begin + shardSize);
+
+            shards[shard].clear();
+
+            try
+            {
+                if (begin < end) serialize(begin, end, shards[shard]);
+
+                if (codec != Compression::Codec::None)
+                {
+                    compressedShards[shard].clear();
+                    const std::string_view shardData = shards[shard];
+                    for (std::size_t blockStart = 0; blockStart < shardData.size(); blockStart += Compression::BLOCK_SIZE)
+                    {
+                        Compression::appendBlock(codec, shardData.substr(blockStart, Compression::BLOCK_SIZE),
+                                                 compressedShards[shard], &shardStats[shard]);
+                    }
+                }
+            }
+            catch (...)
+            {
+                errors[shard] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t shard = 1; shard < threadCount; ++shard)
+        {
+            workers.emplace_back(serializeShard, shard);
+        }
+
+        serializeShard(0);
+        for (std::thread& worker : workers) { worker.join(); }
+
+        // Hands a serialisation error over to the caller, as if it had been thrown on this thread.
+        for (const std::exception_ptr& error : errors)
+        {
+            if (error) std::rethrow_exception(error);
+        }
+
+        for (std::size_t shard = 0; shard < threadCount; ++shard)
+        {
+            if (codec == Compression::Codec::None)
+            {
+                if (!writeToFile(shards[shard])) return false;
+                continue;
+            }
+
+            if (!writeToFile(compressedShards[shard])) return false;
+            stats.add(shardStats[shard]);
+            shardStats[shard] = {};
+        }
+    }
+
+    return true;
+}
+
+StatusResponse AtomicFileWriter::commit()
+{
+    if (file == nullptr)
+    {
+        return { false, "Could not open " + temporaryFilename };
+    }
+
+    const bool synced = writePending(true) && FileUtils::syncFile(file);
+    const bool closed = fclose(file) == 0;
+    file = nullptr;
+
+    if (!synced || !closed)
+    {
+        discard();
+        return { false, "Could not write " + temporaryFilename };
+    }
+
+    StatusResponse status = FileUtils::replaceFile(temporaryFilename, filename);
+    if (!status.success)
+    {
+        discard();
+    }
+
+    return status;
+}
+
+const std::string& AtomicFileWriter::getFilename() const
+{
+    return filename;
+}
+
+const Compression::Stats& AtomicFileWriter::getStats() const
+{
+    return stats;
+}
+
+bool AtomicFileWriter::writeToFile(const std::string_view data)
+{
+    if (file == nullptr || failed) return false;
+
+    failed = fwrite(data.data(), 1, data.size(), file) != data.size();
+    return !failed;
+}
+
+bool AtomicFileWriter::writePending(const bool final)
+{
+    if (failed) return false;
+
+    blocks.clear();
+    std::size_t blockStart = 0;
+    while (pending.size() - blockStart >= Compression::BLOCK_SIZE || (final && blockStart < pending.size()))
+    {
+        const std::size_t blockSize = std::min(Compression::BLOCK_SIZE, pending.size() - blockStart);
+        Compression::appendBlock(codec, std::string_view(pending).substr(blockStart, blockSize), blocks, &stats);
+        blockStart += blockSize;
+    }
+
+    pending.erase(0, blockStart);
+    return writeToFile(blocks);
+}
+
+void AtomicFileWriter::discard()
+{
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+
+    std::error_code error;
+    std::filesystem::remove(temporaryFilename, error);
+    failed = false;
+    pending.clear();
+    stats = {};
+}
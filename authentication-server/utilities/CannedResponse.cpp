@@ -0,0 +1,23 @@
+﻿#include "CannedResponse.h"
+#include "ResponseWriter.h"
+
+CannedResponse::CannedResponse(const bool success, const std::string_view message)
+{
+    for (const WireProtocol::Format format : {WireProtocol::Format::Json, WireProtocol::Format::MessagePack, WireProtocol::Format::Cbor})
+    {
+        ResponseWriter writer(messages[static_cast<std::size_t>(format)], format);
+        writer.reply(success, message);
+        writer.finish();
+    }
+}
+
+std::string_view CannedResponse::getMessage(const WireProtocol::Format format) const
+{
+    return messages[static_cast<std::size_t>(format)];
+}
+
+std::string_view CannedResponse::getBody(const WireProtocol::Format format) const
+{
+    const std::string_view message = getMessage(format);
+    return format == WireProtocol::Format::Json ? message : message.substr(WireProtocol::FRAME_HEADER_SIZE);
+}
@@ -0,0 +1,83 @@
+#include "CompressedInputStream.h"
+
+namespace
+{
+    // How much plain data is read at a time.
+    constexpr std::size_t PLAIN_CHUNK_SIZE = 64 * 1024;
+}
+
+CompressedInputStream::BlockBuffer::BlockBuffer(const std::string& filename) : file(filename, std::ios::binary)
+{
+    char magic[4] = {};
+    if (file.read(magic, sizeof(magic)))
+    {
+        compressed = Compression::isBlock(std::string_view(magic, sizeof(magic)));
+    }
+
+    file.clear();
+    file.seekg(0);
+}
+
+CompressedInputStream::BlockBuffer::int_type CompressedInputStream::BlockBuffer::underflow()
+{
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    if (!file.is_open() || corrupt) return traits_type::eof();
+
+    buffer.clear();
+
+    if (!compressed)
+    {
+        buffer.resize(PLAIN_CHUNK_SIZE);
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.resize(static_cast<std::size_t>(file.gcount()));
+    }
+    else if (file.peek() != traits_type::eof())
+    {
+        block.resize(Compression::BLOCK_HEADER_SIZE);
+        const std::size_t blockSize = file.read(block.data(), static_cast<std::streamsize>(block.size()))
+            ? Compression::blockSizeFromHeader(block)
+            : 0;
+
+        if (blockSize != 0)
+        {
+            block.resize(blockSize);
+            file.read(block.data() + Compression::BLOCK_HEADER_SIZE, static_cast<std::streamsize>(blockSize - Compression::BLOCK_HEADER_SIZE));
+        }
+
+        if (blockSize == 0 || !file || Compression::readBlock(block, buffer, &stats) == 0)
+        {
+            corrupt = true;
+            return traits_type::eof();
+        }
+    }
+
+    if (buffer.empty()) return traits_type::eof();
+
+    setg(buffer.data(), buffer.data(), buffer.data() + buffer.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+CompressedInputStream::CompressedInputStream(const std::string& filename) : std::istream(nullptr), blockBuffer(filename)
+{
+    rdbuf(&blockBuffer);
+}
+
+bool CompressedInputStream::is_open() const
+{
+    return blockBuffer.file.is_open();
+}
+
+bool CompressedInputStream::isCompressed() const
+{
+    return blockBuffer.compressed;
+}
+
+bool CompressedInputStream::hasCorruptBlock() const
+{
+    return blockBuffer.corrupt;
+}
+
+const Compression::Stats& CompressedInputStream::getStats() const
+{
+    return blockBuffer.stats;
+}
@@ -0,0 +1,530 @@
+﻿#include "Compression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace
+{
+    // The first byte can't start UTF-8 text, so a block is never mistaken for a JSON line.
+    constexpr char BLOCK_MAGIC[4] = { '\xC0', 'B', 'L', 'K' };
+
+    struct BlockHeader
+    {
+        char magic[4];
+        std::uint8_t codec;
+        std::uint8_t reserved[3];
+        std::uint32_t rawSize;
+        std::uint32_t storedSize;
+        std::uint32_t checksum; // Of the stored bytes.
+    };
+
+    static_assert(sizeof(BlockHeader) == Compression::BLOCK_HEADER_SIZE);
+
+    std::uint32_t checksum(const std::string_view data)
+    {
+        std::uint32_t hash = 2166136261u;
+        for (const char byte : data)
+        {
+            hash = (hash ^ static_cast<std::uint8_t>(byte)) * 16777619u;
+        }
+        return hash;
+    }
+
+    // The built-in codec is LZ77 with the LZ4 block layout: a token holding the literal and match
+    // lengths, the literals, then a two-byte offset back into the output. The last sequence is
+    // literals only.
+    constexpr std::size_t MIN_MATCH = 4;
+    constexpr std::size_t MAX_OFFSET = 65535;
+    constexpr int HASH_BITS = 16;
+
+    std::uint32_t read32(const char* data)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void writeLength(std::size_t length, std::string& output)
+    {
+        while (length >= 255)
+        {
+            output.push_back(static_cast<char>(255));
+            length -= 255;
+        }
+        output.push_back(static_cast<char>(length));
+    }
+
+    void writeSequence(const std::string_view literals, const std::size_t offset, const std::size_t matchLength, std::string& output)
+    {
+        const std::size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+        const auto token = static_cast<std::uint8_t>((std::min<std::size_t>(literals.size(), 15) << 4) | std::min<std::size_t>(matchCode, 15));
+        output.push_back(static_cast<char>(token));
+
+        if (literals.size() >= 15) writeLength(literals.size() - 15, output);
+        output.append(literals);
+
+        if (matchLength == 0) return;
+
+        output.push_back(static_cast<char>(offset & 0xFF));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15) writeLength(matchCode - 15, output);
+    }
+
+    void builtinCompress(const std::string_view input, std::string& output, Compression::Context& context)
+    {
+        // Entries left by earlier blocks are at or below the base, so the table is only cleared when
+        // the base is about to run out.
+        std::vector<std::uint32_t>& table = context.builtinTable;
+        if (table.empty() || context.builtinBase > std::numeric_limits<std::uint32_t>::max() - 2 * Compression::BLOCK_SIZE)
+        {
+            table.assign(std::size_t{ 1 } << HASH_BITS, 0);
+            context.builtinBase = 0;
+        }
+
+        const std::uint32_t base = context.builtinBase;
+        context.builtinBase += static_cast<std::uint32_t>(input.size()) + 1;
+
+        const char* data = input.data();
+        std::size_t anchor = 0;
+        std::size_t position = 0;
+
+        while (position + MIN_MATCH <= input.size())
+        {
+            const std::uint32_t sequence = read32(data + position);
+            const std::uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            const std::uint32_t entry = table[hash];
+            table[hash] = base + static_cast<std::uint32_t>(position + 1);
+
+            const std::size_t candidate = entry > base ? entry - base : 0;
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read32(data + candidate - 1) != sequence)
+            {
+                ++position;
+                continue;
+            }
+
+            const std::size_t matchStart = candidate - 1;
+            std::size_t matchLength = MIN_MATCH;
+            while (position + matchLength < input.size() && data[matchStart + matchLength] == data[position + matchLength])
+            {
+                ++matchLength;
+            }
+
+            writeSequence(input.substr(anchor, position - anchor), position - matchStart, matchLength, output);
+            position += matchLength;
+            anchor = position;
+        }
+
+        writeSequence(input.substr(anchor), 0, 0, output);
+    }
+
+    bool readLength(const std::string_view input, std::size_t& position, std::size_t& length)
+    {
+        while (true)
+        {
+            if (position >= input.size()) return false;
+
+            const auto byte = static_cast<std::uint8_t>(input[position++]);
+            length += byte;
+            if (byte != 255) return true;
+        }
+    }
+
+    bool builtinDecompress(const std::string_view input, const std::size_t rawSize, std::string& output)
+    {
+        const std::size_t outputStart = output.size();
+        std::size_t position = 0;
+
+        while (position < input.size())
+        {
+            const auto token = static_cast<std::uint8_t>(input[position++]);
+
+            std::size_t literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(input, position, literalLength)) return false;
+            if (literalLength > input.size() - position || output.size() - outputStart + literalLength > rawSize) return false;
+
+            output.append(input.substr(position, literalLength));
+            position += literalLength;
+
+            if (position == input.size()) break;
+
+            if (input.size() - position < 2) return false;
+            const std::size_t offset = static_cast<std::uint8_t>(input[position]) | static_cast<std::uint8_t>(input[position + 1]) << 8;
+            position += 2;
+
+            std::size_t matchLength = token & 0x0F;
+            if (matchLength == 15 && !readLength(input, position, matchLength)) return false;
+            matchLength += MIN_MATCH;
+
+            if (offset == 0 || offset > output.size() - outputStart || output.size() - outputStart + matchLength > rawSize) return false;
+
+            // Copied a byte at a time, as a match can overlap the bytes it produces.
+            std::size_t source = output.size() - offset;
+            for (std::size_t i = 0; i < matchLength; ++i)
+            {
+                output.push_back(output[source++]);
+            }
+        }
+
+        return output.size() - outputStart == rawSize;
+    }
+
+    bool compressWith(const Compression::Codec codec, const std::string_view input, std::string& output, Compression::Context& context)
+    {
+        switch (codec)
+        {
+        case Compression::Codec::Builtin:
+            builtinCompress(input, output, context);
+            return true;
+
+#ifdef HAVE_LZ4
+        case Compression::Codec::Lz4:
+        {
+            if (context.lz4State.empty()) { context.lz4State.resize(LZ4_sizeofState()); }
+
+            const std::size_t start = output.size();
+            output.resize(start + LZ4_compressBound(static_cast<int>(input.size())));
+            const int written = LZ4_compress_fast_extState(context.lz4State.data(), input.data(), output.data() + start,
+                                                           static_cast<int>(input.size()), static_cast<int>(output.size() - start), 1);
+            output.resize(start + std::max(written, 0));
+            return written > 0;
+        }
+#endif
+
+#ifdef HAVE_ZSTD
+        case Compression::Codec::Zstd:
+        {
+            // Each thread keeps its context, so its buffers aren't allocated again for every block.
+            thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+
+            const std::size_t start = output.size();
+            output.resize(start + ZSTD_compressBound(input.size()));
+            const std::size_t written = ZSTD_compressCCtx(context.get(), output.data() + start, output.size() - start,
+                                                          input.data(), input.size(), 3);
+            output.resize(start + (ZSTD_isError(written) ? 0 : written));
+            return !ZSTD_isError(written);
+        }
+#endif
+
+        default:
+            return false;
+        }
+    }
+
+    bool decompressWith(const Compression::Codec codec, const std::string_view input, const std::size_t rawSize, std::string& output)
+    {
+        switch (codec)
+        {
+        case Compression::Codec::None:
+            if (input.size() != rawSize) return false;
+            output.append(input);
+            return true;
+
+        case Compression::Codec::Builtin:
+            return builtinDecompress(input, rawSize, output);
+
+#ifdef HAVE_LZ4
+        case Compression::Codec::Lz4:
+        {
+            const std::size_t start = output.size();
+            output.resize(start + rawSize);
+            const int read = LZ4_decompress_safe(input.data(), output.data() + start, static_cast<int>(input.size()), static_cast<int>(rawSize));
+            output.resize(start + std::max(read, 0));
+            return read >= 0 && static_cast<std::size_t>(read) == rawSize;
+        }
+#endif
+
+#ifdef HAVE_ZSTD
+        case Compression::Codec::Zstd:
+        {
+            thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+            const std::size_t start = output.size();
+            output.resize(start + rawSize);
+            const std::size_t read = ZSTD_decompressDCtx(context.get(), output.data() + start, rawSize, input.data(), input.size());
+            output.resize(start + (ZSTD_isError(read) ? 0 : read));
+            return !ZSTD_isError(read) && read == rawSize;
+        }
+#endif
+
+        default:
+            return false;
+        }
+    }
+}
+
+void Compression::Stats::add(const Stats& other)
+{
+    rawBytes += other.rawBytes;
+    storedBytes += other.storedBytes;
+    codecTime += other.codecTime;
+}
+
+std::string Compression::Stats::describe() const
+{
+    const double ratio = storedBytes == 0 ? 1.0 : static_cast<double>(rawBytes) / static_cast<double>(storedBytes);
+    const double seconds = std::chrono::duration<double>(codecTime).count();
+    const double megabytesPerSecond = seconds <= 0.0 ? 0.0 : static_cast<double>(rawBytes) / (1024.0 * 1024.0) / seconds;
+
+    char summary[64];
+    std::snprintf(summary, sizeof(summary), "%.2fx, %.0f MB/s", ratio, megabytesPerSecond);
+
+    return std::to_string(rawBytes) + " -> " + std::to_string(storedBytes) + " bytes (" + summary + ")";
+}
+
+std::optional<Compression::Codec> Compression::parseCodec(const std::string& name)
+{
+    if (name == "none") return Codec::None;
+    if (name == "builtin") return Codec::Builtin;
+    if (name == "lz4" && isAvailable(Codec::Lz4)) return Codec::Lz4;
+    if (name == "zstd" && isAvailable(Codec::Zstd)) return Codec::Zstd;
+
+    if (name == "auto")
+    {
+        if (isAvailable(Codec::Zstd)) return Codec::Zstd;
+        if (isAvailable(Codec::Lz4)) return Codec::Lz4;
+        return Codec::Builtin;
+    }
+
+    return std::nullopt;
+}
+
+std::string Compression::codecName(const Codec codec)
+{
+    switch (codec)
+    {
+    case Codec::None: return "none";
+    case Codec::Builtin: return "builtin";
+    case Codec::Lz4: return "lz4";
+    case Codec::Zstd: return "zstd";
+    }
+
+    return "unknown";
+}
+
+bool Compression::isAvailable(const Codec codec)
+{
+    switch (codec)
+    {
+    case Codec::None:
+    case Codec::Builtin:
+        return true;
+
+    case Codec::Lz4:
+#ifdef HAVE_LZ4
+        return true;
+#else
+        return false;
+#endif
+
+    case Codec::Zstd:
+#ifdef HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+void Compression::appendBlock(const Codec codec, const std::string_view data, std::string& output, Stats* stats)
+{
+    Context context;
+    appendBlock(codec, data, output, context, stats);
+}
+
+void Compression::appendBlock(const Codec codec, const std::string_view data, std::string& output, Context& context, Stats* stats)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    const std::size_t headerStart = output.size();
+    output.resize(headerStart + sizeof(BlockHeader));
+
+    BlockHeader header{};
+    std::memcpy(header.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+    header.codec = static_cast<std::uint8_t>(codec);
+    header.rawSize = static_cast<std::uint32_t>(data.size());
+
+    // Data the codec can't shrink is stored as it is.
+    if (codec == Codec::None || !compressWith(codec, data, output, context) || output.size() - headerStart - sizeof(BlockHeader) >= data.size())
+    {
+        output.resize(headerStart + sizeof(BlockHeader));
+        output.append(data);
+        header.codec = static_cast<std::uint8_t>(Codec::None);
+    }
+
+    const std::string_view stored(output.data() + headerStart + sizeof(BlockHeader), output.size() - headerStart - sizeof(BlockHeader));
+    header.storedSize = static_cast<std::uint32_t>(stored.size());
+    header.checksum = checksum(stored);
+    std::memcpy(output.data() + headerStart, &header, sizeof(BlockHeader));
+
+    if (stats != nullptr)
+    {
+        stats->rawBytes += data.size();
+        stats->storedBytes += sizeof(BlockHeader) + stored.size();
+        stats->codecTime += std::chrono::steady_clock::now() - startTime;
+    }
+}
+
+void Compression::appendLineBlocks(const Codec codec, std::string_view lines, std::string& output, Stats* stats)
+{
+    Context context;
+
+    while (!lines.empty())
+    {
+        std::size_t blockSize = lines.size();
+        if (blockSize > BLOCK_SIZE)
+        {
+            const std::size_t lastBreak = lines.rfind('\n', BLOCK_SIZE - 1);
+            if (lastBreak == std::string_view::npos)
+            {
+                // A single line longer than a block.
+                const std::size_t lineEnd = lines.find('\n');
+                const std::size_t lineSize = lineEnd == std::string_view::npos ? lines.size() : lineEnd + 1;
+                output.append(lines.substr(0, lineSize));
+                lines.remove_prefix(lineSize);
+                continue;
+            }
+
+            blockSize = lastBreak + 1;
+        }
+
+        appendBlock(codec, lines.substr(0, blockSize), output, context, stats);
+        lines.remove_prefix(blockSize);
+    }
+}
+
+bool Compression::isBlock(const std::string_view data)
+{
+    return data.size() >= sizeof(BLOCK_MAGIC) && std::memcmp(data.data(), BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0;
+}
+
+std::size_t Compression::blockSizeFromHeader(const std::string_view header)
+{
+    if (header.size() < sizeof(BlockHeader) || !isBlock(header)) return 0;
+
+    BlockHeader blockHeader;
+    std::memcpy(&blockHeader, header.data(), sizeof(BlockHeader));
+
+    // A stored block is never much bigger than the data in it.
+    if (blockHeader.rawSize > BLOCK_SIZE || blockHeader.storedSize > BLOCK_SIZE * 2) return 0;
+
+    return sizeof(BlockHeader) + blockHeader.storedSize;
+}
+
+std::size_t Compression::readBlock(const std::string_view data, std::string& output, Stats* stats)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    if (data.size() < sizeof(BlockHeader) || !isBlock(data)) return 0;
+
+    BlockHeader header;
+    std::memcpy(&header, data.data(), sizeof(BlockHeader));
+
+    if (header.rawSize > BLOCK_SIZE || header.storedSize > data.size() - sizeof(BlockHeader)) return 0;
+
+    const std::string_view stored = data.substr(sizeof(BlockHeader), header.storedSize);
+    if (checksum(stored) != header.checksum) return 0;
+
+    const std::size_t outputStart = output.size();
+    if (!decompressWith(static_cast<Codec>(header.codec), stored, header.rawSize, output))
+    {
+        output.resize(outputStart);
+        return 0;
+    }
+
+    if (stats != nullptr)
+    {
+        stats->rawBytes += header.rawSize;
+        stats->storedBytes += sizeof(BlockHeader) + stored.size();
+        stats->codecTime += std::chrono::steady_clock::now() - startTime;
+    }
+
+    return sizeof(BlockHeader) + stored.size();
+}
+
+bool Compression::decodeFile(const std::string_view data, std::string& output, Stats* stats)
+{
+    if (!isBlock(data))
+    {
+        output.append(data);
+        return true;
+    }
+
+    std::size_t position = 0;
+    while (position < data.size())
+    {
+        const std::size_t blockSize = readBlock(data.substr(position), output, stats);
+        if (blockSize == 0) return false;
+        position += blockSize;
+    }
+
+    return true;
+}
+
+std::uintmax_t Compression::readLogLines(std::istream& file, const std::function<bool(std::string_view line)>& onLine)
+{
+    std::uintmax_t validBytes = 0;
+    std::string line;
+    std::string block;
+    std::string contents;
+
+    while (file.peek() != std::char_traits<char>::eof())
+    {
+        if (file.peek() != static_cast<unsigned char>(BLOCK_MAGIC[0]))
+        {
+            std::getline(file, line);
+            const bool lineBreak = !file.eof();
+
+            if (!line.empty() && !onLine(line)) break;
+
+            validBytes += line.size() + 1;
+            if (!lineBreak) break;
+            continue;
+        }
+
+        // A block holds a whole batch of lines. A torn one ends the log.
+        block.resize(sizeof(BlockHeader));
+        if (!file.read(block.data(), sizeof(BlockHeader))) break;
+
+        const std::size_t blockSize = blockSizeFromHeader(block);
+        if (blockSize == 0) break;
+
+        block.resize(blockSize);
+        if (!file.read(block.data() + sizeof(BlockHeader), static_cast<std::streamsize>(blockSize - sizeof(BlockHeader)))) break;
+
+        contents.clear();
+        if (readBlock(block, contents) == 0) break;
+
+        bool accepted = true;
+        std::size_t lineStart = 0;
+        while (accepted && lineStart < contents.size())
+        {
+            std::size_t lineEnd = contents.find('\n', lineStart);
+            if (lineEnd == std::string::npos) lineEnd = contents.size();
+
+            if (lineEnd > lineStart)
+            {
+                accepted = onLine(std::string_view(contents).substr(lineStart, lineEnd - lineStart));
+            }
+            lineStart = lineEnd + 1;
+        }
+
+        if (!accepted) break;
+        validBytes += block.size();
+    }
+
+    return validBytes;
+}
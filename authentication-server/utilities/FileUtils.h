@@ -0,0 +1,20 @@
+﻿#ifndef FILEUTILS_H
+#define FILEUTILS_H
+
+#include <cstdio>
+#include <string>
+
+#include "../structs/StatusResponse.h"
+
+class FileUtils
+{
+public:
+
+    // Forces the written data of a file out of the OS cache onto the disk.
+    static bool syncFile(FILE* file);
+
+    // Moves a file over another in one step, and makes sure the move itself survives a crash.
+    static StatusResponse replaceFile(const std::string& from, const std::string& to);
+};
+
+#endif //FILEUTILS_H
@@ -6,7 +6,7 @@
 #include <ios>
 #include <wincrypt.h>
 
-std::string HashUtils::hashPassword(const std::string& password)
+std::string HashUtils::hashPassword(const std::string_view password)
 {
     HCRYPTPROV hProv = 0;
     HCRYPTHASH hHash = 0;
@@ -17,7 +17,7 @@ std::string HashUtils::hashPassword(const std::string& password)
     {
         if (CryptCreateHash(hProv, CALG_SHA_256, 0, 0, &hHash))
         {
-            if (CryptHashData(hHash, reinterpret_cast<const BYTE*>(password.c_str()), password.length(), 0))
+            if (CryptHashData(hHash, reinterpret_cast<const BYTE*>(password.data()), password.length(), 0))
             {
                 BYTE hash[32];
 
@@ -42,7 +42,7 @@ std::string HashUtils::hashPassword(const std::string& password)
     return result;
 }
 
-bool HashUtils::verifyPassword(const std::string& password, const std::string& hash)
+bool HashUtils::verifyPassword(const std::string_view password, const std::string& hash)
 {
     return hashPassword(password) == hash;
 }
@@ -2,16 +2,17 @@
 #define HASHUTILS_H
 
 #include <string>
+#include <string_view>
 
 class HashUtils
 {
 public:
 
     // Hashes passwords using SHA-256.
-    static std::string hashPassword(const std::string& password);
+    static std::string hashPassword(std::string_view password);
 
     // Compares password hashes.
-    static bool verifyPassword(const std::string& password, const std::string& hash);
+    static bool verifyPassword(std::string_view password, const std::string& hash);
 };
 
 #endif //HASHUTILS_H
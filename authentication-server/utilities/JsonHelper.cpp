@@ -1,56 +1,90 @@
 ﻿#include "JsonHelper.h"
+#include "AtomicFileWriter.h"
+#include "CompressedInputStream.h"
+#include "JsonArrayReader.h"
+#include "RequestParser.h"
 
+#include <array>
 #include <fstream>
 #include <iostream>
 
-JsonMessage JsonHelper::parseMessage(const std::string& jsonStr)
+JsonMessage JsonHelper::parseMessage(std::string& message, const WireProtocol::Format format)
 {
     JsonMessage msg;
 
+    if (format == WireProtocol::Format::Json && RequestParser::parse(message, msg))
+    {
+        return msg;
+    }
+
+    // Anything the fast parser can't read is decoded in full. The values are copied over the
+    // message, so the fields can point into it the same way.
+    msg = JsonMessage();
+    std::array<std::string, JSON_MESSAGE_TEXT_FIELDS.size()> values;
+
     try
     {
-        const json j = json::parse(jsonStr);
-
-        msg.action = j.value("action", "");
-        msg.username = j.value("username", "");
-        msg.password = j.value("password", "");
-        msg.authToken = j.value("token", "");
-        msg.targetUser = j.value("target_user", "");
-        msg.newType = j.value("new_type", "");
+        const json j = WireProtocol::decode(message, format);
+
+        for (std::size_t i = 0; i < JSON_MESSAGE_TEXT_FIELDS.size(); i++)
+        {
+            values[i] = j.value(JSON_MESSAGE_TEXT_FIELDS[i].first, "");
+        }
+
+        for (const auto& [key, field] : JSON_MESSAGE_FLAG_FIELDS)
+        {
+            msg.*field = j.value(key, false);
+        }
+
+        for (const auto& [key, field] : JSON_MESSAGE_NUMBER_FIELDS)
+        {
+            msg.*field = j.value(key, std::uint64_t{0});
+        }
     }
-    catch (const json::parse_error& e)
+    catch (const json::exception& e)
     {
-        std::cout << "JSON parse error: " << e.what() << std::endl;
+        std::cout << "Message parse error: " << e.what() << std::endl;
+    }
+
+    message.clear();
+    for (const std::string& value : values) { message += value; }
+
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < JSON_MESSAGE_TEXT_FIELDS.size(); i++)
+    {
+        msg.*JSON_MESSAGE_TEXT_FIELDS[i].second = std::string_view(message).substr(offset, values[i].size());
+        offset += values[i].size();
     }
 
     return msg;
 }
 
-std::string JsonHelper::createResponse(bool success, const std::string& message, const std::string& token)
+json JsonHelper::userToJson(const User& user)
 {
-    json response;
-    response["success"] = success;
-    response["message"] = message;
-
-    if (!token.empty()) { response["token"] = token; }
-
-    return response.dump();
+    json userJson;
+    userJson["username"] = user.username;
+    userJson["passwordHash"] = user.passwordHash;
+    userJson["type"] = userTypeToString(user.type);
+    userJson["energy"] = user.energy;
+    userJson["is_admin"] = user.isAdmin;
+    return userJson;
 }
 
-std::string JsonHelper::createResponse(bool success, const std::string &message, const std::string &token, const json &data)
+User JsonHelper::jsonToUser(const json& j)
 {
-    json response;
-    response["success"] = success;
-    response["message"] = message;
-    response["token"] = token;
-    response["data"] = data;
-
-    return response.dump();
+    User user;
+    user.username = j.value("username", "");
+    user.passwordHash = j.value("passwordHash", "");
+    user.type = stringToUserType(j.value("type", "")).value_or(UserType::Freemium);
+    user.energy = j.value("energy", 100);
+    user.isAdmin = j.value("is_admin", false);
+    return user;
 }
 
-StatusResponse JsonHelper::loadUsersFromFile(const std::string& filename, std::map<std::string, User>& users)
+StatusResponse JsonHelper::loadUsersFromFile(const std::string& filename, std::map<std::string, User, std::less<>>& users)
 {
-    std::ifstream file(filename);
+    // The file may have been saved compressed.
+    CompressedInputStream file(filename);
 
     if (!file.is_open())
     {
@@ -59,70 +93,80 @@ StatusResponse JsonHelper::loadUsersFromFile(const std::string& filename, std::m
 
     try
     {
-        json j;
-        file >> j;
-        file.close();
-
-        if (j.is_array())
+        // Builds each user as soon as it has been read, rather than parsing the whole file first.
+        JsonArrayReader reader([&users](const json& userJson)
         {
-            for (const auto& userJson : j)
+            if (!userJson.is_object()) return;
+
+            if (User user = jsonToUser(userJson); !user.username.empty())
             {
-                User user;
-                user.username = userJson.value("username", "");
-                user.passwordHash = userJson.value("passwordHash", "");
-                user.type = stringToUserType(userJson.value("type", "")).value_or(UserType::Freemium);
-                user.energy = userJson.value("energy", 100);
-                user.isAdmin = userJson.value("is_admin", false);
-
-                if (!user.username.empty()) { users[user.username] = user; }
+                std::string username = user.username;
+                users.insert_or_assign(std::move(username), std::move(user));
             }
+        });
+
+        const bool parsed = reader.read(file);
+
+        // A corrupt block cuts the stream short, which the reader would only see as a parse error.
+        if (file.hasCorruptBlock())
+        {
+            users.clear();
+            return { false, "Error loading user data file: corrupt compressed block" };
         }
 
-        return { true, "Loaded " + std::to_string(users.size()) + " users from file" };
+        if (!parsed)
+        {
+            users.clear();
+            return { false, "Error parsing user data file: " + reader.getError() };
+        }
 
-    }
-    catch (const json::parse_error& e)
-    {
-        file.close();
-        return { false, "Error parsing user data file: " + std::string(e.what()) };
+        const std::string decompression = file.isCompressed() ? ", decompressed " + file.getStats().describe() : "";
+        return { true, "Loaded " + std::to_string(users.size()) + " users from file" + decompression };
     }
     catch (const std::exception& e)
     {
-        file.close();
+        users.clear();
         return { false, "Error parsing user data: " + std::string(e.what()) };
     }
 }
 
-StatusResponse JsonHelper::saveUsersToFile(const std::string& filename, const std::map<std::string, User>& users)
+StatusResponse JsonHelper::saveUsersToFile(const std::string& filename, const std::map<std::string, User, std::less<>>& users,
+                                           const Compression::Codec codec)
 {
     try
     {
-        json j = json::array();
-
-        for (const auto& val : users | std::views::values)
+        AtomicFileWriter file(filename);
+        file.setCompression(codec);
+        if (!file.open())
         {
-            const User& user = val;
-            json userJson;
-            userJson["username"] = user.username;
-            userJson["passwordHash"] = user.passwordHash;
-            userJson["type"] = userTypeToString(user.type);
-            userJson["energy"] = user.energy;
-            userJson["is_admin"] = user.isAdmin;
-
-            j.push_back(userJson);
+            return { false, "Error: Could not save users to file!" };
         }
 
-        std::ofstream file(filename);
+        std::vector<const User*> orderedUsers;
+        orderedUsers.reserve(users.size());
+        for (const User& user : users | std::views::values) { orderedUsers.push_back(&user); }
 
-        if (!file.is_open())
+        // Only one batch of users is serialised at a time, so the whole array is never built in memory.
+        file.write("[");
+        file.writeInShards(orderedUsers.size(), [&orderedUsers](const std::size_t begin, const std::size_t end, std::string& output)
         {
-            return { false, "Error: Could not save users to file!" };
-        }
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                output += i == 0 ? "\n" : ",\n";
+                output += userToJson(*orderedUsers[i]).dump(2);
+            }
+        });
+        file.write(orderedUsers.empty() ? "]" : "\n]");
 
-        file << j.dump(2);
-        file.close();
+        if (const StatusResponse status = file.commit(); !status.success)
+        {
+            return { false, "Error: Could not save users to file! " + status.message };
+        }
 
-        return { true, "Saved " + std::to_string(users.size()) + " users to file" };
+        const std::string compression = codec == Compression::Codec::None
+            ? ""
+            : ", " + Compression::codecName(codec) + " " + file.getStats().describe();
+        return { true, "Saved " + std::to_string(users.size()) + " users to file" + compression };
     }
     catch (const std::exception& e)
     {
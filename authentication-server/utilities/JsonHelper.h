@@ -8,6 +8,8 @@
 #include "../structs/JsonMessage.h"
 #include "../structs/StatusResponse.h"
 #include "../structs/User.h"
+#include "Compression.h"
+#include "WireProtocol.h"
 
 using json = nlohmann::json;
 
@@ -15,20 +17,22 @@ class JsonHelper
 {
 public:
 
-    // Parses incoming JSON message.
-    static JsonMessage parseMessage(const std::string& jsonStr);
+    // Parses an incoming message in the connection's format. The fields point into message, which
+    // is overwritten with their values if the request had to be decoded in full.
+    static JsonMessage parseMessage(std::string& message, WireProtocol::Format format = WireProtocol::Format::Json);
 
-    // Creates a JSON response.
-    static std::string createResponse(bool success, const std::string& message, const std::string& token = "");
+    // Converts User to JSON.
+    static json userToJson(const User& user);
 
-    // Creates a JSON response with extra data.
-    static std::string createResponse(bool success, const std::string& message, const std::string& token, const json &data);
+    // Converts JSON to User.
+    static User jsonToUser(const json& j);
 
-    // Loads users from JSON file.
-    static StatusResponse loadUsersFromFile(const std::string& filename, std::map<std::string, User>& users);
+    // Loads users from JSON file, which may be compressed.
+    static StatusResponse loadUsersFromFile(const std::string& filename, std::map<std::string, User, std::less<>>& users);
 
     // Saves users to JSON file.
-    static StatusResponse saveUsersToFile(const std::string& filename, const std::map<std::string, User>& users);
+    static StatusResponse saveUsersToFile(const std::string& filename, const std::map<std::string, User, std::less<>>& users,
+                                          Compression::Codec codec = Compression::Codec::None);
 };
 
 #endif //JSONHELPER_H
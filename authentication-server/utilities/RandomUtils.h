@@ -0,0 +1,43 @@
+﻿#ifndef RANDOMUTILS_H
+#define RANDOMUTILS_H
+
+#include <cstdint>
+#include <limits>
+
+// xoshiro256** generator. Small, fast and usable with the standard distributions.
+class Xoshiro256
+{
+public:
+
+    using result_type = std::uint64_t;
+
+    Xoshiro256() : Xoshiro256(0) {}
+    explicit Xoshiro256(std::uint64_t seed);
+
+    result_type operator()();
+
+    static constexpr result_type min() { return std::numeric_limits<result_type>::min(); }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+private:
+
+    std::uint64_t state[4];
+};
+
+class RandomUtils
+{
+public:
+
+    // Sets the seed every thread generator is derived from.
+    static void setRootSeed(std::uint64_t seed);
+    static std::uint64_t getRootSeed();
+
+    // Reseeds the calling thread's generator for a given stream (e.g. a client id).
+    // Runs with the same root seed then produce the same rolls for the same stream.
+    static void seedThread(std::uint64_t stream);
+
+    // Gets the calling thread's generator. Threads that were never seeded get a stream of their own.
+    static Xoshiro256& generator();
+};
+
+#endif //RANDOMUTILS_H
@@ -0,0 +1,34 @@
+﻿#ifndef REQUESTPARSER_H
+#define REQUESTPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "../structs/JsonMessage.h"
+
+// Reads a JSON request straight into a JsonMessage without building a json object. The fields are
+// left pointing into the text, so nothing is copied or allocated. Only flat objects of plain ASCII
+// strings, booleans and unsigned integers are read; anything else is left to the generic parser.
+class RequestParser
+{
+public:
+
+    // Returns false if the text has to go through the generic parser instead. msg is then incomplete.
+    static bool parse(std::string_view text, JsonMessage& msg);
+
+private:
+
+    static void skipWhitespace(std::string_view text, std::size_t& position);
+
+    // Reads a string without escapes or non-ASCII bytes, leaving position after its closing quote.
+    static bool readString(std::string_view text, std::size_t& position, std::string_view& value);
+
+    // Reads true or false, leaving position after it.
+    static bool readBool(std::string_view text, std::size_t& position, bool& value);
+
+    // Reads an unsigned integer that fits in 64 bits, leaving position after it.
+    static bool readUnsigned(std::string_view text, std::size_t& position, std::uint64_t& value);
+};
+
+#endif //REQUESTPARSER_H
@@ -0,0 +1,34 @@
+﻿#ifndef STRUCTURALSCANNER_H
+#define STRUCTURALSCANNER_H
+
+#include <cstddef>
+#include <string_view>
+
+// Finds the bytes the request parser has to stop at, 16 or 32 bytes at a time where the CPU allows.
+// The widest level the CPU supports is picked at startup; the scalar loop is used everywhere else.
+class StructuralScanner
+{
+public:
+
+    enum class Level
+    {
+        Scalar,
+        Sse42,
+        Avx2
+    };
+
+    // Returns the position of the first byte from position on that ends or complicates a JSON string:
+    // a quote, a backslash, a control character or a non-ASCII byte. Returns text.size() if none.
+    static std::size_t findStringEnd(std::string_view text, std::size_t position);
+
+    [[nodiscard]] static Level getLevel();
+    static const char* levelName(Level level);
+
+    // Picks a level explicitly, for comparing them. Returns false if the CPU doesn't support it.
+    // Only call it before any other thread is scanning.
+    static bool setLevel(Level level);
+
+    [[nodiscard]] static bool isSupported(Level level);
+};
+
+#endif //STRUCTURALSCANNER_H
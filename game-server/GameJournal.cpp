@@ -0,0 +1,423 @@
+﻿#include "GameJournal.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "utilities/Compression.h"
+#include "utilities/FileUtils.h"
+#include "utilities/GUIDUtils.h"
+#include "utilities/JsonHelper.h"
+
+namespace
+{
+    // Batches smaller than this are written uncompressed.
+    constexpr std::size_t MIN_COMPRESSED_BATCH = 512;
+
+    // The sequence numbers of the first and last records each thread queued since it last waited for them.
+    thread_local std::uint64_t threadFirstSequence = 0;
+    thread_local std::uint64_t threadLastSequence = 0;
+
+    // Cuts a torn record off the end of a log, so the next record appended starts on a line of its own.
+    void truncateTornRecord(const std::string& filename, const std::uintmax_t validBytes)
+    {
+        std::error_code error;
+        const std::uintmax_t fileSize = std::filesystem::file_size(filename, error);
+        if (error) return;
+
+        if (validBytes < fileSize)
+        {
+            std::filesystem::resize_file(filename, validBytes, error);
+        }
+        else if (validBytes > fileSize)
+        {
+            // The last record is whole but lost its line break.
+            std::ofstream(filename, std::ios::binary | std::ios::app) << '\n';
+        }
+    }
+}
+
+GameJournal::~GameJournal()
+{
+    close();
+}
+
+void GameJournal::setCompression(const Compression::Codec codec)
+{
+    this->codec = codec;
+}
+
+StatusResponse GameJournal::open(const std::string& filename)
+{
+    std::lock_guard lock(journalMutex);
+
+    this->filename = filename;
+    file = fopen(filename.c_str(), "ab");
+
+    if (file == nullptr)
+    {
+        return { false, "Could not open the journal file " + filename };
+    }
+
+    running = true;
+    writerThread = std::thread(&GameJournal::writeLoop, this);
+
+    return { true, "Journaling changes to " + filename +
+        (codec == Compression::Codec::None ? "" : ", compressed with " + Compression::codecName(codec)) };
+}
+
+void GameJournal::close()
+{
+    {
+        std::lock_guard lock(journalMutex);
+        if (!running) return;
+        running = false;
+    }
+
+    pendingCondition.notify_all();
+    if (writerThread.joinable()) { writerThread.join(); }
+
+    std::lock_guard lock(fileMutex);
+    if (file != nullptr)
+    {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void GameJournal::recordCreatePlayer(const Player& player)
+{
+    json record;
+    record["op"] = "create";
+    record["user"] = player.username;
+    record["type"] = playerTypeToString(player.type);
+    record["is_admin"] = player.isAdmin;
+    append(record);
+}
+
+void GameJournal::recordRemovePlayer(const std::string& username)
+{
+    json record;
+    record["op"] = "remove_user";
+    record["user"] = username;
+    append(record);
+}
+
+void GameJournal::recordStore(const std::string& username, const ItemInstance& itemInstance)
+{
+    json record;
+    record["op"] = "store";
+    record["user"] = username;
+    record["item"] = JsonHelper::inventoryEntryToJson(itemInstance);
+    append(record);
+}
+
+void GameJournal::recordRemove(const std::string& username, const ItemInstance& itemInstance)
+{
+    json record;
+    record["op"] = "remove";
+    record["user"] = username;
+    record["item_id"] = GUIDUtils::GUIDToString(itemInstance.id);
+    append(record);
+}
+
+void GameJournal::recordSell(const std::string& username, const ItemInstance& itemInstance, const float newBalance)
+{
+    json record;
+    record["op"] = "sell";
+    record["user"] = username;
+    record["item_id"] = GUIDUtils::GUIDToString(itemInstance.id);
+    record["balance"] = newBalance;
+    append(record);
+}
+
+void GameJournal::recordBalance(const std::string& username, const float newBalance)
+{
+    json record;
+    record["op"] = "balance";
+    record["user"] = username;
+    record["balance"] = newBalance;
+    append(record);
+}
+
+void GameJournal::recordTypeChange(const std::string& username, const PlayerType newType)
+{
+    json record;
+    record["op"] = "type";
+    record["user"] = username;
+    record["type"] = playerTypeToString(newType);
+    append(record);
+}
+
+void GameJournal::append(const json& record)
+{
+    {
+        std::lock_guard lock(journalMutex);
+        if (!running) return;
+
+        pendingRecords += record.dump();
+        pendingRecords += '\n';
+        threadLastSequence = ++lastQueuedSequence;
+        if (threadFirstSequence == 0) { threadFirstSequence = threadLastSequence; }
+    }
+
+    pendingCondition.notify_one();
+}
+
+bool GameJournal::waitUntilDurable()
+{
+    if (threadLastSequence == 0) return true;
+
+    const std::uint64_t firstSequence = threadFirstSequence;
+    const std::uint64_t lastSequence = threadLastSequence;
+    threadFirstSequence = 0;
+    threadLastSequence = 0;
+
+    std::unique_lock lock(journalMutex);
+    durableCondition.wait(lock, [this, lastSequence] { return lastDurableSequence >= lastSequence || !running; });
+
+    // A lost record between the thread's first and last ones would break the replay of the later ones, too.
+    return std::ranges::none_of(failedSequences, [firstSequence, lastSequence](const std::pair<std::uint64_t, std::uint64_t>& failed)
+    {
+        return failed.first < lastSequence && failed.second >= firstSequence;
+    });
+}
+
+void GameJournal::recordFailure(const std::uint64_t firstSequence, const std::uint64_t lastSequence)
+{
+    if (firstSequence >= lastSequence) return;
+
+    // Batches follow each other, so a run of failed ones is kept as a single range.
+    if (!failedSequences.empty() && failedSequences.back().second == firstSequence)
+    {
+        failedSequences.back().second = lastSequence;
+        return;
+    }
+
+    failedSequences.emplace_back(firstSequence, lastSequence);
+}
+
+void GameJournal::writeLoop()
+{
+    std::string batch;
+
+    while (true)
+    {
+        std::uint64_t firstSequence;
+        std::uint64_t batchSequence;
+        std::unique_lock<std::mutex> fileLock;
+
+        {
+            std::unique_lock lock(journalMutex);
+            pendingCondition.wait(lock, [this] { return !pendingRecords.empty() || !running; });
+
+            if (pendingRecords.empty() && !running) break;
+
+            // Takes everything queued so far. Records queued while this batch is flushed go in the next one.
+            batch.swap(pendingRecords);
+            firstSequence = lastTakenSequence;
+            batchSequence = lastQueuedSequence;
+            lastTakenSequence = batchSequence;
+
+            // The file is claimed before the queue is released, so a truncation can't slip in between.
+            fileLock = std::unique_lock(fileMutex);
+        }
+
+        // The file is gone if reopening it after a rotation failed, so it's tried again.
+        if (file == nullptr) { file = fopen(filename.c_str(), "ab"); }
+
+        const bool written = file != nullptr && writeRecords(batch) && FileUtils::syncFile(file);
+        if (!written)
+        {
+            std::cout << "Failed to write " << batch.size() << " bytes to the journal" << std::endl;
+        }
+
+        fileLock.unlock();
+        batch.clear();
+
+        {
+            std::lock_guard lock(journalMutex);
+            if (!written) { recordFailure(firstSequence, batchSequence); }
+            lastDurableSequence = std::max(lastDurableSequence, batchSequence);
+        }
+
+        durableCondition.notify_all();
+    }
+
+    durableCondition.notify_all();
+}
+
+StatusResponse GameJournal::rotate(const std::string& checkpointFilename)
+{
+    std::lock_guard lock(journalMutex);
+    std::lock_guard fileLock(fileMutex);
+
+    // The file is gone if reopening it after the last rotation failed.
+    if (file == nullptr && running) { file = fopen(filename.c_str(), "ab"); }
+
+    if (file == nullptr)
+    {
+        return { false, "The journal is not open" };
+    }
+
+    // A checkpoint from a failed snapshot is kept until a snapshot succeeds. Until then, the
+    // journal keeps growing and both files are replayed.
+    if (std::filesystem::exists(checkpointFilename))
+    {
+        return { false, "A previous journal checkpoint is still pending" };
+    }
+
+    // Queued records belong to changes made before the checkpoint, so they go into it.
+    bool written = true;
+    if (!pendingRecords.empty())
+    {
+        written = writeRecords(pendingRecords);
+        pendingRecords.clear();
+    }
+
+    written = FileUtils::syncFile(file) && written;
+    fclose(file);
+    file = nullptr;
+
+    if (!written)
+    {
+        std::cout << "Failed to write the queued records to the journal before checkpointing it" << std::endl;
+        recordFailure(lastTakenSequence, lastQueuedSequence);
+    }
+
+    lastTakenSequence = lastQueuedSequence;
+    lastDurableSequence = lastQueuedSequence;
+    durableCondition.notify_all();
+
+    std::error_code error;
+    std::filesystem::rename(filename, checkpointFilename, error);
+
+    file = fopen(filename.c_str(), "ab");
+    if (file == nullptr)
+    {
+        return { false, "Could not reopen the journal file " + filename };
+    }
+
+    if (error)
+    {
+        return { false, "Could not move the journal to " + checkpointFilename + ": " + error.message() };
+    }
+
+    const std::string compression = codec == Compression::Codec::None ? "" : " (" + stats.describe() + ")";
+    stats = {};
+
+    return { true, "Journal checkpointed to " + checkpointFilename + compression };
+}
+
+bool GameJournal::writeRecords(const std::string& records)
+{
+    // A block header would outweigh what compressing a few records saves, so they're written as plain lines.
+    if (codec == Compression::Codec::None || records.size() < MIN_COMPRESSED_BATCH)
+    {
+        if (codec != Compression::Codec::None)
+        {
+            stats.rawBytes += records.size();
+            stats.storedBytes += records.size();
+        }
+
+        return fwrite(records.data(), 1, records.size(), file) == records.size();
+    }
+
+    encodedRecords.clear();
+    Compression::appendLineBlocks(codec, records, encodedRecords, &stats);
+    return fwrite(encodedRecords.data(), 1, encodedRecords.size(), file) == encodedRecords.size();
+}
+
+StatusResponse GameJournal::replay(const std::string& filename, std::map<std::string, Player, std::less<>>& players,
+                                   const std::function<void(const std::string&)>& beforeRecord)
+{
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file.is_open())
+    {
+        return { true, "No journal to replay" };
+    }
+
+    int replayedRecords = 0;
+    bool tornRecord = false;
+
+    // Compressed and plain records can both be in the file, if the compression setting changed.
+    const std::uintmax_t validBytes = Compression::readLogLines(file, [&](const std::string_view line)
+    {
+        json record;
+        try
+        {
+            record = json::parse(line);
+        }
+        catch (const json::parse_error&)
+        {
+            // A crash in the middle of a write leaves a torn last record behind.
+            tornRecord = true;
+            return false;
+        }
+
+        const std::string op = record.value("op", "");
+        const std::string username = record.value("user", "");
+
+        if (beforeRecord) { beforeRecord(username); }
+
+        if (op == "create")
+        {
+            if (!players.contains(username))
+            {
+                Player player;
+                player.username = username;
+                player.type = stringToPlayerType(record.value("type", "")).value_or(PlayerType::Freemium);
+                player.isAdmin = record.value("is_admin", false);
+                players[username] = player;
+            }
+        }
+        else if (op == "remove_user")
+        {
+            players.erase(username);
+        }
+        else if (const auto playerIt = players.find(username); playerIt != players.end())
+        {
+            Player& player = playerIt->second;
+
+            if (op == "store")
+            {
+                if (const std::optional<ItemInstance> itemInstance = JsonHelper::jsonToInventoryEntry(record["item"]);
+                    itemInstance.has_value() && !player.getItemFromInventory(GUIDUtils::GUIDToString(itemInstance->id)).has_value())
+                {
+                    // Replayed changes only rebuild the inventory, so they aren't kept as changes for clients to catch up on.
+                    player.inventory.push_back(itemInstance.value());
+                }
+            }
+            else if (op == "remove" || op == "sell")
+            {
+                if (const std::optional<ItemInstance> itemInstance = player.getItemFromInventory(record.value("item_id", "")); itemInstance.has_value())
+                {
+                    std::erase_if(player.inventory, [&itemInstance](const ItemInstance& instance)
+                    {
+                        return IsEqualGUID(instance.id, itemInstance->id);
+                    });
+                }
+
+                if (op == "sell") { player.balance = record.value("balance", player.balance); }
+            }
+            else if (op == "balance")
+            {
+                player.balance = record.value("balance", player.balance);
+            }
+            else if (op == "type")
+            {
+                player.type = stringToPlayerType(record.value("type", "")).value_or(player.type);
+            }
+        }
+
+        replayedRecords++;
+        return true;
+    });
+
+    file.close();
+    truncateTornRecord(filename, validBytes);
+
+    return { true, "Replayed " + std::to_string(replayedRecords) + " journal records" + (tornRecord ? " (ignored a torn record)" : "") };
+}
@@ -0,0 +1,96 @@
+﻿#ifndef GAMEJOURNAL_H
+#define GAMEJOURNAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "structs/Item.h"
+#include "structs/Player.h"
+#include "structs/StatusResponse.h"
+#include "utilities/Compression.h"
+
+using json = nlohmann::json;
+
+// Append-only log of every change made to the game state since the last save.
+// Records are written by a single writer thread, so handler threads that append
+// at the same time share one flush to disk (group commit).
+class GameJournal
+{
+public:
+
+    ~GameJournal();
+
+    // Writes each batch of records as one compressed block. Call it before open().
+    void setCompression(Compression::Codec codec);
+
+    // Opens the journal for appending and starts the writer thread.
+    StatusResponse open(const std::string& filename);
+
+    // Flushes the queued records and stops the writer thread.
+    void close();
+
+    // Queues the changes. Call these while the change is applied, so records keep the same order.
+    void recordCreatePlayer(const Player& player);
+    void recordRemovePlayer(const std::string& username);
+    void recordStore(const std::string& username, const ItemInstance& itemInstance);
+    void recordRemove(const std::string& username, const ItemInstance& itemInstance);
+    void recordSell(const std::string& username, const ItemInstance& itemInstance, float newBalance);
+    void recordBalance(const std::string& username, float newBalance);
+    void recordTypeChange(const std::string& username, PlayerType newType);
+
+    // Blocks until every record queued by the calling thread is on disk. Returns false if any of them
+    // couldn't be written, so the change mustn't be acknowledged.
+    [[nodiscard]] bool waitUntilDurable();
+
+    // Moves the records written so far to a checkpoint file and starts an empty journal.
+    // With compression on, the message reports how well the checkpointed records compressed.
+    // Called while a snapshot copies the players, so the checkpoint holds exactly the changes in that snapshot.
+    // The checkpoint can be deleted once the snapshot is saved.
+    StatusResponse rotate(const std::string& checkpointFilename);
+
+    // Applies the records of a journal file on top of the loaded players.
+    // Records are idempotent, so replaying changes that were already saved is harmless.
+    // beforeRecord is called with each record's username first, so the player can be loaded if needed.
+    static StatusResponse replay(const std::string& filename, std::map<std::string, Player, std::less<>>& players,
+                                 const std::function<void(const std::string&)>& beforeRecord = {});
+
+private:
+
+    void append(const json& record);
+    void writeLoop();
+
+    // Writes records to the file, compressing them if that's on. Call it holding fileMutex.
+    bool writeRecords(const std::string& records);
+
+    // Remembers that the records after firstSequence, up to lastSequence, were lost. Call it holding journalMutex.
+    void recordFailure(std::uint64_t firstSequence, std::uint64_t lastSequence);
+
+    std::string filename;
+    FILE* file = nullptr;
+    Compression::Codec codec = Compression::Codec::None;
+    std::string encodedRecords;
+    Compression::Stats stats; // Since the last rotation.
+    std::thread writerThread;
+    bool running = false;
+
+    std::mutex journalMutex; // Guards the queue. Always taken before fileMutex.
+    std::mutex fileMutex;
+    std::condition_variable pendingCondition;
+    std::condition_variable durableCondition;
+    std::string pendingRecords;
+    std::uint64_t lastQueuedSequence = 0;
+    std::uint64_t lastTakenSequence = 0; // The last record taken off the queue to be written.
+    std::uint64_t lastDurableSequence = 0;
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> failedSequences; // Ranges of lost records, as (first, last].
+};
+
+#endif //GAMEJOURNAL_H
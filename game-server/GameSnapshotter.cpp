@@ -0,0 +1,291 @@
+﻿#include "GameSnapshotter.h"
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "PlayerSnapshotFile.h"
+#include "utilities/JsonHelper.h"
+
+GameSnapshotter::GameSnapshotter(std::map<std::string, Player, std::less<>>& players, std::shared_mutex& playersMutex, GameJournal& journal,
+                                 PlayerCache& playerCache, std::string filename, std::string journalCheckpointFilename)
+    : players(players), playersMutex(playersMutex), journal(journal), playerCache(playerCache),
+      filename(std::move(filename)), journalCheckpointFilename(std::move(journalCheckpointFilename))
+{
+}
+
+GameSnapshotter::~GameSnapshotter()
+{
+    stop();
+}
+
+void GameSnapshotter::markDirty(const std::string& username)
+{
+    std::lock_guard lock(dirtyMutex);
+    dirtyPlayers.insert(username);
+}
+
+void GameSnapshotter::markAllDirty()
+{
+    std::shared_lock playersLock(playersMutex);
+    std::lock_guard lock(dirtyMutex);
+
+    for (const auto& username : players | std::views::keys)
+    {
+        dirtyPlayers.insert(username);
+    }
+}
+
+void GameSnapshotter::useStore(KeyValueStore& store)
+{
+    this->store = &store;
+}
+
+void GameSnapshotter::setCompression(const Compression::Codec codec)
+{
+    this->codec = codec;
+}
+
+void GameSnapshotter::start(const std::chrono::seconds interval)
+{
+    std::lock_guard lock(stopMutex);
+    if (running) return;
+
+    running = true;
+    snapshotThread = std::thread(&GameSnapshotter::snapshotLoop, this, interval);
+}
+
+void GameSnapshotter::stop()
+{
+    {
+        std::lock_guard lock(stopMutex);
+        if (!running) return;
+        running = false;
+    }
+
+    stopCondition.notify_all();
+    if (snapshotThread.joinable()) { snapshotThread.join(); }
+}
+
+void GameSnapshotter::snapshotLoop(const std::chrono::seconds interval)
+{
+    while (true)
+    {
+        {
+            std::unique_lock lock(stopMutex);
+            if (stopCondition.wait_for(lock, interval, [this] { return !running; })) break;
+        }
+
+        const StatusResponse status = takeSnapshot();
+        std::cout << status.message << std::endl;
+    }
+}
+
+StatusResponse GameSnapshotter::takeSnapshot()
+{
+    std::lock_guard snapshotLock(snapshotMutex);
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<Player> changedPlayers;
+    std::vector<std::string> removedPlayers;
+    bool journalRotated;
+    std::string journalCompression;
+
+    {
+        // Changes are made under the exclusive lock, so none can slip in while the dirty players are copied.
+        std::shared_lock playersLock(playersMutex);
+
+        std::set<std::string> dirty;
+        {
+            std::lock_guard lock(dirtyMutex);
+            dirty.swap(dirtyPlayers);
+        }
+
+        for (const std::string& username : dirty)
+        {
+            if (const auto playerIt = players.find(username); playerIt != players.end())
+            {
+                changedPlayers.push_back(playerIt->second);
+            }
+            else
+            {
+                removedPlayers.push_back(username);
+            }
+        }
+
+        const StatusResponse journalStatus = journal.rotate(journalCheckpointFilename);
+        journalRotated = journalStatus.success;
+        if (journalRotated && codec != Compression::Codec::None) { journalCompression = "; " + journalStatus.message; }
+    }
+
+    const auto copyTime = std::chrono::steady_clock::now();
+
+    const std::size_t changedCount = changedPlayers.size();
+    std::size_t savedPlayers = 0;
+    std::uintmax_t bytesWritten = 0;
+    std::string fileCompression;
+
+    if (store != nullptr)
+    {
+        if (const StatusResponse saveStatus = saveToStore(changedPlayers, removedPlayers, bytesWritten); !saveStatus.success)
+        {
+            return { false, "Snapshot failed: " + saveStatus.message };
+        }
+
+        savedPlayers = changedCount;
+    }
+    else
+    {
+        const StatusResponse saveStatus = playerCache.isEnabled()
+            ? saveMergedPlayers(changedPlayers, removedPlayers, savedPlayers)
+            : saveAllPlayers(changedPlayers, removedPlayers, savedPlayers);
+
+        if (!saveStatus.success)
+        {
+            return { false, "Snapshot failed: " + saveStatus.message };
+        }
+
+        if (codec != Compression::Codec::None) { fileCompression = "; " + saveStatus.message; }
+
+        std::error_code error;
+        bytesWritten = std::filesystem::file_size(filename, error);
+    }
+
+    // Every change in the checkpoint is part of the snapshot now.
+    std::error_code error;
+    std::filesystem::remove(journalCheckpointFilename, error);
+
+    const auto endTime = std::chrono::steady_clock::now();
+    const auto copyMs = std::chrono::duration_cast<std::chrono::milliseconds>(copyTime - startTime).count();
+    const auto totalMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+
+    return { true, "Snapshot saved: " + std::to_string(savedPlayers) + " players (" +
+        std::to_string(changedCount) + " changed, " + std::to_string(removedPlayers.size()) + " removed), " +
+        std::to_string(bytesWritten) + " bytes in " + std::to_string(totalMs) + " ms (" + std::to_string(copyMs) +
+        " ms holding the lock)" + (journalRotated ? "" : ", journal kept") + fileCompression + journalCompression };
+}
+
+StatusResponse GameSnapshotter::saveAllPlayers(std::vector<Player>& changedPlayers,
+                                               const std::vector<std::string>& removedPlayers, std::size_t& savedPlayers)
+{
+    for (Player& player : changedPlayers)
+    {
+        std::string username = player.username;
+        snapshotPlayers.insert_or_assign(std::move(username), std::move(player));
+    }
+
+    for (const std::string& username : removedPlayers)
+    {
+        snapshotPlayers.erase(username);
+    }
+
+    // A failed write never replaces the last good snapshot.
+    const StatusResponse saveStatus = PlayerSnapshotFile::save(filename, snapshotPlayers, codec);
+    if (!saveStatus.success)
+    {
+        return saveStatus;
+    }
+
+    savedPlayers = snapshotPlayers.size();
+    return saveStatus;
+}
+
+StatusResponse GameSnapshotter::saveMergedPlayers(std::vector<Player>& changedPlayers,
+                                                  const std::vector<std::string>& removedPlayers, std::size_t& savedPlayers)
+{
+    std::map<std::string, Player, std::less<>> changes;
+    for (Player& player : changedPlayers)
+    {
+        std::string username = player.username;
+        changes.emplace(std::move(username), std::move(player));
+    }
+
+    const std::set<std::string, std::less<>> removals(removedPlayers.begin(), removedPlayers.end());
+
+    // The backing file is still being read from, so the merged one is written next to it and swapped in after.
+    // Only this thread replaces the backing file, so it can be read here without the players lock.
+    const std::string mergedFilename = filename + ".merged";
+    const StatusResponse saveStatus = PlayerSnapshotFile::saveMerged(mergedFilename, playerCache.getBackingFile(), changes, removals, codec);
+    StatusResponse status = saveStatus;
+
+    std::unique_lock playersLock(playersMutex);
+
+    if (status.success)
+    {
+        status = playerCache.replaceBackingFile(mergedFilename, removedPlayers);
+    }
+
+    std::lock_guard lock(dirtyMutex);
+
+    if (!status.success)
+    {
+        // Nothing else holds these changes, so they must stay in memory for the next attempt.
+        for (const std::string& username : changes | std::views::keys) { dirtyPlayers.insert(username); }
+        for (const std::string& username : removedPlayers) { dirtyPlayers.insert(username); }
+        return status;
+    }
+
+    savedPlayers = playerCache.getBackingFile().getPlayerCount();
+    const std::size_t evicted = playerCache.evictIdle([this](const std::string& username)
+    {
+        return dirtyPlayers.contains(username);
+    });
+
+    if (evicted > 0)
+    {
+        std::cout << "Evicted " << evicted << " idle players, " << players.size() << " still in memory" << std::endl;
+    }
+
+    return saveStatus;
+}
+
+StatusResponse GameSnapshotter::saveToStore(const std::vector<Player>& changedPlayers, const std::vector<std::string>& removedPlayers,
+                                            std::uintmax_t& bytesWritten)
+{
+    StatusResponse status { true, "" };
+
+    for (const Player& player : changedPlayers)
+    {
+        const std::string value = JsonHelper::playerToJson(player).dump();
+        status = store->put(player.username, value);
+        if (!status.success) break;
+
+        bytesWritten += value.size();
+    }
+
+    for (const std::string& username : removedPlayers)
+    {
+        if (!status.success) break;
+        status = store->remove(username);
+    }
+
+    if (status.success)
+    {
+        status = store->flush();
+    }
+
+    std::unique_lock playersLock(playersMutex);
+    std::lock_guard lock(dirtyMutex);
+
+    if (!status.success)
+    {
+        // Writing a player again is harmless, so every change is kept for the next attempt.
+        for (const Player& player : changedPlayers) { dirtyPlayers.insert(player.username); }
+        for (const std::string& username : removedPlayers) { dirtyPlayers.insert(username); }
+        return status;
+    }
+
+    playerCache.forgetSavedRemovals(removedPlayers);
+    const std::size_t evicted = playerCache.evictIdle([this](const std::string& username)
+    {
+        return dirtyPlayers.contains(username);
+    });
+
+    if (evicted > 0)
+    {
+        std::cout << "Evicted " << evicted << " idle players, " << players.size() << " still in memory" << std::endl;
+    }
+
+    return { true, "" };
+}
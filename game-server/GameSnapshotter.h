@@ -0,0 +1,94 @@
+﻿#ifndef GAMESNAPSHOTTER_H
+#define GAMESNAPSHOTTER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+
+#include "GameJournal.h"
+#include "PlayerCache.h"
+#include "storage/KeyValueStore.h"
+#include "structs/Player.h"
+#include "structs/StatusResponse.h"
+#include "utilities/Compression.h"
+
+// Saves the game data in the background as a binary snapshot. Only players changed since the last
+// snapshot are copied out of the shared map; everyone else is written from the snapshotter's own copy,
+// or with lazy loading on, copied across from the previous snapshot file. With a key-value store in
+// use, only the changed players are written to it.
+class GameSnapshotter
+{
+public:
+
+    GameSnapshotter(std::map<std::string, Player, std::less<>>& players, std::shared_mutex& playersMutex, GameJournal& journal,
+                    PlayerCache& playerCache, std::string filename, std::string journalCheckpointFilename);
+
+    ~GameSnapshotter();
+
+    // Flags a player as changed. Call it whenever a player is created, changed or removed.
+    void markDirty(const std::string& username);
+
+    // Flags every loaded player as changed, so the first snapshot copies all of them.
+    void markAllDirty();
+
+    // Saves to a key-value store instead of the snapshot file. Call it before the first snapshot.
+    void useStore(KeyValueStore& store);
+
+    // Compresses the snapshot file with the given codec. Doesn't apply to a key-value store.
+    void setCompression(Compression::Codec codec);
+
+    // Starts taking a snapshot at a fixed interval.
+    void start(std::chrono::seconds interval);
+
+    // Stops the background thread. Doesn't take a final snapshot.
+    void stop();
+
+    // Takes one snapshot now.
+    StatusResponse takeSnapshot();
+
+private:
+
+    void snapshotLoop(std::chrono::seconds interval);
+
+    // Writes the snapshot file from the snapshotter's own copy of every player. Returns the file's save message.
+    StatusResponse saveAllPlayers(std::vector<Player>& changedPlayers,
+                                  const std::vector<std::string>& removedPlayers, std::size_t& savedPlayers);
+
+    // Writes the snapshot file by merging the changes into the previous one, then evicts idle players.
+    // Returns the file's save message.
+    StatusResponse saveMergedPlayers(std::vector<Player>& changedPlayers,
+                                     const std::vector<std::string>& removedPlayers, std::size_t& savedPlayers);
+
+    // Writes the changes to the key-value store, then evicts idle players.
+    StatusResponse saveToStore(const std::vector<Player>& changedPlayers, const std::vector<std::string>& removedPlayers,
+                               std::uintmax_t& bytesWritten);
+
+    std::map<std::string, Player, std::less<>>& players;
+    std::shared_mutex& playersMutex;
+    GameJournal& journal;
+    PlayerCache& playerCache;
+    std::string filename;
+    std::string journalCheckpointFilename;
+    KeyValueStore* store = nullptr;
+    Compression::Codec codec = Compression::Codec::None;
+
+    std::mutex dirtyMutex;
+    std::set<std::string> dirtyPlayers;
+
+    // The players as of the last snapshot, only ever touched by the thread taking the snapshot.
+    // Unused with lazy loading, where the previous snapshot file plays this part.
+    std::mutex snapshotMutex;
+    std::map<std::string, Player, std::less<>> snapshotPlayers;
+
+    std::thread snapshotThread;
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool running = false;
+};
+
+#endif //GAMESNAPSHOTTER_H
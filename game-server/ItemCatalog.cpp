@@ -0,0 +1,189 @@
+﻿#include "ItemCatalog.h"
+
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+#include "utilities/JsonHelper.h"
+
+std::atomic<std::shared_ptr<const ItemCatalog>> ItemCatalog::currentCatalog;
+std::atomic<std::uint64_t> ItemCatalog::generation{0};
+
+namespace
+{
+    // Money range used by tiers without their own loot table.
+    constexpr float DEFAULT_MONEY_MIN = 15.0f;
+    constexpr float DEFAULT_MONEY_MAX = 75.0f;
+}
+
+ItemCatalog::ItemCatalog(std::vector<std::optional<Item>> entries, std::vector<Index> lootableIndices, std::map<PlayerType, LootTable> lootTables)
+    : entries(std::move(entries)), lootableIndices(std::move(lootableIndices)), lootTables(std::move(lootTables))
+{
+    for (std::size_t i = 0; i < this->entries.size(); i++)
+    {
+        if (this->entries[i].has_value())
+        {
+            indicesByName[this->entries[i]->name] = static_cast<Index>(i);
+        }
+    }
+
+    // 50% to get an item, 50% to earn money.
+    const auto itemCount = static_cast<float>(this->lootableIndices.size());
+    defaultLootTable = LootTable(itemCount, DEFAULT_MONEY_MIN, DEFAULT_MONEY_MAX,
+        this->lootableIndices, std::vector(this->lootableIndices.size(), 1.0f));
+}
+
+const Item& ItemCatalog::get(const Index index) const
+{
+    if (!contains(index))
+    {
+        throw std::out_of_range("Unknown catalog index: " + std::to_string(index));
+    }
+
+    return entries[index].value();
+}
+
+const Item& ItemCatalog::get(const ItemInstance& itemInstance) const
+{
+    return get(itemInstance.catalogIndex);
+}
+
+bool ItemCatalog::contains(const Index index) const
+{
+    return index < entries.size() && entries[index].has_value();
+}
+
+std::optional<ItemCatalog::Index> ItemCatalog::findByName(const std::string& name) const
+{
+    const auto it = indicesByName.find(name);
+    if (it == indicesByName.end()) { return std::nullopt; }
+    return it->second;
+}
+
+const std::vector<ItemCatalog::Index>& ItemCatalog::getLootableIndices() const
+{
+    return lootableIndices;
+}
+
+const LootTable& ItemCatalog::getLootTable(const PlayerType playerType) const
+{
+    const auto it = lootTables.find(playerType);
+    return it != lootTables.end() ? it->second : defaultLootTable;
+}
+
+std::size_t ItemCatalog::size() const
+{
+    return entries.size();
+}
+
+std::shared_ptr<const ItemCatalog> ItemCatalog::current()
+{
+    // Each thread keeps its own reference and only touches the shared pointer after a reload.
+    thread_local std::shared_ptr<const ItemCatalog> cachedCatalog;
+    thread_local std::uint64_t cachedGeneration = 0;
+
+    if (const std::uint64_t latest = generation.load(std::memory_order_acquire); latest != cachedGeneration)
+    {
+        cachedCatalog = currentCatalog.load(std::memory_order_acquire);
+        cachedGeneration = latest;
+    }
+
+    return cachedCatalog;
+}
+
+void ItemCatalog::publish(std::shared_ptr<const ItemCatalog> catalog)
+{
+    currentCatalog.store(std::move(catalog), std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+StatusResponse ItemCatalog::loadFromFile(const std::string& filename, const std::vector<Item>& defaultItems)
+{
+    // Reloads are serialised so each one merges against the catalog published before it.
+    static std::mutex reloadMutex;
+    std::lock_guard lock(reloadMutex);
+
+    std::vector<std::optional<Item>> entries;
+    std::set<Index> retiredIndices;
+    std::map<PlayerType, LootTable> lootTables;
+
+    if (!std::filesystem::exists(filename))
+    {
+        // Starts with the built-in items and writes them out so they can be edited.
+        entries.assign(defaultItems.begin(), defaultItems.end());
+
+        if (const StatusResponse status = JsonHelper::saveItemCatalogToFile(filename, entries); !status.success)
+        {
+            return status;
+        }
+    }
+    else if (const StatusResponse status = JsonHelper::loadItemCatalogFromFile(filename, entries, retiredIndices, lootTables); !status.success)
+    {
+        return status;
+    }
+
+    for (const auto& [playerType, lootTable] : lootTables)
+    {
+        for (const Index index : lootTable.itemIndices)
+        {
+            if (index >= entries.size() || !entries[index].has_value())
+            {
+                return { false, "The " + playerTypeToString(playerType) + " loot table refers to unknown item " + std::to_string(index) };
+            }
+
+            if (retiredIndices.contains(index))
+            {
+                return { false, "The " + playerTypeToString(playerType) + " loot table refers to retired item " + std::to_string(index) };
+            }
+        }
+    }
+
+    std::vector<Index> lootableIndices;
+    for (std::size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].has_value() && !retiredIndices.contains(static_cast<Index>(i))) { lootableIndices.push_back(static_cast<Index>(i)); }
+    }
+
+    if (lootableIndices.empty())
+    {
+        return { false, "The item catalog in " + filename + " has no items" };
+    }
+
+    // Keeps the definitions of items that were removed from the file, since players may still own them.
+    // They're written back as retired, so they're still defined after a restart.
+    std::size_t newlyRetiredItems = 0;
+    if (const std::shared_ptr<const ItemCatalog> previous = current())
+    {
+        if (entries.size() < previous->entries.size())
+        {
+            entries.resize(previous->entries.size());
+        }
+
+        for (std::size_t i = 0; i < previous->entries.size(); i++)
+        {
+            if (!entries[i].has_value() && previous->entries[i].has_value())
+            {
+                entries[i] = previous->entries[i];
+                retiredIndices.insert(static_cast<Index>(i));
+                newlyRetiredItems++;
+            }
+        }
+    }
+
+    if (newlyRetiredItems > 0)
+    {
+        if (const StatusResponse status = JsonHelper::saveItemCatalogToFile(filename, entries, retiredIndices, lootTables); !status.success)
+        {
+            return { false, status.message + ", so the " + std::to_string(newlyRetiredItems) + " removed items couldn't be kept" };
+        }
+    }
+
+    const std::size_t lootableCount = lootableIndices.size();
+    const std::size_t lootTableCount = lootTables.size();
+    const std::size_t retiredItems = retiredIndices.size();
+    publish(std::make_shared<const ItemCatalog>(std::move(entries), std::move(lootableIndices), std::move(lootTables)));
+
+    return { true, "Loaded " + std::to_string(lootableCount) + " items and " + std::to_string(lootTableCount) + " loot tables from " + filename +
+        (retiredItems > 0 ? " (" + std::to_string(retiredItems) + " retired items)" : "") };
+}
@@ -0,0 +1,72 @@
+﻿#ifndef ITEMCATALOG_H
+#define ITEMCATALOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "enums/PlayerType.h"
+#include "structs/Item.h"
+#include "structs/LootTable.h"
+#include "structs/StatusResponse.h"
+
+// An immutable set of item definitions. A new catalog is published as a whole on every reload,
+// so readers never see a partially updated one.
+class ItemCatalog
+{
+public:
+
+    using Index = std::uint16_t;
+
+    // Entries are addressed by their position. Empty entries are unused indices.
+    // Player tiers without a loot table get an even split between money and the lootable items.
+    ItemCatalog(std::vector<std::optional<Item>> entries, std::vector<Index> lootableIndices, std::map<PlayerType, LootTable> lootTables);
+
+    // Gets an item definition by its catalog index.
+    [[nodiscard]] const Item& get(Index index) const;
+
+    // Gets the item definition of an item instance.
+    [[nodiscard]] const Item& get(const ItemInstance& itemInstance) const;
+
+    // Checks if a catalog index refers to a registered item.
+    [[nodiscard]] bool contains(Index index) const;
+
+    // Finds the catalog index of an item by its name.
+    [[nodiscard]] std::optional<Index> findByName(const std::string& name) const;
+
+    // Gets the indices of the items that can still be found on adventures.
+    [[nodiscard]] const std::vector<Index>& getLootableIndices() const;
+
+    // Gets the adventure rewards of a player tier.
+    [[nodiscard]] const LootTable& getLootTable(PlayerType playerType) const;
+
+    [[nodiscard]] std::size_t size() const;
+
+    // Gets the catalog currently in use. The returned pointer keeps it alive even if a reload happens.
+    static std::shared_ptr<const ItemCatalog> current();
+
+    // Replaces the catalog in use.
+    static void publish(std::shared_ptr<const ItemCatalog> catalog);
+
+    // Loads the catalog from a file and publishes it.
+    // Items missing from the file are kept as retired entries, and written back to it marked as such,
+    // so inventories still resolve them after a restart.
+    static StatusResponse loadFromFile(const std::string& filename, const std::vector<Item>& defaultItems);
+
+private:
+
+    std::vector<std::optional<Item>> entries;
+    std::vector<Index> lootableIndices;
+    std::map<std::string, Index> indicesByName;
+    std::map<PlayerType, LootTable> lootTables;
+    LootTable defaultLootTable;
+
+    static std::atomic<std::shared_ptr<const ItemCatalog>> currentCatalog;
+    static std::atomic<std::uint64_t> generation;
+};
+
+#endif //ITEMCATALOG_H
@@ -0,0 +1,312 @@
+﻿#include "PlayerCache.h"
+
+#include <limits>
+#include <ranges>
+
+#include "utilities/FileUtils.h"
+#include "utilities/JsonHelper.h"
+
+PlayerCache::PlayerCache(std::map<std::string, Player, std::less<>>& players, std::shared_mutex& playersMutex)
+    : players(players), playersMutex(playersMutex)
+{
+}
+
+StatusResponse PlayerCache::enable(const std::string& snapshotFilename, const std::chrono::seconds idleTime, PlayerFilter isPinned)
+{
+    if (const StatusResponse status = backingFile.open(snapshotFilename); !status.success)
+    {
+        return status;
+    }
+
+    this->snapshotFilename = snapshotFilename;
+    this->idleTime = idleTime;
+    this->isPinned = std::move(isPinned);
+    enabled = true;
+
+    return { true, "Lazy loading " + std::to_string(backingFile.getPlayerCount()) + " players from " + snapshotFilename +
+        ", evicting them after " + std::to_string(idleTime.count()) + " s idle" };
+}
+
+StatusResponse PlayerCache::enable(KeyValueStore& store, const std::chrono::seconds idleTime, PlayerFilter isPinned)
+{
+    this->store = &store;
+    this->idleTime = idleTime;
+    this->isPinned = std::move(isPinned);
+    enabled = true;
+
+    return { true, "Lazy loading players from the " + store.describe() + ", evicting them after " +
+        std::to_string(idleTime.count()) + " s idle" };
+}
+
+bool PlayerCache::isEnabled() const
+{
+    return enabled;
+}
+
+void PlayerCache::ensureLoaded(const std::string_view username)
+{
+    if (!enabled || username.empty()) return;
+
+    const std::string name(username);
+    {
+        std::shared_lock playersLock(playersMutex);
+        if (players.contains(name))
+        {
+            touch(name);
+            return;
+        }
+    }
+
+    std::unique_lock playersLock(playersMutex);
+    ensureLoadedLocked(name);
+}
+
+void PlayerCache::ensureLoadedLocked(const std::string& username)
+{
+    if (!enabled || username.empty()) return;
+
+    touch(username);
+
+    if (players.contains(username) || removedPlayers.contains(username)) return;
+
+    if (std::optional<Player> player = readBackingPlayer(username); player.has_value())
+    {
+        players.emplace(username, std::move(player.value()));
+    }
+}
+
+void PlayerCache::markRemoved(const std::string& username)
+{
+    if (!enabled) return;
+    removedPlayers.insert(username);
+
+    if (storePlayerCount.has_value() && storePlayerCount.value() > 0) { --storePlayerCount.value(); }
+}
+
+void PlayerCache::markCreated(const std::string& username)
+{
+    if (!enabled) return;
+
+    if (const auto removedIt = removedPlayers.find(username); removedIt != removedPlayers.end())
+    {
+        removedPlayers.erase(removedIt);
+    }
+
+    if (storePlayerCount.has_value()) { ++storePlayerCount.value(); }
+
+    touch(username);
+}
+
+std::size_t PlayerCache::countPlayers()
+{
+    if (!enabled) return players.size();
+
+    if (store != nullptr)
+    {
+        if (!storePlayerCount.has_value())
+        {
+            // Everyone in memory, plus the stored players that aren't and haven't been removed.
+            std::size_t count = players.size();
+            store->scanKeys({}, std::numeric_limits<std::size_t>::max(), [this, &count](const std::string& username)
+            {
+                if (!players.contains(username) && !removedPlayers.contains(username)) { ++count; }
+            });
+            storePlayerCount = count;
+        }
+
+        return storePlayerCount.value();
+    }
+
+    std::size_t count = backingFile.getPlayerCount();
+
+    for (const std::string& username : removedPlayers)
+    {
+        if (backingFile.contains(username)) { --count; }
+    }
+
+    for (const std::string& username : players | std::views::keys)
+    {
+        if (!backingFile.contains(username)) { ++count; }
+    }
+
+    return count;
+}
+
+std::vector<std::string> PlayerCache::collectUsernames() const
+{
+    return collectUsernames({}, std::numeric_limits<std::size_t>::max());
+}
+
+std::vector<std::string> PlayerCache::collectUsernames(const std::string_view after, const std::size_t limit) const
+{
+    std::vector<std::string> usernames;
+    if (limit == 0) return usernames;
+
+    auto playerIt = players.upper_bound(after);
+
+    if (!enabled)
+    {
+        usernames.reserve(std::min(players.size(), limit));
+        for (; playerIt != players.end() && usernames.size() < limit; ++playerIt) { usernames.push_back(playerIt->first); }
+        return usernames;
+    }
+
+    if (store != nullptr)
+    {
+        // Merges the store's keys, read a page at a time, with players not written to it yet.
+        std::vector<std::string> storeUsernames;
+        std::size_t storeIndex = 0;
+        bool storeLeft = true;
+        std::string storeAfter(after);
+
+        while (usernames.size() < limit)
+        {
+            if (storeIndex == storeUsernames.size() && storeLeft)
+            {
+                storeUsernames.clear();
+                storeIndex = 0;
+                const StatusResponse status = store->scanKeys(storeAfter, limit, [&storeUsernames](const std::string& username)
+                {
+                    storeUsernames.push_back(username);
+                });
+                storeLeft = status.success && storeUsernames.size() == limit;
+                if (!storeUsernames.empty()) { storeAfter = storeUsernames.back(); }
+            }
+
+            const bool fromStore = storeIndex < storeUsernames.size();
+            if (!fromStore && playerIt == players.end()) break;
+
+            if (playerIt == players.end() || (fromStore && storeUsernames[storeIndex] < playerIt->first))
+            {
+                std::string& username = storeUsernames[storeIndex++];
+                if (!removedPlayers.contains(username)) { usernames.push_back(std::move(username)); }
+                continue;
+            }
+
+            if (fromStore && storeUsernames[storeIndex] == playerIt->first) { ++storeIndex; }
+
+            usernames.push_back(playerIt->first);
+            ++playerIt;
+        }
+
+        return usernames;
+    }
+
+    // Merges the two sorted lists, so the result is sorted too.
+    std::size_t fileIndex = backingFile.findFirstAfter(after);
+
+    while ((fileIndex < backingFile.getPlayerCount() || playerIt != players.end()) && usernames.size() < limit)
+    {
+        const bool fileLeft = fileIndex < backingFile.getPlayerCount();
+        const std::string_view fileUsername = fileLeft ? backingFile.getUsername(fileIndex) : std::string_view();
+
+        if (playerIt == players.end() || (fileLeft && fileUsername < playerIt->first))
+        {
+            if (!removedPlayers.contains(fileUsername)) { usernames.emplace_back(fileUsername); }
+            ++fileIndex;
+            continue;
+        }
+
+        if (fileLeft && fileUsername == playerIt->first) { ++fileIndex; }
+
+        usernames.push_back(playerIt->first);
+        ++playerIt;
+    }
+
+    return usernames;
+}
+
+const PlayerSnapshotFile& PlayerCache::getBackingFile() const
+{
+    return backingFile;
+}
+
+StatusResponse PlayerCache::replaceBackingFile(const std::string& newFilename, const std::vector<std::string>& savedRemovals)
+{
+    // A mapped file can't be replaced on Windows, so the old mapping is released first.
+    backingFile.close();
+
+    const StatusResponse replaceStatus = FileUtils::replaceFile(newFilename, snapshotFilename);
+
+    const StatusResponse openStatus = backingFile.open(snapshotFilename);
+    if (!replaceStatus.success)
+    {
+        return replaceStatus;
+    }
+
+    if (!openStatus.success)
+    {
+        return openStatus;
+    }
+
+    forgetSavedRemovals(savedRemovals);
+
+    return { true, "Replaced " + snapshotFilename };
+}
+
+void PlayerCache::forgetSavedRemovals(const std::vector<std::string>& savedRemovals)
+{
+    for (const std::string& username : savedRemovals)
+    {
+        if (const auto removedIt = removedPlayers.find(username); removedIt != removedPlayers.end())
+        {
+            removedPlayers.erase(removedIt);
+        }
+    }
+}
+
+std::size_t PlayerCache::evictIdle(const PlayerFilter& isDirty)
+{
+    if (!enabled) return 0;
+
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(accessMutex);
+
+    std::size_t evicted = 0;
+    for (auto playerIt = players.begin(); playerIt != players.end();)
+    {
+        const auto accessIt = lastAccess.find(playerIt->first);
+        const bool idle = accessIt == lastAccess.end() || now - accessIt->second >= idleTime;
+
+        if (idle && !isDirty(playerIt->first) && !(isPinned && isPinned(playerIt->first)))
+        {
+            playerIt = players.erase(playerIt);
+            ++evicted;
+        }
+        else
+        {
+            ++playerIt;
+        }
+    }
+
+    // Forgets about lookups that are too old to matter, including those of players that don't exist.
+    std::erase_if(lastAccess, [&now, this](const auto& access)
+    {
+        return now - access.second >= idleTime;
+    });
+
+    return evicted;
+}
+
+void PlayerCache::touch(const std::string& username)
+{
+    std::lock_guard lock(accessMutex);
+    lastAccess[username] = std::chrono::steady_clock::now();
+}
+
+std::optional<Player> PlayerCache::readBackingPlayer(const std::string& username) const
+{
+    if (store == nullptr) return backingFile.findPlayer(username);
+
+    const std::optional<std::string> value = store->get(username);
+    if (!value.has_value()) return std::nullopt;
+
+    try
+    {
+        return JsonHelper::jsonToPlayer(json::parse(value.value()));
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
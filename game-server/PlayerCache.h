@@ -0,0 +1,97 @@
+﻿#ifndef PLAYERCACHE_H
+#define PLAYERCACHE_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "PlayerSnapshotFile.h"
+#include "storage/KeyValueStore.h"
+#include "structs/Player.h"
+#include "structs/StatusResponse.h"
+
+// Keeps only the active players in memory when lazy loading is on. Everyone else stays in the binary
+// snapshot, or in the key-value store when one is used, and is read back by username the next time
+// they're needed. While lazy loading is off,
+// every call is a no-op and the players map simply holds everyone.
+//
+// Apart from ensureLoaded(), the methods expect the caller to hold the players lock, exclusively when
+// they change anything.
+class PlayerCache
+{
+public:
+
+    using PlayerFilter = std::function<bool(const std::string& username)>;
+
+    PlayerCache(std::map<std::string, Player, std::less<>>& players, std::shared_mutex& playersMutex);
+
+    // Turns lazy loading on. Players idle for longer than idleTime are evicted unless isPinned says otherwise.
+    StatusResponse enable(const std::string& snapshotFilename, std::chrono::seconds idleTime, PlayerFilter isPinned);
+
+    // The same, reading the players that aren't in memory from a key-value store.
+    StatusResponse enable(KeyValueStore& store, std::chrono::seconds idleTime, PlayerFilter isPinned);
+    [[nodiscard]] bool isEnabled() const;
+
+    // Makes sure a player is in memory, if they exist at all. Takes the players lock itself.
+    void ensureLoaded(std::string_view username);
+
+    // The same, for callers already holding the players lock exclusively.
+    void ensureLoadedLocked(const std::string& username);
+
+    // Keeps the old record of a removed player from being loaded again.
+    void markRemoved(const std::string& username);
+    void markCreated(const std::string& username);
+
+    // Counts or lists every player, whether they're in memory or not. With a store, the first count reads
+    // its keys and later ones are kept up to date by markCreated and markRemoved, so it changes the cache.
+    [[nodiscard]] std::size_t countPlayers();
+    [[nodiscard]] std::vector<std::string> collectUsernames() const;
+
+    // Lists at most limit players, in order, starting with the first whose username sorts after the given one.
+    [[nodiscard]] std::vector<std::string> collectUsernames(std::string_view after, std::size_t limit) const;
+
+    // The snapshot holding the players that aren't in memory. Only the snapshotter reads it without
+    // holding the players lock, as it's the only one that replaces it.
+    [[nodiscard]] const PlayerSnapshotFile& getBackingFile() const;
+
+    // Swaps in a newly written snapshot. savedRemovals are the removed players it no longer holds.
+    StatusResponse replaceBackingFile(const std::string& newFilename, const std::vector<std::string>& savedRemovals);
+
+    // Forgets removed players once the store no longer holds them.
+    void forgetSavedRemovals(const std::vector<std::string>& savedRemovals);
+
+    // Drops the idle players from memory. Players with unsaved changes must be reported by isDirty.
+    std::size_t evictIdle(const PlayerFilter& isDirty);
+
+private:
+
+    void touch(const std::string& username);
+
+    // Reads a player that isn't in memory.
+    std::optional<Player> readBackingPlayer(const std::string& username) const;
+
+    std::map<std::string, Player, std::less<>>& players;
+    std::shared_mutex& playersMutex;
+
+    bool enabled = false;
+    std::string snapshotFilename;
+    std::chrono::seconds idleTime { 0 };
+    PlayerFilter isPinned;
+
+    PlayerSnapshotFile backingFile;
+    KeyValueStore* store = nullptr; // Used instead of the backing file when set.
+    std::set<std::string, std::less<>> removedPlayers; // Removed since the backing file was written.
+    std::optional<std::size_t> storePlayerCount; // Every player, once counted with a store.
+
+    std::mutex accessMutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> lastAccess;
+};
+
+#endif //PLAYERCACHE_H
@@ -0,0 +1,475 @@
+﻿#include "PlayerSnapshotFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <ranges>
+#include <thread>
+#include <vector>
+
+#include "utilities/AtomicFileWriter.h"
+#include "utilities/GUIDUtils.h"
+
+namespace
+{
+    constexpr char MAGIC[4] = { 'G', 'S', 'N', 'P' };
+
+    struct FileHeader
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t playerCount;
+        std::uint32_t itemCount;
+        std::uint64_t playersOffset;
+        std::uint64_t itemsOffset;
+        std::uint64_t stringsOffset;
+        std::uint64_t stringsSize;
+    };
+
+    struct PlayerRecord
+    {
+        std::uint32_t usernameOffset;
+        std::uint32_t usernameLength;
+        std::uint32_t firstItem;
+        std::uint32_t itemCount;
+        float balance;
+        std::uint8_t type;
+        std::uint8_t isAdmin;
+        std::uint16_t reserved;
+    };
+
+    struct ItemRecord
+    {
+        std::uint8_t id[16];
+        std::uint16_t catalogIndex;
+        std::uint16_t reserved;
+    };
+
+    // Below this many players per thread, starting the threads costs more than it saves.
+    constexpr std::size_t MIN_PLAYERS_PER_THREAD = 4096;
+
+    static_assert(sizeof(FileHeader) == 48);
+    static_assert(sizeof(PlayerRecord) == 24);
+    static_assert(sizeof(ItemRecord) == 20);
+
+    // Copies a record out of the mapping, which makes no promises about alignment.
+    template<typename T>
+    T readRecord(const char* data, const std::size_t offset)
+    {
+        T record;
+        std::memcpy(&record, data + offset, sizeof(T));
+        return record;
+    }
+
+    template<typename T>
+    void appendRecord(std::string& buffer, const T& record)
+    {
+        buffer.append(reinterpret_cast<const char*>(&record), sizeof(T));
+    }
+
+    // Collects the sections of a snapshot file. Players have to be added in username order.
+    class SnapshotBuilder
+    {
+    public:
+
+        void addPlayer(const Player& player)
+        {
+            PlayerRecord record{};
+            record.itemCount = static_cast<std::uint32_t>(player.inventory.size());
+            record.balance = player.balance;
+            record.type = static_cast<std::uint8_t>(player.type);
+            record.isAdmin = player.isAdmin ? 1 : 0;
+
+            for (const ItemInstance& itemInstance : player.inventory)
+            {
+                ItemRecord item{};
+                GUIDUtils::GUIDToBytes(itemInstance.id, item.id);
+                item.catalogIndex = itemInstance.catalogIndex;
+                appendRecord(items, item);
+            }
+
+            addRecord(record, player.username);
+        }
+
+        // Adds a record copied from another snapshot, along with its raw item records.
+        void addCopiedRecord(PlayerRecord record, const std::string_view username, const char* itemRecords)
+        {
+            items.append(itemRecords, static_cast<std::size_t>(record.itemCount) * sizeof(ItemRecord));
+            addRecord(record, username);
+        }
+
+        // Appends the records of a builder that covered the players after this one's.
+        void append(const SnapshotBuilder& other)
+        {
+            const auto stringsBase = static_cast<std::uint32_t>(strings.size());
+
+            players.reserve(players.size() + other.players.size());
+            for (std::size_t offset = 0; offset < other.players.size(); offset += sizeof(PlayerRecord))
+            {
+                auto record = readRecord<PlayerRecord>(other.players.data(), offset);
+                record.usernameOffset += stringsBase;
+                record.firstItem += itemCount;
+                appendRecord(players, record);
+            }
+
+            items += other.items;
+            strings += other.strings;
+            playerCount += other.playerCount;
+            itemCount += other.itemCount;
+        }
+
+        // Writes the file under a temporary name first, so a crash never leaves a torn snapshot behind.
+        StatusResponse writeTo(const std::string& filename, const Compression::Codec codec) const
+        {
+            FileHeader header{};
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = PlayerSnapshotFile::VERSION;
+            header.playerCount = playerCount;
+            header.itemCount = itemCount;
+            header.playersOffset = sizeof(FileHeader);
+            header.itemsOffset = header.playersOffset + players.size();
+            header.stringsOffset = header.itemsOffset + items.size();
+            header.stringsSize = strings.size();
+
+            AtomicFileWriter output(filename);
+            output.setCompression(codec);
+            if (!output.open())
+            {
+                return { false, "Could not open " + filename };
+            }
+
+            output.write({ reinterpret_cast<const char*>(&header), sizeof(FileHeader) });
+            output.write(players);
+            output.write(items);
+            output.write(strings);
+
+            if (const StatusResponse status = output.commit(); !status.success)
+            {
+                return status;
+            }
+
+            const std::size_t totalBytes = sizeof(FileHeader) + players.size() + items.size() + strings.size();
+            const std::string compression = codec == Compression::Codec::None
+                ? ""
+                : ", " + Compression::codecName(codec) + " " + output.getStats().describe();
+
+            return { true, "Saved " + std::to_string(playerCount) + " players (" + std::to_string(totalBytes) + " bytes" +
+                compression + ") to " + filename };
+        }
+
+    private:
+
+        void addRecord(PlayerRecord record, const std::string_view username)
+        {
+            record.usernameOffset = static_cast<std::uint32_t>(strings.size());
+            record.usernameLength = static_cast<std::uint32_t>(username.size());
+            record.firstItem = itemCount;
+            appendRecord(players, record);
+            strings.append(username);
+
+            itemCount += record.itemCount;
+            ++playerCount;
+        }
+
+        std::string players;
+        std::string items;
+        std::string strings;
+        std::uint32_t playerCount = 0;
+        std::uint32_t itemCount = 0;
+    };
+}
+
+StatusResponse PlayerSnapshotFile::open(const std::string& filename)
+{
+    close();
+
+    if (!file.open(filename))
+    {
+        return { false, "No binary snapshot found at " + filename };
+    }
+
+    const auto fail = [this, &filename](const std::string& reason) -> StatusResponse
+    {
+        close();
+        return { false, "Invalid binary snapshot " + filename + ": " + reason };
+    };
+
+    if (file.size() < sizeof(FileHeader)) return fail("file is too small");
+
+    const auto header = readRecord<FileHeader>(file.data(), 0);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return fail("unknown file type");
+    if (header.version != VERSION) return fail("unsupported version " + std::to_string(header.version));
+
+    const std::uint64_t size = file.size();
+    if (header.playersOffset > size || (size - header.playersOffset) / sizeof(PlayerRecord) < header.playerCount ||
+        header.itemsOffset > size || (size - header.itemsOffset) / sizeof(ItemRecord) < header.itemCount ||
+        header.stringsOffset > size || size - header.stringsOffset < header.stringsSize)
+    {
+        return fail("section out of bounds");
+    }
+
+    playerCount = header.playerCount;
+    itemCount = header.itemCount;
+    playersOffset = header.playersOffset;
+    itemsOffset = header.itemsOffset;
+    stringsOffset = header.stringsOffset;
+    stringsSize = header.stringsSize;
+
+    // Checked once here, so lookups can trust every record afterwards.
+    std::string_view previousUsername;
+    for (std::size_t i = 0; i < playerCount; ++i)
+    {
+        const auto record = readRecord<PlayerRecord>(file.data(), playersOffset + i * sizeof(PlayerRecord));
+        if (record.usernameOffset > stringsSize || stringsSize - record.usernameOffset < record.usernameLength ||
+            record.firstItem > itemCount || itemCount - record.firstItem < record.itemCount)
+        {
+            return fail("player record " + std::to_string(i) + " out of bounds");
+        }
+
+        const std::string_view username = getUsername(i);
+        if (i > 0 && username <= previousUsername)
+        {
+            return fail("players are not sorted by username");
+        }
+
+        previousUsername = username;
+    }
+
+    const std::string decompression = file.getDecodeStats().has_value()
+        ? ", decompressed " + file.getDecodeStats()->describe()
+        : "";
+
+    return { true, "Mapped binary snapshot " + filename + " (" + std::to_string(playerCount) + " players" + decompression + ")" };
+}
+
+void PlayerSnapshotFile::close()
+{
+    file.close();
+    playerCount = 0;
+    itemCount = 0;
+    playersOffset = 0;
+    itemsOffset = 0;
+    stringsOffset = 0;
+    stringsSize = 0;
+}
+
+std::size_t PlayerSnapshotFile::getPlayerCount() const
+{
+    return playerCount;
+}
+
+std::string_view PlayerSnapshotFile::getUsername(const std::size_t index) const
+{
+    const auto record = readRecord<PlayerRecord>(file.data(), playersOffset + index * sizeof(PlayerRecord));
+    return { file.data() + stringsOffset + record.usernameOffset, record.usernameLength };
+}
+
+Player PlayerSnapshotFile::readPlayer(const std::size_t index) const
+{
+    const auto record = readRecord<PlayerRecord>(file.data(), playersOffset + index * sizeof(PlayerRecord));
+    const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
+
+    Player player;
+    player.username = getUsername(index);
+    player.balance = record.balance;
+    player.type = static_cast<PlayerType>(record.type);
+    player.isAdmin = record.isAdmin != 0;
+    player.inventory.reserve(record.itemCount);
+
+    for (std::size_t i = record.firstItem; i < record.firstItem + record.itemCount; ++i)
+    {
+        const auto item = readRecord<ItemRecord>(file.data(), itemsOffset + i * sizeof(ItemRecord));
+        if (!catalog->contains(item.catalogIndex))
+        {
+            std::cout << "Skipping unknown item " << item.catalogIndex << " for player " << player.username << std::endl;
+            continue;
+        }
+
+        player.inventory.emplace_back(item.catalogIndex, GUIDUtils::bytesToGUID(item.id));
+    }
+
+    return player;
+}
+
+std::optional<std::size_t> PlayerSnapshotFile::findIndex(const std::string_view username) const
+{
+    std::size_t low = 0;
+    std::size_t high = playerCount;
+
+    while (low < high)
+    {
+        const std::size_t middle = low + (high - low) / 2;
+        const std::string_view middleUsername = getUsername(middle);
+
+        if (middleUsername == username) return middle;
+        if (middleUsername < username) { low = middle + 1; }
+        else { high = middle; }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<Player> PlayerSnapshotFile::findPlayer(const std::string_view username) const
+{
+    if (const std::optional<std::size_t> index = findIndex(username); index.has_value())
+    {
+        return readPlayer(index.value());
+    }
+
+    return std::nullopt;
+}
+
+bool PlayerSnapshotFile::contains(const std::string_view username) const
+{
+    return findIndex(username).has_value();
+}
+
+std::size_t PlayerSnapshotFile::findFirstAfter(const std::string_view username) const
+{
+    std::size_t low = 0;
+    std::size_t high = playerCount;
+
+    while (low < high)
+    {
+        const std::size_t middle = low + (high - low) / 2;
+
+        if (getUsername(middle) <= username) { low = middle + 1; }
+        else { high = middle; }
+    }
+
+    return low;
+}
+
+StatusResponse PlayerSnapshotFile::loadAll(std::map<std::string, Player, std::less<>>& players, const unsigned int threadCount) const
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    players.clear();
+
+    const std::size_t usefulThreads = std::max<std::size_t>(1, playerCount / MIN_PLAYERS_PER_THREAD);
+    const std::size_t chunkCount = std::clamp<std::size_t>(threadCount, 1, usefulThreads);
+    const std::size_t chunkSize = (playerCount + chunkCount - 1) / std::max<std::size_t>(1, chunkCount);
+
+    // Each thread decodes its own contiguous run of records.
+    std::vector<std::vector<Player>> chunks(chunkCount);
+    const auto decodeChunk = [this, &chunks, chunkSize](const std::size_t chunk)
+    {
+        const std::size_t begin = std::min(chunk * chunkSize, playerCount);
+        const std::size_t end = std::min(begin + chunkSize, playerCount);
+
+        chunks[chunk].reserve(end - begin);
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            chunks[chunk].push_back(readPlayer(i));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        workers.emplace_back(decodeChunk, chunk);
+    }
+
+    decodeChunk(0);
+    for (std::thread& worker : workers) { worker.join(); }
+
+    const auto decodeTime = std::chrono::steady_clock::now();
+
+    // The records are sorted and the chunks are in order, so every insert lands at the end of the map.
+    for (std::vector<Player>& chunk : chunks)
+    {
+        for (Player& player : chunk)
+        {
+            std::string username = player.username;
+            players.emplace_hint(players.end(), std::move(username), std::move(player));
+        }
+    }
+
+    const auto endTime = std::chrono::steady_clock::now();
+    const auto decodeMs = std::chrono::duration_cast<std::chrono::milliseconds>(decodeTime - startTime).count();
+    const auto mergeMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - decodeTime).count();
+
+    return { true, "Loaded " + std::to_string(players.size()) + " players from the binary snapshot on " +
+        std::to_string(chunkCount) + " threads (decode " + std::to_string(decodeMs) + " ms, merge " + std::to_string(mergeMs) + " ms)" };
+}
+
+StatusResponse PlayerSnapshotFile::save(const std::string& filename, const std::map<std::string, Player, std::less<>>& players,
+                                        const Compression::Codec codec)
+{
+    // std::map iterates in username order, which is the order lookups expect.
+    std::vector<const Player*> orderedPlayers;
+    orderedPlayers.reserve(players.size());
+    for (const Player& player : players | std::views::values) { orderedPlayers.push_back(&player); }
+
+    // Each thread builds the records of one run of players, and the runs are joined in order.
+    const std::size_t chunkCount = std::max<std::size_t>(1, std::min<std::size_t>(
+        std::thread::hardware_concurrency(), orderedPlayers.size() / MIN_PLAYERS_PER_THREAD));
+    const std::size_t chunkSize = (orderedPlayers.size() + chunkCount - 1) / chunkCount;
+
+    std::vector<SnapshotBuilder> builders(chunkCount);
+    const auto buildChunk = [&](const std::size_t chunk)
+    {
+        const std::size_t begin = std::min(orderedPlayers.size(), chunk * chunkSize);
+        const std::size_t end = std::min(orderedPlayers.size(), begin + chunkSize);
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            builders[chunk].addPlayer(*orderedPlayers[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        workers.emplace_back(buildChunk, chunk);
+    }
+
+    buildChunk(0);
+    for (std::thread& worker : workers) { worker.join(); }
+
+    for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+    {
+        builders[0].append(builders[chunk]);
+    }
+
+    return builders[0].writeTo(filename, codec);
+}
+
+StatusResponse PlayerSnapshotFile::saveMerged(const std::string& filename, const PlayerSnapshotFile& base,
+                                              const std::map<std::string, Player, std::less<>>& changedPlayers,
+                                              const std::set<std::string, std::less<>>& removedPlayers,
+                                              const Compression::Codec codec)
+{
+    SnapshotBuilder builder;
+    std::size_t baseIndex = 0;
+    auto changedIt = changedPlayers.begin();
+
+    // Both inputs are sorted by username, so they're merged in a single pass.
+    while (baseIndex < base.playerCount || changedIt != changedPlayers.end())
+    {
+        const bool baseLeft = baseIndex < base.playerCount;
+        const std::string_view baseUsername = baseLeft ? base.getUsername(baseIndex) : std::string_view();
+
+        if (changedIt == changedPlayers.end() || (baseLeft && baseUsername < changedIt->first))
+        {
+            if (!removedPlayers.contains(baseUsername))
+            {
+                const auto record = readRecord<PlayerRecord>(base.file.data(), base.playersOffset + baseIndex * sizeof(PlayerRecord));
+                builder.addCopiedRecord(record, baseUsername, base.file.data() + base.itemsOffset + record.firstItem * sizeof(ItemRecord));
+            }
+
+            ++baseIndex;
+            continue;
+        }
+
+        if (baseLeft && baseUsername == changedIt->first) { ++baseIndex; }
+
+        builder.addPlayer(changedIt->second);
+        ++changedIt;
+    }
+
+    return builder.writeTo(filename, codec);
+}
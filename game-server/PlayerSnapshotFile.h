@@ -0,0 +1,76 @@
+﻿#ifndef PLAYERSNAPSHOTFILE_H
+#define PLAYERSNAPSHOTFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "structs/Player.h"
+#include "structs/StatusResponse.h"
+#include "utilities/Compression.h"
+#include "utilities/MappedFile.h"
+
+// The binary game data snapshot. The file is mapped into memory and players are read straight
+// out of it, either all at once on startup or one at a time by username.
+//
+// Layout (little-endian):
+//   header       magic "GSNP", version, player count, item count and the offsets of the sections below
+//   players      fixed-size records sorted by username, so the table doubles as the lookup index
+//   items        fixed-size inventory entries; each player points at a contiguous run of them
+//   strings      the usernames, referenced by offset and length
+class PlayerSnapshotFile
+{
+public:
+
+    static constexpr std::uint32_t VERSION = 1;
+
+    // Maps a snapshot file and checks that every record lies within it.
+    StatusResponse open(const std::string& filename);
+    void close();
+
+    [[nodiscard]] std::size_t getPlayerCount() const;
+    [[nodiscard]] std::string_view getUsername(std::size_t index) const;
+
+    // Reads one player. Items no longer in the catalog are skipped.
+    [[nodiscard]] Player readPlayer(std::size_t index) const;
+
+    // Looks a player up by username without loading anyone else.
+    [[nodiscard]] std::optional<Player> findPlayer(std::string_view username) const;
+    [[nodiscard]] bool contains(std::string_view username) const;
+
+    // The index of the first player whose username sorts after the given one.
+    [[nodiscard]] std::size_t findFirstAfter(std::string_view username) const;
+
+    // Loads every player, decoding the records on several threads.
+    StatusResponse loadAll(std::map<std::string, Player, std::less<>>& players, unsigned int threadCount = 1) const;
+
+    // Writes players to a snapshot file, building the records on several threads.
+    // The file is only replaced once the new one is complete and on disk.
+    static StatusResponse save(const std::string& filename, const std::map<std::string, Player, std::less<>>& players,
+                               Compression::Codec codec = Compression::Codec::None);
+
+    // Writes a snapshot file holding the players of another one with some changed or removed.
+    // Unchanged records are copied across as they are, without being decoded.
+    static StatusResponse saveMerged(const std::string& filename, const PlayerSnapshotFile& base,
+                                     const std::map<std::string, Player, std::less<>>& changedPlayers,
+                                     const std::set<std::string, std::less<>>& removedPlayers,
+                                     Compression::Codec codec = Compression::Codec::None);
+
+private:
+
+    [[nodiscard]] std::optional<std::size_t> findIndex(std::string_view username) const;
+
+    MappedFile file;
+    std::size_t playerCount = 0;
+    std::size_t itemCount = 0;
+    std::size_t playersOffset = 0;
+    std::size_t itemsOffset = 0;
+    std::size_t stringsOffset = 0;
+    std::size_t stringsSize = 0;
+};
+
+#endif //PLAYERSNAPSHOTFILE_H
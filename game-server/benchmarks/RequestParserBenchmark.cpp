@@ -0,0 +1,128 @@
+﻿#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../structs/JsonMessage.h"
+#include "../utilities/RequestParser.h"
+#include "../utilities/StructuralScanner.h"
+#include "../utilities/WireProtocol.h"
+
+using json = nlohmann::json;
+
+// Frames and parses a realistic mix of requests, as a client sending them back to back would, once
+// with the json object the servers used to build and once with RequestParser at each scanner level.
+
+namespace
+{
+    constexpr int ROUNDS = 200;
+    constexpr int REQUESTS_PER_ROUND = 1000;
+    constexpr std::size_t READ_SIZE = 1024;
+
+    std::string makeRequests()
+    {
+        const std::vector<std::string> usernames = {"alice", "bob", "a_much_longer_player_name", "carol_the_collector"};
+        std::string requests;
+
+        for (int i = 0; i < REQUESTS_PER_ROUND; i++)
+        {
+            const std::string& username = usernames[i % usernames.size()];
+            const std::string token = "AUTH_" + username + "_17" + std::to_string(10000000 + i);
+
+            switch (i % 6)
+            {
+            case 0:
+            case 1:
+                requests += R"({"action":"adventure","username":")" + username + R"(","token":")" + token + "\"}";
+                break;
+            case 2:
+                requests += R"({"action":"store","username":")" + username + R"(","token":")" + token + "\"}";
+                break;
+            case 3:
+                requests += R"({"action": "sell", "username": ")" + username + R"(", "token": ")" + token
+                    + R"(", "itemId": "6B29FC40-CA47-1067-B31D-00DD010662DA"})";
+                break;
+            case 4:
+                requests += R"({"action":"list_items","username":")" + username + R"(","token":")" + token + "\"}";
+                break;
+            default:
+                requests += R"({"action":"modify_type","username":"admin","token":"AUTH_admin_1700000000","targetUser":")"
+                    + username + R"(","newType":"Gold"})";
+                break;
+            }
+        }
+
+        return requests;
+    }
+
+    // Parse returns 1 for each request it read, so the work can't be optimised away.
+    template <typename Parse>
+    void run(const char* name, const std::string& requests, Parse parse)
+    {
+        std::string buffer;
+        WireProtocol::TextScan scan;
+        std::string message;
+        std::size_t parsed = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            // The requests arrive in reads of the same size as the servers' receive buffer.
+            for (std::size_t offset = 0; offset < requests.size(); offset += READ_SIZE)
+            {
+                buffer.append(requests, offset, READ_SIZE);
+
+                while (WireProtocol::takeMessage(buffer, WireProtocol::Format::Json, message, scan) == WireProtocol::FrameResult::Complete)
+                {
+                    parsed += parse(message);
+                }
+            }
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double requestCount = static_cast<double>(ROUNDS) * REQUESTS_PER_ROUND;
+
+        std::cout << name << ": " << seconds * 1e9 / requestCount << " ns per request, "
+                  << static_cast<double>(requests.size()) * ROUNDS / seconds / (1024 * 1024) << " MiB/s"
+                  << " (" << parsed << " parsed)" << std::endl;
+    }
+}
+
+int main()
+{
+    const std::string requests = makeRequests();
+    std::cout << requests.size() / REQUESTS_PER_ROUND << " bytes per request on average" << std::endl;
+
+    run("json object", requests, [](const std::string& message)
+    {
+        const json j = json::parse(message);
+        std::string fields[JSON_MESSAGE_TEXT_FIELDS.size()];
+
+        for (std::size_t i = 0; i < JSON_MESSAGE_TEXT_FIELDS.size(); i++)
+        {
+            fields[i] = j.value(JSON_MESSAGE_TEXT_FIELDS[i].first, "");
+        }
+
+        return fields[0].empty() ? 0 : 1;
+    });
+
+    for (const StructuralScanner::Level level : {StructuralScanner::Level::Scalar, StructuralScanner::Level::Sse42, StructuralScanner::Level::Avx2})
+    {
+        if (!StructuralScanner::setLevel(level))
+        {
+            std::cout << "RequestParser (" << StructuralScanner::levelName(level) << "): not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        const std::string name = std::string("RequestParser (") + StructuralScanner::levelName(level) + ")";
+        run(name.c_str(), requests, [](const std::string& message)
+        {
+            JsonMessage msg;
+            return RequestParser::parse(message, msg) ? 1 : 0;
+        });
+    }
+
+    return 0;
+}
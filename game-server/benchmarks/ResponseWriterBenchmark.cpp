@@ -0,0 +1,152 @@
+﻿#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../utilities/ResponseWriter.h"
+#include "../utilities/WireProtocol.h"
+
+using json = nlohmann::json;
+
+// Compares building a list_items response as a json object and dumping it with writing it
+// through ResponseWriter, counting the heap allocations each makes per response.
+
+namespace
+{
+    std::atomic<std::size_t> allocationCount{0};
+
+    struct BenchmarkItem
+    {
+        std::string id;
+        std::string type;
+        std::string name;
+        int weight;
+        float value;
+    };
+
+    constexpr int ITERATIONS = 20000;
+    constexpr int INVENTORY_SIZE = 20;
+
+    std::vector<BenchmarkItem> makeInventory()
+    {
+        std::vector<BenchmarkItem> inventory;
+        for (int i = 0; i < INVENTORY_SIZE; i++)
+        {
+            inventory.push_back({"6B29FC40-CA47-1067-B31D-00DD010662DA", "Weapon", "Sword of item " + std::to_string(i), 3 + i % 5, 12.5f + i});
+        }
+
+        return inventory;
+    }
+
+    std::string buildWithJson(const std::vector<BenchmarkItem>& inventory, const WireProtocol::Format format)
+    {
+        json responseData;
+        responseData["inventory"] = json::array();
+
+        for (const BenchmarkItem& item : inventory)
+        {
+            json j;
+            j["id"] = item.id;
+            j["type"] = item.type;
+            j["name"] = item.name;
+            j["weight"] = item.weight;
+            j["value"] = item.value;
+            responseData["inventory"].push_back(j);
+        }
+
+        responseData["total_items"] = inventory.size();
+        responseData["used_space"] = 60;
+        responseData["max_space"] = 100;
+
+        json response;
+        response["success"] = true;
+        response["message"] = "Inventory retrieved successfully";
+        response["data"] = responseData;
+
+        return WireProtocol::encode(response, format);
+    }
+
+    std::string_view buildWithWriter(std::string& output, const std::vector<BenchmarkItem>& inventory, const WireProtocol::Format format)
+    {
+        ResponseWriter response(output, format);
+        response.begin(true, "Inventory retrieved successfully").beginData()
+            .beginArray("inventory");
+
+        for (const BenchmarkItem& item : inventory)
+        {
+            response.beginObject()
+                .field("id", item.id)
+                .field("type", item.type)
+                .field("name", item.name)
+                .field("weight", item.weight)
+                .field("value", item.value)
+                .endObject();
+        }
+
+        response.endArray()
+            .field("total_items", inventory.size())
+            .field("used_space", 60)
+            .field("max_space", 100);
+        response.end();
+
+        return response.finish();
+    }
+
+    template <typename Build>
+    void run(const char* name, const WireProtocol::Format format, Build build)
+    {
+        std::size_t bytes = 0;
+        build(bytes); // Warms up buffers that are kept between responses.
+
+        const std::size_t allocationsBefore = allocationCount.load();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < ITERATIONS; i++)
+        {
+            build(bytes);
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const std::size_t allocations = allocationCount.load() - allocationsBefore;
+
+        std::cout << name << " (" << WireProtocol::formatName(format) << "): "
+                  << static_cast<double>(allocations) / ITERATIONS << " allocations, "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ITERATIONS << " ns, "
+                  << bytes << " bytes per response" << std::endl;
+    }
+}
+
+void* operator new(const std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main()
+{
+    const std::vector<BenchmarkItem> inventory = makeInventory();
+    std::string output;
+
+    for (const WireProtocol::Format format : {WireProtocol::Format::Json, WireProtocol::Format::MessagePack, WireProtocol::Format::Cbor})
+    {
+        run("json object", format, [&](std::size_t& bytes) { bytes = buildWithJson(inventory, format).size(); });
+        run("ResponseWriter", format, [&](std::size_t& bytes) { bytes = buildWithWriter(output, inventory, format).size(); });
+    }
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 ﻿#ifndef PLAYERTYPE_H
 #define PLAYERTYPE_H
 
+#include <string_view>
+
 enum class PlayerType
 {
     Freemium = 20,
@@ -10,7 +12,7 @@ enum class PlayerType
     Platinum = 120
 };
 
-inline std::optional<PlayerType> stringToPlayerType(const std::string& string)
+inline std::optional<PlayerType> stringToPlayerType(const std::string_view string)
 {
     if (string == "Freemium") return PlayerType::Freemium;
     if (string == "Bronze") return PlayerType::Bronze;
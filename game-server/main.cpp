@@ -5,20 +5,58 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
+#include <shared_mutex>
 #include <atomic>
 #include <csignal>
-#include <random>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
 
 #include "AuthServerClient.h"
+#include "GameJournal.h"
+#include "GameSnapshotter.h"
+#include "ItemCatalog.h"
+#include "PlayerCache.h"
+#include "PlayerSnapshotFile.h"
+#include "storage/JsonFileStore.h"
+#include "storage/LogStructuredStore.h"
+#include "structs/ClientSession.h"
 #include "structs/Player.h"
+#include "utilities/ActionTable.h"
+#include "utilities/CannedResponse.h"
+#include "utilities/CommandLineUtils.h"
+#include "utilities/Compression.h"
 #include "utilities/JsonHelper.h"
+#include "utilities/RandomUtils.h"
+#include "utilities/ResponseWriter.h"
+#include "utilities/WireProtocol.h"
 
 namespace
 {
     const std::string GAME_DATA_FILE = "game_data.json";
+    const std::string GAME_SNAPSHOT_FILE = "game_data.bin";
+    const std::string GAME_STORE_DIRECTORY = "game_data.db";
+    const std::string JOURNAL_FILE = "game_journal.log";
+    const std::string JOURNAL_CHECKPOINT_FILE = "game_journal.checkpoint.log";
+    const std::string ITEMS_FILE = "items.json";
+    const std::string ADMIN_USERNAME = "admin";
 
-    // Some sample items for adventures.
-    const std::vector ADVENTURE_ITEMS =
+    // How many users a page of the admin's list_users holds, unless the request asks for fewer.
+    constexpr std::size_t DEFAULT_USERS_PAGE_SIZE = 100;
+    constexpr std::size_t MAX_USERS_PAGE_SIZE = 1000;
+
+    // The most actions one batch request may hold.
+    constexpr std::size_t MAX_BATCH_ACTIONS = 16;
+
+    // Responses smaller than this are sent uncompressed, as compressing them saves too little.
+    constexpr std::size_t COMPRESSION_THRESHOLD = 1024;
+
+    // How often the item catalog file is checked for changes.
+    constexpr auto ITEMS_FILE_POLL_INTERVAL = std::chrono::seconds(2);
+
+    // Items used when no item catalog file exists yet. They are written to the file on first start.
+    const std::vector DEFAULT_ADVENTURE_ITEMS =
     {
         Item("weapon", "Iron Dagger", 3, 150.0),
         Item("consumable", "Health Potion", 1, 25.0),
@@ -34,14 +72,46 @@ namespace
     std::atomic currentConnections{0};
     std::mutex connectionMutex;
 
-    std::map<std::string, Player> players;
-    std::map<std::string, bool> onlineUsers;
+    std::map<std::string, Player, std::less<>> players;
+    std::shared_mutex playersMutex; // Guards the players map and every player in it.
+    GameJournal journal;
+    PlayerCache playerCache(players, playersMutex);
+    GameSnapshotter snapshotter(players, playersMutex, journal, playerCache, GAME_SNAPSHOT_FILE, JOURNAL_CHECKPOINT_FILE);
+
+    // How often the changed players are saved in the background.
+    std::chrono::seconds snapshotInterval { 30 };
+
+    // The key-value store the players are saved to, if one was picked with --storage.
+    std::unique_ptr<KeyValueStore> playerStore;
+
+    // Where to also write the game data as JSON on shutdown, if anywhere.
+    std::optional<std::string> jsonExportFilename;
+
+    // How the snapshot, the journal and the JSON export are compressed.
+    Compression::Codec fileCodec = Compression::Codec::None;
+
+    // The most common errors, serialised once at startup.
+    const CannedResponse AUTHENTICATE_FIRST(false, "Please authenticate first");
+    const CannedResponse INVALID_TOKEN(false, "Invalid authentication token");
+    const CannedResponse AT_CAPACITY(false, "Server is at capacity for your user type. Please try again later");
+    const CannedResponse PLAYER_NOT_FOUND(false, "Player not found");
+    const CannedResponse TARGET_NOT_FOUND(false, "Target user not found");
+    const CannedResponse NOT_ADMIN(false, "Insufficient permissions. Admin access required");
+    const CannedResponse ITEM_NOT_FOUND(false, "Item not found in inventory");
+    const CannedResponse NO_INVENTORY(false, "Admin accounts have no inventory");
+    const CannedResponse NO_ADVENTURES(false, "Admin accounts cannot go on adventures");
+    const CannedResponse NOT_SAVED(false, "The change was made but could not be written to disk, so it may be lost if the server restarts");
+
+    // How long a player stays in memory after their last request, if lazy loading is on.
+    std::optional<std::chrono::seconds> playerIdleTime;
+    std::map<std::string, bool, std::less<>> onlineUsers;
     std::mutex onlineUsersMutex; // Thread safety for online users map.
 
-    std::map<std::string, ItemInstance> pendingItems;
+    // How long an item found on an adventure can be stored before it's discarded.
+    std::chrono::seconds pendingItemTimeToLive { 300 };
+
     std::atomic serverRunning { true };
     SOCKET listenSocket = INVALID_SOCKET;
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
 
     // Shuts the server down gracefully.
     void performShutdown()
@@ -50,9 +120,38 @@ namespace
 
         std::cout << "\nShutting down the game server..." << std::endl;
 
-        const StatusResponse status = JsonHelper::saveGameDataToFile(GAME_DATA_FILE, players);
+        // Only the players changed since the last background snapshot need saving.
+        snapshotter.stop();
+        const StatusResponse status = snapshotter.takeSnapshot();
         std::cout << status.message << std::endl;
 
+        if (jsonExportFilename.has_value())
+        {
+            std::shared_lock playersLock(playersMutex);
+
+            // With lazy loading, only the final snapshot holds everyone.
+            std::map<std::string, Player, std::less<>> allPlayers;
+            if (playerCache.isEnabled() && playerStore != nullptr)
+            {
+                playerStore->scan([&allPlayers](const std::string& username, const std::string& value)
+                {
+                    allPlayers.emplace(username, JsonHelper::jsonToPlayer(json::parse(value)));
+                });
+            }
+            else if (playerCache.isEnabled())
+            {
+                playerCache.getBackingFile().loadAll(allPlayers);
+            }
+
+            const StatusResponse exportStatus = JsonHelper::saveGameDataToFile(jsonExportFilename.value(), playerCache.isEnabled() ? allPlayers : players,
+                                                                               fileCodec);
+            std::cout << exportStatus.message << std::endl;
+        }
+
+        journal.close();
+
+        if (playerStore != nullptr) { playerStore->close(); }
+
         if (listenSocket != INVALID_SOCKET)
         {
             closesocket(listenSocket);
@@ -109,11 +208,11 @@ namespace
     // Creates an admin account if none is present at server initialisation.
     void ensureAdminPlayerExists()
     {
-        const std::string adminUsername = "admin";
+        playerCache.ensureLoadedLocked(ADMIN_USERNAME);
 
-        if (players.contains(adminUsername))
+        if (players.contains(ADMIN_USERNAME))
         {
-            Player& adminPlayer = players[adminUsername];
+            Player& adminPlayer = players[ADMIN_USERNAME];
             adminPlayer.isAdmin = true;
             adminPlayer.balance = 0.0f;
             adminPlayer.inventory.clear();
@@ -121,17 +220,26 @@ namespace
         }
 
         Player adminPlayer;
-        adminPlayer.username = adminUsername;
+        adminPlayer.username = ADMIN_USERNAME;
         adminPlayer.authToken = "";
         adminPlayer.type = PlayerType::Freemium;
         adminPlayer.balance = 0.0f;
         adminPlayer.isAdmin = true;
 
-        players[adminUsername] = adminPlayer;
+        players[ADMIN_USERNAME] = adminPlayer;
+    }
+
+    // Checks if a username belongs to an admin player.
+    bool isAdminPlayer(const std::string_view username)
+    {
+        std::shared_lock playersLock(playersMutex);
+
+        const auto playerIt = players.find(username);
+        return playerIt != players.end() && playerIt->second.isAdmin;
     }
 
     // Checks if the player can join or if the server is full.
-    bool canUserConnect(const std::string& username, const std::string& token)
+    bool canUserConnect(const std::string_view username, const std::string_view token)
     {
         json request;
         request["action"] = "get_user_info";
@@ -200,10 +308,13 @@ namespace
     }
 
     // Validates the player's auth token (very simplified!).
-    bool validateToken(const std::string& token, const std::string& username)
+    bool validateToken(const std::string_view token, const std::string_view username)
     {
-        const std::string expectedPrefix = "AUTH_" + username + "_";
-        return token.substr(0, expectedPrefix.length()) == expectedPrefix;
+        // Tokens look like AUTH_<username>_<time>.
+        constexpr std::string_view prefix = "AUTH_";
+        return token.starts_with(prefix)
+            && token.substr(prefix.size()).starts_with(username)
+            && token.substr(prefix.size() + username.size()).starts_with('_');
     }
 
     // Marks a user as being online.
@@ -223,23 +334,64 @@ namespace
     }
 
     // Checks if a user is online.
-    bool isUserOnline(const std::string& username)
+    bool isUserOnline(const std::string_view username)
     {
         std::lock_guard lock(onlineUsersMutex);
         return onlineUsers.contains(username);
     }
 
-    // Creates a unique item instance of a random item.
-    ItemInstance generateRandomItemInstance()
+    // Whether lazy loading must keep a player in memory. Online players are never evicted, and
+    // neither is the admin, so spotting the admin never reads the disk.
+    bool isPinnedPlayer(const std::string& username)
     {
-        std::uniform_int_distribution<> dist(0, static_cast<int>(ADVENTURE_ITEMS.size()) - 1);
-        const Item& baseItem = ADVENTURE_ITEMS[dist(rng)];
+        return username == ADMIN_USERNAME || isUserOnline(username);
+    }
 
-        return ItemInstance(baseItem);
+    // Replaces the body of a large response with compression blocks. Blocks start with a byte that
+    // can't start a JSON, MessagePack or CBOR response, and their header gives their length, so
+    // clients can tell the two apart. A body too big for one block is split, and every block holding
+    // a full Compression::BLOCK_SIZE is followed by another, so the response ends with the first one
+    // that holds less, which is empty if the body fills its last block exactly. Returns the message
+    // as it is if compressing doesn't pay.
+    std::string_view compressResponse(ClientSession& session, const std::string_view message, const WireProtocol::Format format)
+    {
+        const std::size_t headerSize = format == WireProtocol::Format::Json ? 0 : WireProtocol::FRAME_HEADER_SIZE;
+        const std::string_view body = message.substr(headerSize);
+        if (body.size() < COMPRESSION_THRESHOLD) return message;
+
+        std::string& compressed = session.compressedBuffer;
+        compressed.assign(headerSize, '\0');
+        for (std::size_t blockStart = 0; ; blockStart += Compression::BLOCK_SIZE)
+        {
+            const std::string_view block = body.substr(blockStart, Compression::BLOCK_SIZE);
+            Compression::appendBlock(session.responseCodec, block, compressed, session.compressionContext);
+            if (block.size() < Compression::BLOCK_SIZE) break;
+        }
+        if (compressed.size() >= message.size()) return message;
+
+        const std::size_t blockSize = compressed.size() - headerSize;
+        for (std::size_t i = 0; i < headerSize; i++)
+        {
+            compressed[i] = static_cast<char>((blockSize >> (8 * (headerSize - 1 - i))) & 0xFF);
+        }
+
+        return compressed;
+    }
+
+    // Sends a finished response, compressed if the client asked for that.
+    void sendResponse(ClientSession& session, ResponseWriter& response)
+    {
+        std::string_view bytes = response.finish();
+        if (session.responseCodec != Compression::Codec::None)
+        {
+            bytes = compressResponse(session, bytes, response.getFormat());
+        }
+
+        send(session.clientSocket, bytes.data(), static_cast<int>(bytes.size()), 0);
     }
 
     // Communicates with the authentication server to check and deduct energy.
-    bool checkAndDeductEnergy(const std::string& username, const std::string& token)
+    bool checkAndDeductEnergy(const std::string_view username, const std::string_view token)
     {
         json request;
         request["action"] = "check_energy";
@@ -297,7 +449,7 @@ namespace
     }
 
     // Retrieves user info from the authentication server.
-    std::optional<std::string> getUserTypeFromAuthServer(const std::string& username, const std::string& token)
+    std::optional<std::string> getUserTypeFromAuthServer(const std::string_view username, const std::string_view token)
     {
         json request;
         request["action"] = "get_user_info";
@@ -339,28 +491,28 @@ namespace
     }
 
     // Handles the 'adventure' command.
-    std::string handleAdventure(const std::string& username, const std::string& token)
+    void handleAdventure(ResponseWriter& response, ClientSession& session, const std::string_view username, const std::string_view token)
     {
-        if (!validateToken(token, username))
+        if (!checkAndDeductEnergy(username, token))
         {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
+            return response.reply(false, "Insufficient energy or failed to contact authentication server");
         }
 
-        if (!checkAndDeductEnergy(username, token))
+        Player newPlayer;
+        newPlayer.username = username;
+        newPlayer.authToken = token;
+        newPlayer.balance = 0.0;
+        newPlayer.isAdmin = false;
+
+        bool isNewPlayer;
         {
-            return JsonHelper::createResponse(false, "Insufficient energy or failed to contact authentication server");
+            std::shared_lock playersLock(playersMutex);
+            isNewPlayer = !players.contains(username);
         }
 
-        auto it = players.find(username);
-        if (it == players.end())
+        // New players need their type from the auth server, which is asked before taking the lock.
+        if (isNewPlayer)
         {
-            Player newPlayer;
-            newPlayer.username = username;
-            newPlayer.authToken = token;
-            newPlayer.balance = 0.0;
-            newPlayer.isAdmin = false;
-            players[username] = newPlayer;
-
             // Get the player type from the auth server.
             if (const auto userTypeOpt = getUserTypeFromAuthServer(username, token); userTypeOpt.has_value())
             {
@@ -371,256 +523,384 @@ namespace
             {
                 newPlayer.type = PlayerType::Freemium; // Default fallback
             }
+        }
+
+        std::unique_lock playersLock(playersMutex);
 
-            it = players.find(username);
+        auto it = players.find(username);
+        if (it == players.end())
+        {
+            it = players.emplace(username, newPlayer).first;
+            playerCache.markCreated(it->first);
+            journal.recordCreatePlayer(it->second);
+            snapshotter.markDirty(it->first);
         }
 
         Player& player = it->second;
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
 
-        // 50% to get an item, 50% to earn money.
-        std::uniform_int_distribution chanceDist(1, 100);
-        const bool shouldGetItem = chanceDist(rng) <= 50;
-
-        json responseData;
+        // The loot table of the player's tier decides between an item and money.
+        const LootTable& lootTable = catalog->getLootTable(player.type);
 
-        if (shouldGetItem)
+        if (const std::optional<ItemCatalog::Index> itemIndex = lootTable.rollItem(RandomUtils::generator()); itemIndex.has_value())
         {
-            const ItemInstance itemInstance = generateRandomItemInstance();
-
-            pendingItems[username] = itemInstance;
+            const ItemInstance itemInstance(itemIndex.value());
 
-            responseData["type"] = "item";
-            responseData["item"] = JsonHelper::itemToJson(itemInstance);
-            responseData["message"] = "Use command 'store' to store this item in your inventory";
+            session.setPendingItem(itemInstance, pendingItemTimeToLive);
 
-            return JsonHelper::createResponse(true, "Adventure complete! Found item: " + itemInstance.item.name, responseData);
+            response.begin(true, {"Adventure complete! Found item: ", catalog->get(itemInstance).name}).beginData()
+                .field("type", "item")
+                .beginObject("item");
+            JsonHelper::writeItem(response, itemInstance, *catalog);
+            response.endObject()
+                .field("message", "Use command 'store' to store this item in your inventory");
+            response.end();
+            return;
         }
 
-        // Player can earn between $15 and $75.
-        std::uniform_real_distribution moneyDist(15.0f, 75.0f);
-        float money = std::round(moneyDist(rng) * 100.0f) / 100.0f;
+        const float money = lootTable.rollMoney(RandomUtils::generator());
         player.balance += money;
+        journal.recordBalance(it->first, player.balance);
+        snapshotter.markDirty(it->first);
 
-        responseData["type"] = "money";
-        responseData["amount"] = money;
-        responseData["total_balance"] = player.balance;
-
-        std::ostringstream moneyStream;
-        moneyStream << std::fixed << std::setprecision(2) << money;
+        char moneyText[32];
+        std::snprintf(moneyText, sizeof(moneyText), "%.2f", money);
 
-        return JsonHelper::createResponse(true, "Adventure complete! Found money: $" + moneyStream.str(), responseData);
+        response.begin(true, {"Adventure complete! Found money: $", moneyText}).beginData()
+            .field("type", "money")
+            .field("amount", money)
+            .field("total_balance", player.balance);
+        response.end();
     }
 
     // Handles the 'store' command.
-    std::string handleStore(const std::string& username, const std::string& token)
+    void handleStore(ResponseWriter& response, ClientSession& session, const std::string_view username)
     {
-        if (!validateToken(token, username))
+        if (!session.pendingItem.has_value())
         {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
+            return response.reply(false, "No item to store");
         }
 
-        const auto pendingIt = pendingItems.find(username);
-        if (pendingIt == pendingItems.end())
+        if (session.isPendingItemExpired())
         {
-            return JsonHelper::createResponse(false, "No item to store");
+            session.clearPendingItem();
+            return response.reply(false, "The item you found has expired. Go on another adventure");
         }
 
+        std::unique_lock playersLock(playersMutex);
+
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "You must go on an adventure first");
+            return response.reply(false, "You must go on an adventure first");
         }
 
         Player& player = playerIt->second;
-        ItemInstance itemToStore = pendingIt->second;
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
+        ItemInstance itemToStore = session.pendingItem.value();
+        const Item& item = catalog->get(itemToStore);
 
-        if (!player.canAddItem(itemToStore.item))
+        if (!player.canAddItem(*catalog, item))
         {
-            json responseData;
-            responseData["used_space"] = player.getUsedInventorySpace();
-            responseData["max_space"] = player.getMaxInventorySpace();
-            responseData["item_space"] = itemToStore.item.weight;
-            responseData["item_name"] = itemToStore.item.name;
-            responseData["item_type"] = itemToStore.item.type;
-
-            return JsonHelper::createResponse(false, "Not enough inventory space to store item", responseData);
+            response.begin(false, "Not enough inventory space to store item").beginData()
+                .field("inventory_version", player.inventoryVersion)
+                .field("used_space", player.getUsedInventorySpace(*catalog))
+                .field("max_space", player.getMaxInventorySpace())
+                .field("item_space", item.weight)
+                .field("item_name", item.name)
+                .field("item_type", item.type);
+            response.end();
+            return;
         }
 
         player.collectItem(itemToStore);
-        pendingItems.erase(pendingIt);
-
-        json responseData;
-        responseData["used_space"] = player.getUsedInventorySpace();
-        responseData["max_space"] = player.getMaxInventorySpace();
-        responseData["item_name"] = itemToStore.item.name;
-        responseData["item_type"] = itemToStore.item.type;
-        responseData["item_weight"] = itemToStore.item.weight;
-        responseData["item_value"] = itemToStore.item.value;
-
-        return JsonHelper::createResponse(true, "Item stored successfully: " + itemToStore.item.name + " [ID: " + GUIDUtils::GUIDToString(itemToStore.id) + "]", responseData);
+        journal.recordStore(playerIt->first, itemToStore);
+        snapshotter.markDirty(playerIt->first);
+        session.clearPendingItem();
+
+        char itemId[GUIDUtils::STRING_LENGTH + 1];
+        GUIDUtils::GUIDToChars(itemToStore.id, itemId);
+
+        response.begin(true, {"Item stored successfully: ", item.name, " [ID: ", itemId, "]"}).beginData()
+            .field("inventory_version", player.inventoryVersion)
+            .field("used_space", player.getUsedInventorySpace(*catalog))
+            .field("max_space", player.getMaxInventorySpace())
+            .field("item_name", item.name)
+            .field("item_type", item.type)
+            .field("item_weight", item.weight)
+            .field("item_value", item.value);
+        response.end();
     }
 
     // Handles the 'remove' command.
-    std::string handleRemove(const std::string& username, const std::string& token, const std::string& itemId)
+    void handleRemove(ResponseWriter& response, const std::string_view username, const std::string_view itemId)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::unique_lock playersLock(playersMutex);
 
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         Player& player = playerIt->second;
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
         const std::optional<ItemInstance> removedItemOptional = player.getItemFromInventory(itemId);
 
         if (!removedItemOptional.has_value())
         {
-            return JsonHelper::createResponse(false, "Item not found in inventory");
+            return response.reply(ITEM_NOT_FOUND);
         }
 
         const ItemInstance& removedItem = removedItemOptional.value();
         player.dropItem(removedItem);
-
-        json responseData;
-        responseData["removed_item"] = JsonHelper::itemToJson(removedItem);
-        responseData["used_space"] = player.getUsedInventorySpace();
-        responseData["max_space"] = player.getMaxInventorySpace();
-
-        return JsonHelper::createResponse(true, "Item removed successfully: " + removedItem.item.name, responseData);
+        journal.recordRemove(playerIt->first, removedItem);
+        snapshotter.markDirty(playerIt->first);
+
+        response.begin(true, {"Item removed successfully: ", catalog->get(removedItem).name}).beginData()
+            .beginObject("removed_item");
+        JsonHelper::writeItem(response, removedItem, *catalog);
+        response.endObject()
+            .field("inventory_version", player.inventoryVersion)
+            .field("used_space", player.getUsedInventorySpace(*catalog))
+            .field("max_space", player.getMaxInventorySpace());
+        response.end();
     }
 
     // Handles the 'sell' command.
-    std::string handleSell(const std::string& username, const std::string& token, const std::string& itemId)
+    void handleSell(ResponseWriter& response, const std::string_view username, const std::string_view itemId)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::unique_lock playersLock(playersMutex);
 
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         Player& player = playerIt->second;
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
         const std::optional<ItemInstance> soldItemOptional = player.getItemFromInventory(itemId);
 
         if (!soldItemOptional.has_value())
         {
-            return JsonHelper::createResponse(false, "Item not found in inventory");
+            return response.reply(ITEM_NOT_FOUND);
         }
 
         ItemInstance soldItem = soldItemOptional.value();
-        player.balance += soldItem.item.value;
+        const Item& item = catalog->get(soldItem);
+        player.balance += item.value;
         player.dropItem(soldItem);
+        journal.recordSell(playerIt->first, soldItem, player.balance);
+        snapshotter.markDirty(playerIt->first);
+
+        char valueText[32];
+        std::snprintf(valueText, sizeof(valueText), "%.2f", item.value);
+
+        response.begin(true, {"Item sold successfully: ", item.name, " for $", valueText}).beginData()
+            .beginObject("sold_item");
+        JsonHelper::writeItem(response, soldItem, *catalog);
+        response.endObject()
+            .field("item_value", item.value)
+            .field("new_balance", player.balance)
+            .field("inventory_version", player.inventoryVersion)
+            .field("used_space", player.getUsedInventorySpace(*catalog))
+            .field("max_space", player.getMaxInventorySpace());
+        response.end();
+    }
 
-        json responseData;
-        responseData["sold_item"] = JsonHelper::itemToJson(soldItem);
-        responseData["item_value"] = soldItem.item.value;
-        responseData["new_balance"] = player.balance;
-        responseData["used_space"] = player.getUsedInventorySpace();
-        responseData["max_space"] = player.getMaxInventorySpace();
+    // Writes the items added since a version the client has, and the IDs of those removed since,
+    // leaving out items that came and went in between.
+    void writeInventoryChanges(ResponseWriter& response, const std::span<const InventoryChange> changes, const ItemCatalog& catalog)
+    {
+        const auto isUndone = [&changes](const std::size_t index)
+        {
+            const InventoryChange& change = changes[index];
+            const auto matches = [&change](const InventoryChange& other)
+            {
+                return other.added != change.added && IsEqualGUID(other.item.id, change.item.id);
+            };
 
-        std::ostringstream stream;
-        stream << std::fixed << std::setprecision(2) << soldItem.item.value;
+            // An addition is undone by a later removal, a removal by an earlier addition.
+            return change.added
+                ? std::ranges::any_of(changes.subspan(index + 1), matches)
+                : std::ranges::any_of(changes.first(index), matches);
+        };
 
-        return JsonHelper::createResponse(true, "Item sold successfully: " + soldItem.item.name + " for $" + stream.str(), responseData);
-    }
+        response.beginArray("added");
+        for (std::size_t i = 0; i < changes.size(); i++)
+        {
+            if (!changes[i].added || isUndone(i)) continue;
 
-    // Handles the 'list_items' command.
-    std::string handleListItems(const std::string& username, const std::string& token)
-    {
-        if (!validateToken(token, username))
+            response.beginObject();
+            JsonHelper::writeItem(response, changes[i].item, catalog);
+            response.endObject();
+        }
+
+        response.endArray()
+            .beginArray("removed");
+        for (std::size_t i = 0; i < changes.size(); i++)
         {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
+            if (changes[i].added || isUndone(i)) continue;
+
+            char id[GUIDUtils::STRING_LENGTH + 1];
+            GUIDUtils::GUIDToChars(changes[i].item.id, id);
+            response.element(std::string_view(id, GUIDUtils::STRING_LENGTH));
         }
 
+        response.endArray();
+    }
+
+    // Handles the 'list_items' command. A client that sends the inventory version it already has is
+    // told the inventory is unchanged, or sent only what changed if that's still known.
+    void handleListItems(ResponseWriter& response, const std::string_view username, const std::uint64_t knownVersion)
+    {
+        std::shared_lock playersLock(playersMutex);
+
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         const Player& player = playerIt->second;
 
-        json responseData;
-        responseData["inventory"] = json::array();
+        if (knownVersion != 0 && knownVersion == player.inventoryVersion)
+        {
+            response.begin(true, "Inventory not modified").beginData()
+                .field("inventory_version", player.inventoryVersion)
+                .field("not_modified", true);
+            response.end();
+            return;
+        }
 
-        for (const auto& itemInstance : player.inventory)
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
+
+        if (knownVersion != 0)
         {
-            responseData["inventory"].push_back(JsonHelper::itemToJson(itemInstance));
+            if (const auto changes = player.getInventoryChangesSince(knownVersion); changes.has_value())
+            {
+                response.begin(true, "Inventory changes retrieved successfully").beginData()
+                    .field("inventory_version", player.inventoryVersion)
+                    .field("since_version", knownVersion);
+                writeInventoryChanges(response, changes.value(), *catalog);
+                response.field("total_items", player.inventory.size())
+                    .field("used_space", player.getUsedInventorySpace(*catalog))
+                    .field("max_space", player.getMaxInventorySpace());
+                response.end();
+                return;
+            }
         }
 
-        responseData["total_items"] = player.inventory.size();
-        responseData["used_space"] = player.getUsedInventorySpace();
-        responseData["max_space"] = player.getMaxInventorySpace();
+        response.begin(true, "Inventory retrieved successfully").beginData()
+            .field("inventory_version", player.inventoryVersion)
+            .beginArray("inventory");
+
+        for (const auto& itemInstance : player.inventory)
+        {
+            response.beginObject();
+            JsonHelper::writeItem(response, itemInstance, *catalog);
+            response.endObject();
+        }
 
-        return JsonHelper::createResponse(true, "Inventory retrieved successfully", responseData);
+        response.endArray()
+            .field("total_items", player.inventory.size())
+            .field("used_space", player.getUsedInventorySpace(*catalog))
+            .field("max_space", player.getMaxInventorySpace());
+        response.end();
     }
 
     // Handles the 'space' command.
-    std::string handleSpace(const std::string& username, const std::string& token)
+    void handleSpace(ResponseWriter& response, const std::string_view username)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::shared_lock playersLock(playersMutex);
 
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         const Player& player = playerIt->second;
+        const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
+
+        const int usedSpace = player.getUsedInventorySpace(*catalog);
+        const int maxSpace = player.getMaxInventorySpace();
 
-        json responseData;
-        responseData["used_space"] = player.getUsedInventorySpace();
-        responseData["max_space"] = player.getMaxInventorySpace();
-        responseData["available_space"] = player.getMaxInventorySpace() - player.getUsedInventorySpace();
-        responseData["player_type"] = player.type;
+        char spaceText[32];
+        std::snprintf(spaceText, sizeof(spaceText), "%d/%d", usedSpace, maxSpace);
 
-        return JsonHelper::createResponse(true, "Space: " + std::to_string(player.getUsedInventorySpace()) + "/" + std::to_string(player.getMaxInventorySpace()), responseData);
+        response.begin(true, {"Space: ", spaceText}).beginData()
+            .field("inventory_version", player.inventoryVersion)
+            .field("used_space", usedSpace)
+            .field("max_space", maxSpace)
+            .field("available_space", maxSpace - usedSpace)
+            .field("player_type", static_cast<int>(player.type));
+        response.end();
     }
 
     // Handles the 'list_users' command.
-    std::string handleListUsers(const std::string& username, const std::string& token)
+    void handleListUsers(ResponseWriter& response, ClientSession& session, const std::string_view username,
+        const std::string_view cursor, const std::uint64_t limit, const bool stream)
     {
-        if (!validateToken(token, username))
-        {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+        std::shared_lock playersLock(playersMutex);
 
         const auto playerIt = players.find(username);
         if (playerIt == players.end())
         {
-            return JsonHelper::createResponse(false, "Player not found");
+            return response.reply(PLAYER_NOT_FOUND);
         }
 
         const Player& player = playerIt->second;
 
-        json responseData;
-        responseData["users"] = json::array();
-
+        // The admin can see all registered users, including those not loaded into memory, a page at a
+        // time after the cursor. Streaming sends every following page too, each as its own message.
         if (player.isAdmin)
         {
-            // The admin can see all registered users.
-            for (const auto& playerData : players | std::views::values)
+            const std::size_t pageSize = limit == 0 ? DEFAULT_USERS_PAGE_SIZE : static_cast<std::size_t>(std::min<std::uint64_t>(limit, MAX_USERS_PAGE_SIZE));
+            std::string after(cursor);
+
+            while (true)
             {
-                json userInfo;
-                userInfo["username"] = playerData.username;
-                userInfo["is_online"] = isUserOnline(playerData.username);
-                responseData["users"].push_back(userInfo);
-            }
+                // One more is fetched to tell whether another page follows.
+                std::vector<std::string> page = playerCache.collectUsernames(after, pageSize + 1);
+                playersLock.unlock();
+
+                const bool more = page.size() > pageSize;
+                if (more) { page.pop_back(); }
+
+                response.begin(true, "All users retrieved (admin view)").beginData()
+                    .beginArray("users");
+
+                {
+                    std::lock_guard lock(onlineUsersMutex);
+                    for (const std::string& registeredUsername : page)
+                    {
+                        response.beginObject()
+                            .field("username", registeredUsername)
+                            .field("is_online", onlineUsers.contains(registeredUsername))
+                            .endObject();
+                    }
+                }
+
+                response.endArray()
+                    .field("more", more);
+                if (more) { response.field("next_cursor", page.back()); }
+                response.end();
+
+                if (!stream || !more) return;
+
+                sendResponse(session, response);
+                response.restart();
 
-            return JsonHelper::createResponse(true, "All users retrieved (admin view)", responseData);
+                after = page.back();
+                playersLock.lock();
+            }
         }
 
+        response.begin(true, "Online users retrieved").beginData()
+            .beginArray("users");
+
         // Regular users can only see currently online users.
         std::lock_guard lock(onlineUsersMutex);
 
@@ -628,44 +908,48 @@ namespace
         {
             if (players.contains(onlineUsername))
             {
-                json userInfo;
-                userInfo["username"] = onlineUsername;
-                responseData["users"].push_back(userInfo);
+                response.beginObject()
+                    .field("username", onlineUsername)
+                    .endObject();
             }
         }
 
-        return JsonHelper::createResponse(true, "Online users retrieved", responseData);
+        response.end();
     }
 
     // Handles the 'modify_type' command.
-    std::string handleModifyType(const std::string& username, const std::string& token, const std::string& targetUser, const std::string& newType)
+    void handleModifyType(ResponseWriter& response, const std::string_view username, const std::string_view token, const std::string_view targetUser, const std::string_view newType)
     {
-        if (!validateToken(token, username))
         {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+            std::shared_lock playersLock(playersMutex);
 
-        const auto adminIt = players.find(username);
-        if (adminIt == players.end())
-        {
-            return JsonHelper::createResponse(false, "Player not found");
-        }
+            const auto adminIt = players.find(username);
+            if (adminIt == players.end())
+            {
+                return response.reply(PLAYER_NOT_FOUND);
+            }
 
-        if (!adminIt->second.isAdmin)
-        {
-            return JsonHelper::createResponse(false, "Insufficient permissions. Admin access required");
+            if (!adminIt->second.isAdmin)
+            {
+                return response.reply(NOT_ADMIN);
+            }
         }
 
-        const auto targetIt = players.find(targetUser);
-        if (targetIt == players.end())
+        // Only an admin's request may read the target in.
+        playerCache.ensureLoaded(targetUser);
+
         {
-            return JsonHelper::createResponse(false, "Target user not found");
+            std::shared_lock playersLock(playersMutex);
+            if (!players.contains(targetUser))
+            {
+                return response.reply(TARGET_NOT_FOUND);
+            }
         }
 
         const std::optional<PlayerType> newPlayerTypeOpt = stringToPlayerType(newType);
         if (!newPlayerTypeOpt.has_value())
         {
-            return JsonHelper::createResponse(false, "Invalid player type. Valid types: Freemium, Bronze, Silver, Gold, Platinum");
+            return response.reply(false, "Invalid player type. Valid types: Freemium, Bronze, Silver, Gold, Platinum");
         }
 
         PlayerType newPlayerType = newPlayerTypeOpt.value();
@@ -700,58 +984,77 @@ namespace
                 if (!modifyTypeSuccessful)
                 {
                     const std::string authMessage = responseJson.value("message", "Unknown error from auth server");
-                    return JsonHelper::createResponse(false, "Failed to modify type of user from auth server: " + authMessage);
+                    return response.reply(false, {"Failed to modify type of user from auth server: ", authMessage});
                 }
             }
             catch (const json::parse_error& e)
             {
                 std::cout << "Failed to parse auth server response: " << e.what() << std::endl;
-                return JsonHelper::createResponse(false, "Failed to parse auth server response");
+                return response.reply(false, "Failed to parse auth server response");
             }
         }
         else
         {
-            return JsonHelper::createResponse(false, "Failed to communicate with authentication server");
+            return response.reply(false, "Failed to communicate with authentication server");
         }
 
-        targetIt->second.type = newPlayerType;
+        // The calls below keep the name, so it's copied once. Admin commands are rare.
+        const std::string target(targetUser);
+
+        std::unique_lock playersLock(playersMutex);
+        playerCache.ensureLoadedLocked(target);
+
+        // The target may have been removed while waiting for the auth server.
+        const auto targetIt = players.find(targetUser);
+        if (targetIt == players.end())
+        {
+            return response.reply(TARGET_NOT_FOUND);
+        }
 
-        json responseData;
-        responseData["target_user"] = targetUser;
-        responseData["new_type"] = playerTypeToString(newPlayerType);
+        targetIt->second.type = newPlayerType;
+        journal.recordTypeChange(target, newPlayerType);
+        snapshotter.markDirty(target);
 
         std::cout << "User " << targetUser << "'s type changed to " << newType << std::endl;
-        return JsonHelper::createResponse(true, "User type modified successfully on both servers: " + targetUser + " -> " + newType, responseData);
+
+        response.begin(true, {"User type modified successfully on both servers: ", targetUser, " -> ", newType}).beginData()
+            .field("target_user", targetUser)
+            .field("new_type", playerTypeToString(newPlayerType));
+        response.end();
     }
 
     // Handles the 'remove_user' command.
-    std::string handleRemoveUser(const std::string& username, const std::string& token, const std::string& targetUser)
+    void handleRemoveUser(ResponseWriter& response, const std::string_view username, const std::string_view token, const std::string_view targetUser)
     {
-        if (!validateToken(token, username))
         {
-            return JsonHelper::createResponse(false, "Invalid authentication token");
-        }
+            std::shared_lock playersLock(playersMutex);
 
-        const auto adminIt = players.find(username);
-        if (adminIt == players.end())
-        {
-            return JsonHelper::createResponse(false, "Player not found");
-        }
+            const auto adminIt = players.find(username);
+            if (adminIt == players.end())
+            {
+                return response.reply(PLAYER_NOT_FOUND);
+            }
 
-        if (!adminIt->second.isAdmin)
-        {
-            return JsonHelper::createResponse(false, "Insufficient permissions. Admin access required");
+            if (!adminIt->second.isAdmin)
+            {
+                return response.reply(NOT_ADMIN);
+            }
         }
 
         if (targetUser == username)
         {
-            return JsonHelper::createResponse(false, "You may not remove yourself");
+            return response.reply(false, "You may not remove yourself");
         }
 
-        const auto targetIt = players.find(targetUser);
-        if (targetIt == players.end())
+        // Only an admin's request may read the target in.
+        playerCache.ensureLoaded(targetUser);
+
         {
-            return JsonHelper::createResponse(false, "Target user not found");
+            std::shared_lock playersLock(playersMutex);
+            if (!players.contains(targetUser))
+            {
+                return response.reply(TARGET_NOT_FOUND);
+            }
         }
 
         // First, tries to remove the user from the authentication server.
@@ -783,179 +1086,314 @@ namespace
                 if (!authRemovalSuccessful)
                 {
                     const std::string authMessage = responseJson.value("message", "Unknown error from auth server");
-                    return JsonHelper::createResponse(false, "Failed to remove user from auth server: " + authMessage);
+                    return response.reply(false, {"Failed to remove user from auth server: ", authMessage});
                 }
             }
             catch (const json::parse_error& e)
             {
                 std::cout << "Failed to parse auth server response: " << e.what() << std::endl;
-                return JsonHelper::createResponse(false, "Failed to parse auth server response");
+                return response.reply(false, "Failed to parse auth server response");
             }
         }
         else
         {
-            return JsonHelper::createResponse(false, "Failed to communicate with authentication server");
+            return response.reply(false, "Failed to communicate with authentication server");
         }
 
-        markUserOffline(targetUser);
-        players.erase(targetIt);
+        // The calls below keep the name, so it's copied once. Admin commands are rare.
+        const std::string target(targetUser);
+
+        std::unique_lock playersLock(playersMutex);
+        playerCache.ensureLoadedLocked(target);
+
+        // The target may have been removed while waiting for the auth server.
+        const auto targetIt = players.find(targetUser);
+        if (targetIt == players.end())
+        {
+            return response.reply(TARGET_NOT_FOUND);
+        }
 
-        json responseData;
-        responseData["removed_user"] = targetUser;
-        responseData["remaining_users"] = players.size();
+        markUserOffline(target);
+        players.erase(targetIt);
+        playerCache.markRemoved(target);
+        journal.recordRemovePlayer(target);
+        snapshotter.markDirty(target);
 
         std::cout << "User " << targetUser << " removed from both auth server and game server by " << username << std::endl;
-        return JsonHelper::createResponse(true, "User removed successfully from both servers: " + targetUser, responseData);
+
+        response.begin(true, {"User removed successfully from both servers: ", targetUser}).beginData()
+            .field("removed_user", targetUser)
+            .field("remaining_users", playerCache.countPlayers());
+        response.end();
+    }
+
+    // Handles the 'reload_items' command.
+    void handleReloadItems(ResponseWriter& response, const std::string_view username)
+    {
+        {
+            std::shared_lock playersLock(playersMutex);
+
+            const auto adminIt = players.find(username);
+            if (adminIt == players.end())
+            {
+                return response.reply(PLAYER_NOT_FOUND);
+            }
+
+            if (!adminIt->second.isAdmin)
+            {
+                return response.reply(NOT_ADMIN);
+            }
+        }
+
+        const StatusResponse status = ItemCatalog::loadFromFile(ITEMS_FILE, DEFAULT_ADVENTURE_ITEMS);
+        if (!status.success)
+        {
+            return response.reply(false, {"Failed to reload the item catalog: ", status.message});
+        }
+
+        std::cout << "Item catalog reloaded by " << username << ": " << status.message << std::endl;
+
+        response.begin(true, status.message).beginData()
+            .field("catalog_size", ItemCatalog::current()->size());
+        response.end();
+    }
+
+    // What handleClient needs to know to run an action.
+    struct Action
+    {
+        std::string_view name;
+        void (*handler)(ResponseWriter& response, ClientSession& session, const JsonMessage& msg);
+
+        // Why admins may not use the action, or null if they may.
+        const CannedResponse* adminRefusal;
+
+        // Whether the request's token has to be valid for its username.
+        bool needsAuth;
+    };
+
+    // Adding an action only takes an entry here.
+    constexpr ActionTable ACTIONS(std::array<Action, 10>{{
+        {"adventure", [](ResponseWriter& response, ClientSession& session, const JsonMessage& msg)
+            { handleAdventure(response, session, msg.username, msg.authToken); }, &NO_ADVENTURES, true},
+        {"store", [](ResponseWriter& response, ClientSession& session, const JsonMessage& msg)
+            { handleStore(response, session, msg.username); }, &NO_INVENTORY, true},
+        {"remove", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleRemove(response, msg.username, msg.itemId); }, &NO_INVENTORY, true},
+        {"sell", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleSell(response, msg.username, msg.itemId); }, &NO_INVENTORY, true},
+        {"list_items", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleListItems(response, msg.username, msg.knownVersion); }, &NO_INVENTORY, true},
+        {"space", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleSpace(response, msg.username); }, &NO_INVENTORY, true},
+        {"list_users", [](ResponseWriter& response, ClientSession& session, const JsonMessage& msg)
+            { handleListUsers(response, session, msg.username, msg.cursor, msg.limit, msg.stream); }, nullptr, true},
+        {"modify_type", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleModifyType(response, msg.username, msg.authToken, msg.targetUser, msg.newType); }, nullptr, true},
+        {"remove_user", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleRemoveUser(response, msg.username, msg.authToken, msg.targetUser); }, nullptr, true},
+        {"reload_items", [](ResponseWriter& response, ClientSession&, const JsonMessage& msg)
+            { handleReloadItems(response, msg.username); }, nullptr, true}
+    }});
+
+    // Runs one action for an approved session. The token is checked unless the caller already has.
+    void runAction(ResponseWriter& response, ClientSession& session, const JsonMessage& msg, const bool tokenChecked = false)
+    {
+        const Action* action = ACTIONS.find(msg.action);
+        if (action == nullptr)
+        {
+            return response.reply(false, {"Unknown action: ", msg.action});
+        }
+
+        if (action->adminRefusal != nullptr && session.username == ADMIN_USERNAME)
+        {
+            return response.reply(*action->adminRefusal);
+        }
+
+        if (action->needsAuth && !tokenChecked && !validateToken(msg.authToken, msg.username))
+        {
+            return response.reply(INVALID_TOKEN);
+        }
+
+        action->handler(response, session, msg);
+    }
+
+    // Handles the 'batch' command. Its steps run in order as the batch's user, with the token checked
+    // once, and their responses are sent back together in one.
+    void handleBatch(ResponseWriter& response, ClientSession& session, const JsonMessage& msg)
+    {
+        if (msg.actions.size() > MAX_BATCH_ACTIONS)
+        {
+            return response.reply(false, "Too many actions in the batch");
+        }
+
+        if (!validateToken(msg.authToken, msg.username))
+        {
+            return response.reply(INVALID_TOKEN);
+        }
+
+        response.begin(true, "Batch completed").beginData()
+            .beginArray("results");
+
+        for (const JsonMessage& step : msg.actions)
+        {
+            // Streamed pages would go out ahead of the batch's reply, so steps never stream.
+            JsonMessage stepMessage = step;
+            stepMessage.username = msg.username;
+            stepMessage.authToken = msg.authToken;
+            stepMessage.stream = false;
+
+            runAction(response, session, stepMessage, true);
+        }
+
+        response.end();
+    }
+
+    // Reloads the item catalog whenever its file changes on disk.
+    void watchItemCatalogFile()
+    {
+        std::error_code error;
+        auto lastWriteTime = std::filesystem::last_write_time(ITEMS_FILE, error);
+
+        while (serverRunning)
+        {
+            std::this_thread::sleep_for(ITEMS_FILE_POLL_INTERVAL);
+
+            const auto writeTime = std::filesystem::last_write_time(ITEMS_FILE, error);
+            if (error || writeTime == lastWriteTime) continue;
+
+            lastWriteTime = writeTime;
+
+            const StatusResponse status = ItemCatalog::loadFromFile(ITEMS_FILE, DEFAULT_ADVENTURE_ITEMS);
+            std::cout << (status.success ? "Item catalog reloaded: " : "Item catalog reload failed: ") << status.message << std::endl;
+        }
     }
 
     // Handles client connections.
     void handleClient(const SOCKET clientSocket, const int clientId)
     {
         std::cout << "Client " << clientId << " connected!" << std::endl;
+        RandomUtils::seedThread(clientId);
 
         char buffer[1024];
-        std::string messageBuffer;
-        std::string connectedUsername;
-        bool connectionApproved = false;
+        std::string completeMessage; // Requests are parsed in place here, so it must outlive the parsed message.
+        ClientSession session(clientId, clientSocket);
+        bool rejected = false;
 
         while (serverRunning)
         {
-            if (const int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0); bytesReceived > 0)
+            if (const int bytesReceived = recv(clientSocket, buffer, sizeof(buffer), 0); bytesReceived > 0)
             {
-                buffer[bytesReceived] = '\0';
-                messageBuffer += std::string(buffer);
+                // Binary messages can hold zero bytes, so the exact length is appended.
+                session.messageBuffer.append(buffer, bytesReceived);
 
-                // Looks for the complete JSON message.
-                if (const size_t pos = messageBuffer.find('}'); pos != std::string::npos)
+                // Handles every complete message received so far before waiting for more.
+                WireProtocol::FrameResult frame;
+                while ((frame = WireProtocol::takeMessage(session.messageBuffer, session.protocol, completeMessage, session.messageScan)) == WireProtocol::FrameResult::Complete)
                 {
-                    std::string completeMessage = messageBuffer.substr(0, pos + 1);
-                    messageBuffer = messageBuffer.substr(pos + 1);
-
-                    std::cout << "Client " << clientId << " sent: " << completeMessage << std::endl;
+                    if (session.protocol == WireProtocol::Format::Json)
+                    {
+                        std::cout << "Client " << clientId << " sent: " << completeMessage << std::endl;
+                    }
+                    else
+                    {
+                        std::cout << "Client " << clientId << " sent a " << completeMessage.size() << " byte "
+                                  << WireProtocol::formatName(session.protocol) << " message" << std::endl;
+                    }
 
                     // Parses messages sent by the user.
-                    JsonMessage msg = JsonHelper::parseMessage(completeMessage);
-                    std::string response;
+                    JsonMessage msg = JsonHelper::parseMessage(completeMessage, session.protocol);
+                    ResponseWriter response(session.responseBuffer, session.protocol);
+
+                    // Switching protocol needs no authentication. The reply still goes out in the old format.
+                    if (msg.action == "set_protocol")
+                    {
+                        const std::optional<WireProtocol::Format> protocol = WireProtocol::parseFormat(msg.protocol);
+                        if (protocol.has_value()) { response.reply(true, {"Switched to ", msg.protocol}); }
+                        else { response.reply(false, {"Unknown protocol: ", msg.protocol}); }
+
+                        sendResponse(session, response);
+                        if (protocol.has_value()) { session.protocol = protocol.value(); }
+                        continue;
+                    }
+
+                    // Compression is negotiated the same way, and applies to the responses after this one.
+                    if (msg.action == "set_compression")
+                    {
+                        const std::optional<Compression::Codec> codec = Compression::parseCodec(std::string(msg.compression));
+                        if (codec.has_value()) { response.reply(true, {"Compressing responses with ", Compression::codecName(codec.value())}); }
+                        else { response.reply(false, {"Unknown or unavailable compression: ", msg.compression}); }
 
-                    if (players.contains(msg.username) && players[msg.username].isAdmin)
+                        sendResponse(session, response);
+                        if (codec.has_value()) { session.responseCodec = codec.value(); }
+                        continue;
+                    }
+
+                    // The admin is always in memory, so this never reads the disk.
+                    if (isAdminPlayer(msg.username))
                     {
                         // Admins bypass the server availability check.
-                        connectionApproved = true;
-                        connectedUsername = msg.username;
-                        markUserOnline(connectedUsername);
+                        session.connectionApproved = true;
+                        session.username = msg.username;
+                        markUserOnline(session.username);
                         incrementConnections();
                         std::cout << "Connection approved for " << msg.username << std::endl;
                     }
-                    else if (!connectionApproved && !msg.username.empty() && validateToken(msg.authToken, msg.username))
+                    else if (!session.connectionApproved && !msg.username.empty() && validateToken(msg.authToken, msg.username))
                     {
                         if (!canUserConnect(msg.username, msg.authToken)) // Admin can always connect.
                         {
-                            response = JsonHelper::createResponse(false, "Server is at capacity for your user type. Please try again later");
-                            send(clientSocket, response.c_str(), static_cast<int>(response.length()), 0);
+                            response.reply(AT_CAPACITY);
+                            sendResponse(session, response);
                             std::cout << "Connection rejected for " << msg.username << " - server at capacity" << std::endl;
+                            rejected = true;
                             break;
                         }
 
                         // Connection was approved! :D
-                        connectionApproved = true;
-                        connectedUsername = msg.username;
-                        markUserOnline(connectedUsername);
+                        session.connectionApproved = true;
+                        session.username = msg.username;
+                        markUserOnline(session.username);
                         incrementConnections();
                         std::cout << "Connection approved for " << msg.username << std::endl;
                     }
 
-                    if (!connectionApproved)
+                    // With lazy loading, the player is read back from disk the first time they're needed,
+                    // but only for requests that could act for them.
+                    if (session.connectionApproved && validateToken(msg.authToken, msg.username))
                     {
-                        response = JsonHelper::createResponse(false, "Please authenticate first");
+                        playerCache.ensureLoaded(msg.username);
+                    }
+
+                    if (!session.connectionApproved)
+                    {
+                        response.reply(AUTHENTICATE_FIRST);
+                    }
+                    else if (msg.action == "batch")
+                    {
+                        handleBatch(response, session, msg);
                     }
                     else
                     {
-                        if (msg.action == "adventure")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts cannot go on adventures");
-                            }
-                            else
-                            {
-                                response = handleAdventure(msg.username, msg.authToken);
-                            }
-                        }
-                        else if (msg.action == "store")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts have no inventory");
-                            }
-                            else
-                            {
-                                response = handleStore(msg.username, msg.authToken);
-                            }
-                        }
-                        else if (msg.action == "remove")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts have no inventory");
-                            }
-                            else
-                            {
-                                response = handleRemove(msg.username, msg.authToken, msg.itemId);
-                            }
-                        }
-                        else if (msg.action == "sell")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts have no inventory");
-                            }
-                            else
-                            {
-                                response = handleSell(msg.username, msg.authToken, msg.itemId);
-                            }
-                        }
-                        else if (msg.action == "list_items")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts have no inventory");
-                            }
-                            else
-                            {
-                                response = handleListItems(msg.username, msg.authToken);
-                            }
-                        }
-                        else if (msg.action == "space")
-                        {
-                            if (connectedUsername == "admin")
-                            {
-                                response = JsonHelper::createResponse(false, "Admin accounts have no inventory");
-                            }
-                            else
-                            {
-                                response = handleSpace(msg.username, msg.authToken);
-                            }
-                        }
-                        else if (msg.action == "list_users")
-                        {
-                            response = handleListUsers(msg.username, msg.authToken);
-                        }
-                        else if (msg.action == "modify_type")
-                        {
-                            response = handleModifyType(msg.username, msg.authToken, msg.targetUser, msg.newType);
-                        }
-                        else if (msg.action == "remove_user")
-                        {
-                            response = handleRemoveUser(msg.username, msg.authToken, msg.targetUser);
-                        }
-                        else
-                        {
-                            response = JsonHelper::createResponse(false, "Unknown action: " + msg.action);
-                        }
+                        runAction(response, session, msg);
+                    }
+
+                    // Changes are only acknowledged once they're safely in the journal.
+                    if (!journal.waitUntilDurable())
+                    {
+                        response.restart();
+                        response.reply(NOT_SAVED);
                     }
 
                     // Sends the response back.
-                    send(clientSocket, response.c_str(), static_cast<int>(response.length()), 0);
+                    sendResponse(session, response);
+                }
+
+                if (rejected) break;
+
+                if (frame == WireProtocol::FrameResult::TooLarge)
+                {
+                    std::cout << "Client " << clientId << " sent a message too large to accept" << std::endl;
+                    break;
                 }
             }
             else if (bytesReceived == 0)
@@ -990,14 +1428,14 @@ namespace
             }
         }
 
-        if (connectionApproved)
+        if (session.connectionApproved)
         {
             decrementConnections();
         }
 
-        if (!connectedUsername.empty())
+        if (!session.username.empty())
         {
-            markUserOffline(connectedUsername);
+            markUserOffline(session.username);
         }
 
         closesocket(clientSocket);
@@ -1014,6 +1452,114 @@ int main(int argc, char* argv[])
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
+    // Seeds the random rolls. Starting again with the same --seed replays the same rolls per client.
+    std::uint64_t rootSeed = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (const std::optional<std::string> seedOption = CommandLineUtils::getOption(argc, argv, "seed"); seedOption.has_value())
+    {
+        try
+        {
+            rootSeed = std::stoull(seedOption.value());
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid seed '" << seedOption.value() << "', using a random one" << std::endl;
+        }
+    }
+
+    RandomUtils::setRootSeed(rootSeed);
+    std::cout << "Random seed: " << rootSeed << std::endl;
+
+    if (const std::optional<std::string> intervalOption = CommandLineUtils::getOption(argc, argv, "snapshot-interval"); intervalOption.has_value())
+    {
+        try
+        {
+            snapshotInterval = std::chrono::seconds(std::max(1LL, std::stoll(intervalOption.value())));
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid snapshot interval '" << intervalOption.value() << "', using the default" << std::endl;
+        }
+    }
+
+    if (const std::optional<std::string> expiryOption = CommandLineUtils::getOption(argc, argv, "pending-item-ttl"); expiryOption.has_value())
+    {
+        try
+        {
+            pendingItemTimeToLive = std::chrono::seconds(std::stoll(expiryOption.value()));
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid pending item time to live '" << expiryOption.value() << "', using the default" << std::endl;
+        }
+    }
+
+    jsonExportFilename = CommandLineUtils::getOption(argc, argv, "export-json");
+
+    // Keeps only the active players in memory, evicting them after this many seconds idle.
+    if (const std::optional<std::string> lazyOption = CommandLineUtils::getOption(argc, argv, "lazy-load"); lazyOption.has_value())
+    {
+        try
+        {
+            playerIdleTime = std::chrono::seconds(std::max(1LL, std::stoll(lazyOption.value())));
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid lazy loading idle time '" << lazyOption.value() << "', loading every player" << std::endl;
+        }
+    }
+
+    // How many threads decode the game data on startup.
+    unsigned int loadThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (const std::optional<std::string> threadsOption = CommandLineUtils::getOption(argc, argv, "load-threads"); threadsOption.has_value())
+    {
+        try
+        {
+            loadThreads = static_cast<unsigned int>(std::max(1UL, std::stoul(threadsOption.value())));
+        }
+        catch (const std::exception&)
+        {
+            std::cout << "Invalid load thread count '" << threadsOption.value() << "', using " << loadThreads << std::endl;
+        }
+    }
+
+    // Compresses the snapshot, the journal and the JSON export: "none", "builtin", "lz4", "zstd" or "auto".
+    // Files are read back whichever codec wrote them.
+    if (const std::optional<std::string> compressionOption = CommandLineUtils::getOption(argc, argv, "compression"); compressionOption.has_value())
+    {
+        if (const std::optional<Compression::Codec> codec = Compression::parseCodec(compressionOption.value()); codec.has_value())
+        {
+            fileCodec = codec.value();
+        }
+        else
+        {
+            std::cout << "Unknown or unavailable compression '" << compressionOption.value() << "', leaving files uncompressed" << std::endl;
+        }
+    }
+
+    journal.setCompression(fileCodec);
+    snapshotter.setCompression(fileCodec);
+
+    // Saves the players to a key-value store instead of the binary snapshot: "lsm" for the log-structured
+    // store, "json" for the JSON file.
+    std::string playerStorePath;
+    if (const std::optional<std::string> storageOption = CommandLineUtils::getOption(argc, argv, "storage"); storageOption.has_value())
+    {
+        if (storageOption.value() == "lsm")
+        {
+            playerStore = std::make_unique<LogStructuredStore>(GAME_STORE_DIRECTORY);
+            playerStorePath = GAME_STORE_DIRECTORY;
+        }
+        else if (storageOption.value() == "json")
+        {
+            playerStore = std::make_unique<JsonFileStore>(GAME_DATA_FILE);
+            playerStorePath = GAME_DATA_FILE;
+        }
+        else
+        {
+            std::cout << "Unknown storage '" << storageOption.value() << "', using the binary snapshot" << std::endl;
+        }
+    }
+
     // Initialises Winsock (version 2.2).
     WSADATA wsaData;
     if (const int result = WSAStartup(MAKEWORD(2, 2), &wsaData); result != 0)
@@ -1039,13 +1585,153 @@ int main(int argc, char* argv[])
         ExitProcess(EXIT_FAILURE);
     }
 
-    // Loads the game data.
-    std::cout << "Loading game data..." << std::endl;
-    const StatusResponse status = JsonHelper::loadGameDataFromFile(GAME_DATA_FILE, players);
-    std::cout << status.message << "\n" << std::endl;
+    // Times each startup phase, so a slow start can be traced to the phase responsible.
+    auto phaseStartTime = std::chrono::steady_clock::now();
+    const auto logPhase = [&phaseStartTime](const std::string& phase)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - phaseStartTime).count();
+        std::cout << "Startup phase '" << phase << "' took " << elapsedMs << " ms" << std::endl;
+        phaseStartTime = now;
+    };
+
+    // Loads the item definitions before any inventory references them.
+    std::cout << "Loading item catalog..." << std::endl;
+    if (const StatusResponse catalogStatus = ItemCatalog::loadFromFile(ITEMS_FILE, DEFAULT_ADVENTURE_ITEMS); !catalogStatus.success)
+    {
+        std::cout << catalogStatus.message << std::endl;
+        authClient.disconnect();
+        WSACleanup();
+        ExitProcess(EXIT_FAILURE);
+    }
+    else
+    {
+        std::cout << catalogStatus.message << std::endl;
+    }
+
+    logPhase("item catalog");
+
+    // Loads the game data from the key-value store, if one is used and already exists.
+    bool storeLoaded = false;
+    if (playerStore != nullptr)
+    {
+        std::cout << "Opening the " << playerStore->describe() << "..." << std::endl;
+        const bool storeExisted = std::filesystem::exists(playerStorePath);
+
+        const StatusResponse storeStatus = playerStore->open();
+        std::cout << storeStatus.message << std::endl;
+        if (!storeStatus.success)
+        {
+            authClient.disconnect();
+            WSACleanup();
+            ExitProcess(EXIT_FAILURE);
+        }
+
+        snapshotter.useStore(*playerStore);
+        storeLoaded = storeExisted;
+
+        if (storeLoaded && playerIdleTime.has_value())
+        {
+            const StatusResponse lazyStatus = playerCache.enable(*playerStore, playerIdleTime.value(), isPinnedPlayer);
+            std::cout << lazyStatus.message << std::endl;
+        }
+        else if (storeLoaded)
+        {
+            playerStore->scan([](const std::string& username, const std::string& value)
+            {
+                try
+                {
+                    players.emplace(username, JsonHelper::jsonToPlayer(json::parse(value)));
+                }
+                catch (const std::exception& exception)
+                {
+                    std::cout << "Skipping the unreadable player '" << username << "': " << exception.what() << std::endl;
+                }
+            });
+            std::cout << "Loaded " << players.size() << " players from the store" << std::endl;
+        }
+        else
+        {
+            // The first snapshot copies everyone loaded below into the new store.
+            std::cout << "The store is new, so the existing game data is imported into it" << std::endl;
+        }
+
+        logPhase("open store");
+    }
+
+    // Loads the game data from the binary snapshot, or imports the JSON file if there isn't one yet.
+    if (!storeLoaded)
+    {
+        std::cout << "Loading game data..." << std::endl;
+
+        PlayerSnapshotFile snapshotFile;
+        const StatusResponse mapStatus = snapshotFile.open(GAME_SNAPSHOT_FILE);
+        std::cout << mapStatus.message << std::endl;
+        logPhase("map snapshot");
+
+        if (mapStatus.success && playerIdleTime.has_value() && playerStore == nullptr)
+        {
+            // Players stay on disk until they're needed. Online players and the admin are never evicted.
+            const StatusResponse lazyStatus = playerCache.enable(GAME_SNAPSHOT_FILE, playerIdleTime.value(), isPinnedPlayer);
+            std::cout << lazyStatus.message << std::endl;
+        }
+        else if (playerIdleTime.has_value())
+        {
+            std::cout << "Lazy loading needs a binary snapshot or an existing store, so every player is loaded this time" << std::endl;
+        }
+
+        if (!playerCache.isEnabled())
+        {
+            const StatusResponse status = mapStatus.success
+                ? snapshotFile.loadAll(players, loadThreads)
+                : JsonHelper::loadGameDataFromFile(GAME_DATA_FILE, players);
+            std::cout << status.message << std::endl;
+            logPhase(mapStatus.success ? "load snapshot" : "import JSON");
+        }
+    }
+
+    // Recovers the changes made after the last snapshot. A checkpoint is only left behind if a snapshot failed.
+    // With lazy loading, the players in the journal are loaded before their records are applied.
+    std::set<std::string> journalPlayers;
+    const auto loadJournalPlayer = [&journalPlayers](const std::string& username)
+    {
+        if (journalPlayers.insert(username).second) { playerCache.ensureLoadedLocked(username); }
+    };
+
+    const StatusResponse checkpointStatus = GameJournal::replay(JOURNAL_CHECKPOINT_FILE, players, loadJournalPlayer);
+    std::cout << checkpointStatus.message << std::endl;
+
+    const StatusResponse replayStatus = GameJournal::replay(JOURNAL_FILE, players, loadJournalPlayer);
+    std::cout << replayStatus.message << std::endl;
+
+    // Players the journal removed are still in the snapshot file until the next snapshot drops them.
+    if (playerCache.isEnabled())
+    {
+        for (const std::string& username : journalPlayers)
+        {
+            if (!players.contains(username))
+            {
+                playerCache.markRemoved(username);
+                snapshotter.markDirty(username);
+            }
+        }
+    }
+
+    logPhase("journal replay");
+
+    const StatusResponse journalStatus = journal.open(JOURNAL_FILE);
+    std::cout << journalStatus.message << "\n" << std::endl;
 
     ensureAdminPlayerExists();
 
+    // The first snapshot serialises everyone, later ones only the players that changed. A store that
+    // was loaded already holds everyone.
+    if (!storeLoaded) { snapshotter.markAllDirty(); }
+    snapshotter.start(snapshotInterval);
+
+    // Picks up edits to the item catalog without a restart.
+    std::thread(watchItemCatalogFile).detach();
+
     // Creates a socket with the TCP protocol for listening.
     listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (listenSocket == INVALID_SOCKET)
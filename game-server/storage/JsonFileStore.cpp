@@ -0,0 +1,130 @@
+﻿#include "JsonFileStore.h"
+
+#include <fstream>
+#include <ranges>
+
+#include "../utilities/AtomicFileWriter.h"
+#include "../utilities/JsonArrayReader.h"
+
+JsonFileStore::JsonFileStore(std::string filename) : filename(std::move(filename))
+{
+}
+
+StatusResponse JsonFileStore::open()
+{
+    std::lock_guard lock(storeMutex);
+    records.clear();
+    changed = false;
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        return { true, "No " + filename + " yet, starting an empty store" };
+    }
+
+    JsonArrayReader reader([this](const json& record)
+    {
+        if (record.is_object() && record.contains("username") && record["username"].is_string())
+        {
+            records.insert_or_assign(record["username"].get<std::string>(), record.dump());
+        }
+    });
+
+    if (!reader.read(file))
+    {
+        records.clear();
+        return { false, "Error parsing " + filename + ": " + reader.getError() };
+    }
+
+    return { true, "Loaded " + std::to_string(records.size()) + " records from " + filename };
+}
+
+void JsonFileStore::close()
+{
+    flush();
+}
+
+std::optional<std::string> JsonFileStore::get(const std::string& key)
+{
+    std::lock_guard lock(storeMutex);
+
+    const auto recordIt = records.find(key);
+    if (recordIt == records.end()) return std::nullopt;
+    return recordIt->second;
+}
+
+StatusResponse JsonFileStore::put(const std::string& key, const std::string& value)
+{
+    std::lock_guard lock(storeMutex);
+    records.insert_or_assign(key, value);
+    changed = true;
+    return { true, "" };
+}
+
+StatusResponse JsonFileStore::remove(const std::string& key)
+{
+    std::lock_guard lock(storeMutex);
+    changed = records.erase(key) > 0 || changed;
+    return { true, "" };
+}
+
+StatusResponse JsonFileStore::scan(const Visitor& visit)
+{
+    std::lock_guard lock(storeMutex);
+
+    for (const auto& [key, value] : records)
+    {
+        visit(key, value);
+    }
+
+    return { true, "" };
+}
+
+StatusResponse JsonFileStore::scanKeys(const std::string_view after, const std::size_t limit, const KeyVisitor& visit)
+{
+    std::lock_guard lock(storeMutex);
+
+    std::size_t visited = 0;
+    for (auto recordIt = records.upper_bound(after); recordIt != records.end() && visited < limit; ++recordIt, ++visited)
+    {
+        visit(recordIt->first);
+    }
+
+    return { true, "" };
+}
+
+StatusResponse JsonFileStore::flush()
+{
+    std::lock_guard lock(storeMutex);
+    if (!changed) return { true, "" };
+
+    // A failed write never replaces the last good file.
+    AtomicFileWriter file(filename);
+    if (!file.open())
+    {
+        return { false, "Could not create a temporary file for " + filename };
+    }
+
+    file.write("[");
+    bool first = true;
+    for (const std::string& value : records | std::views::values)
+    {
+        file.write(first ? "\n" : ",\n");
+        file.write(value);
+        first = false;
+    }
+    file.write(first ? "]" : "\n]");
+
+    if (const StatusResponse status = file.commit(); !status.success)
+    {
+        return status;
+    }
+
+    changed = false;
+    return { true, "" };
+}
+
+std::string JsonFileStore::describe() const
+{
+    return "JSON file " + filename;
+}
@@ -0,0 +1,44 @@
+﻿#ifndef KEYVALUESTORE_H
+#define KEYVALUESTORE_H
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "../structs/StatusResponse.h"
+
+// A persistent store of records keyed by username. Values are serialised records the store doesn't look into.
+class KeyValueStore
+{
+public:
+
+    using Visitor = std::function<void(const std::string& key, const std::string& value)>;
+    using KeyVisitor = std::function<void(const std::string& key)>;
+
+    virtual ~KeyValueStore() = default;
+
+    // Loads or creates the store.
+    virtual StatusResponse open() = 0;
+
+    // Makes every change so far durable and releases the files.
+    virtual void close() = 0;
+
+    virtual std::optional<std::string> get(const std::string& key) = 0;
+    virtual StatusResponse put(const std::string& key, const std::string& value) = 0;
+    virtual StatusResponse remove(const std::string& key) = 0;
+
+    // Visits every record in key order.
+    virtual StatusResponse scan(const Visitor& visit) = 0;
+
+    // Visits up to limit keys that sort after the given one, in key order, without reading their values.
+    virtual StatusResponse scanKeys(std::string_view after, std::size_t limit, const KeyVisitor& visit) = 0;
+
+    // Makes every change so far durable.
+    virtual StatusResponse flush() = 0;
+
+    // Describes the store for log messages.
+    [[nodiscard]] virtual std::string describe() const = 0;
+};
+
+#endif //KEYVALUESTORE_H
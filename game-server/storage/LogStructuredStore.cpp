@@ -0,0 +1,790 @@
+﻿#include "LogStructuredStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <ranges>
+
+#include "../utilities/AtomicFileWriter.h"
+#include "../utilities/FileUtils.h"
+
+namespace
+{
+    constexpr char SEGMENT_MAGIC[4] = { 'L', 'S', 'M', 'S' };
+    constexpr std::uint32_t SEGMENT_VERSION = 1;
+
+    const std::string LOG_FILENAME = "wal.log";
+    const std::string MANIFEST_FILENAME = "MANIFEST";
+
+    struct SegmentHeader
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t reserved;
+        std::uint64_t indexOffset;
+    };
+
+    // Every segment entry and log record starts like this, followed by the key and the value.
+    struct EntryHeader
+    {
+        std::uint8_t removed;
+        std::uint8_t reserved[3];
+        std::uint32_t keyLength;
+        std::uint32_t valueLength;
+    };
+
+    struct LogRecordHeader
+    {
+        std::uint32_t checksum;
+        EntryHeader entry;
+    };
+
+    static_assert(sizeof(SegmentHeader) == 24);
+    static_assert(sizeof(EntryHeader) == 12);
+    static_assert(sizeof(LogRecordHeader) == 16);
+
+    template<typename T>
+    T readRecord(const char* data, const std::size_t offset)
+    {
+        T record;
+        std::memcpy(&record, data + offset, sizeof(T));
+        return record;
+    }
+
+    template<typename T>
+    void appendRecord(std::string& buffer, const T& record)
+    {
+        buffer.append(reinterpret_cast<const char*>(&record), sizeof(T));
+    }
+
+    // FNV-1a, enough to tell a torn log record from a whole one.
+    std::uint32_t checksum(const EntryHeader& header, const std::string_view key, const std::string_view value)
+    {
+        std::uint32_t hash = 2166136261u;
+        const auto mix = [&hash](const char* data, const std::size_t size)
+        {
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                hash = (hash ^ static_cast<std::uint8_t>(data[i])) * 16777619u;
+            }
+        };
+
+        mix(reinterpret_cast<const char*>(&header), sizeof(header));
+        mix(key.data(), key.size());
+        mix(value.data(), value.size());
+        return hash;
+    }
+
+    std::string segmentFilename(const std::uint64_t number)
+    {
+        return "segment-" + std::to_string(number) + ".dat";
+    }
+
+    // Reads the number out of a segment filename, or 0 if it isn't one.
+    std::uint64_t segmentNumber(const std::string& filename)
+    {
+        if (!filename.starts_with("segment-") || !filename.ends_with(".dat")) return 0;
+
+        try
+        {
+            return std::stoull(filename.substr(8, filename.size() - 12));
+        }
+        catch (const std::exception&)
+        {
+            return 0;
+        }
+    }
+}
+
+LogStructuredStore::Segment::~Segment()
+{
+    file.close();
+
+    if (obsolete)
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
+
+bool LogStructuredStore::Segment::open(const std::string& segmentPath, std::string& error)
+{
+    path = segmentPath;
+    filename = std::filesystem::path(segmentPath).filename().string();
+
+    if (!file.open(path))
+    {
+        error = "Could not map " + path;
+        return false;
+    }
+
+    const char* data = file.data();
+    const std::size_t size = file.size();
+
+    if (size < sizeof(SegmentHeader))
+    {
+        error = path + " is too small";
+        return false;
+    }
+
+    const auto header = readRecord<SegmentHeader>(data, 0);
+    if (std::memcmp(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 || header.version != SEGMENT_VERSION)
+    {
+        error = path + " is not a version " + std::to_string(SEGMENT_VERSION) + " segment";
+        return false;
+    }
+
+    if (header.indexOffset < sizeof(SegmentHeader) || header.indexOffset > size
+        || (size - header.indexOffset) / sizeof(std::uint64_t) < header.entryCount)
+    {
+        error = path + " has an index outside the file";
+        return false;
+    }
+
+    entryCount = header.entryCount;
+    index = data + header.indexOffset;
+
+    // Checks every entry once, so lookups can trust the offsets.
+    std::string_view previousKey;
+    for (std::uint32_t i = 0; i < entryCount; ++i)
+    {
+        const auto offset = readRecord<std::uint64_t>(index, i * sizeof(std::uint64_t));
+        if (offset < sizeof(SegmentHeader) || offset > header.indexOffset - sizeof(EntryHeader))
+        {
+            error = path + " has an entry outside the file";
+            return false;
+        }
+
+        const auto entryHeader = readRecord<EntryHeader>(data, offset);
+        if (header.indexOffset - offset - sizeof(EntryHeader) < std::uint64_t{ entryHeader.keyLength } + entryHeader.valueLength)
+        {
+            error = path + " has an entry outside the file";
+            return false;
+        }
+
+        const std::string_view key(data + offset + sizeof(EntryHeader), entryHeader.keyLength);
+        if (i > 0 && key <= previousKey)
+        {
+            error = path + " is not sorted";
+            return false;
+        }
+        previousKey = key;
+    }
+
+    return true;
+}
+
+std::uint32_t LogStructuredStore::Segment::getEntryCount() const
+{
+    return entryCount;
+}
+
+LogStructuredStore::Segment::Entry LogStructuredStore::Segment::getEntry(const std::uint32_t entryIndex) const
+{
+    const auto offset = readRecord<std::uint64_t>(index, entryIndex * sizeof(std::uint64_t));
+    const auto header = readRecord<EntryHeader>(file.data(), offset);
+    const char* key = file.data() + offset + sizeof(EntryHeader);
+
+    return { { key, header.keyLength }, { key + header.keyLength, header.valueLength }, header.removed != 0 };
+}
+
+std::uint32_t LogStructuredStore::Segment::find(const std::string_view key) const
+{
+    const std::uint32_t low = lowerBound(key);
+    return low < entryCount && getEntry(low).key == key ? low : entryCount;
+}
+
+std::uint32_t LogStructuredStore::Segment::lowerBound(const std::string_view key) const
+{
+    std::uint32_t low = 0;
+    std::uint32_t high = entryCount;
+
+    while (low < high)
+    {
+        const std::uint32_t middle = low + (high - low) / 2;
+        if (getEntry(middle).key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+const std::string& LogStructuredStore::Segment::getFilename() const
+{
+    return filename;
+}
+
+void LogStructuredStore::Segment::markObsolete()
+{
+    obsolete = true;
+}
+
+LogStructuredStore::LogStructuredStore(std::string directory) : directory(std::move(directory))
+{
+}
+
+LogStructuredStore::~LogStructuredStore()
+{
+    close();
+}
+
+StatusResponse LogStructuredStore::open()
+{
+    std::lock_guard lock(storeMutex);
+    if (opened) return { false, "The store is already open" };
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        return { false, "Could not create " + directory + ": " + error.message() };
+    }
+
+    // Loads the live segments. Files the manifest doesn't list are left over from an interrupted
+    // flush or compaction.
+    segments.clear();
+    std::vector<std::string> liveFilenames;
+    {
+        std::ifstream manifest(pathOf(MANIFEST_FILENAME));
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            if (!line.empty()) liveFilenames.push_back(line);
+        }
+    }
+
+    for (const std::string& filename : liveFilenames)
+    {
+        auto segment = std::make_shared<Segment>();
+        std::string segmentError;
+        if (!segment->open(pathOf(filename), segmentError))
+        {
+            segments.clear();
+            return { false, segmentError };
+        }
+
+        nextSegmentNumber = std::max(nextSegmentNumber, segmentNumber(filename) + 1);
+        segments.push_back(std::move(segment));
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+    {
+        const std::string filename = entry.path().filename().string();
+        if (segmentNumber(filename) != 0 && std::ranges::find(liveFilenames, filename) == liveFilenames.end())
+        {
+            std::filesystem::remove(entry.path(), error);
+        }
+    }
+
+    if (StatusResponse replayResult = replayLog(); !replayResult.success)
+    {
+        segments.clear();
+        return replayResult;
+    }
+
+    if (StatusResponse logResult = openLog("ab"); !logResult.success)
+    {
+        segments.clear();
+        return logResult;
+    }
+
+    opened = true;
+    stopping = false;
+    compactionRequested = segments.size() >= COMPACTION_TRIGGER;
+    compactionThread = std::thread(&LogStructuredStore::compactionLoop, this);
+
+    return { true, "Opened " + directory + " with " + std::to_string(segments.size()) + " segments and "
+        + std::to_string(memtable.size()) + " logged changes" };
+}
+
+void LogStructuredStore::close()
+{
+    {
+        std::lock_guard lock(storeMutex);
+        if (!opened) return;
+        stopping = true;
+    }
+
+    compactionCondition.notify_all();
+    if (compactionThread.joinable())
+    {
+        compactionThread.join();
+    }
+
+    std::lock_guard lock(storeMutex);
+    if (logFile != nullptr)
+    {
+        FileUtils::syncFile(logFile);
+        fclose(logFile);
+        logFile = nullptr;
+    }
+
+    memtable.clear();
+    memtableBytes = 0;
+    segments.clear();
+    opened = false;
+}
+
+std::optional<std::string> LogStructuredStore::get(const std::string& key)
+{
+    std::lock_guard lock(storeMutex);
+
+    if (const auto memtableIt = memtable.find(key); memtableIt != memtable.end())
+    {
+        return memtableIt->second;
+    }
+
+    // The newest segment holding the key has its latest value.
+    for (const auto& segment : std::views::reverse(segments))
+    {
+        const std::uint32_t entryIndex = segment->find(key);
+        if (entryIndex == segment->getEntryCount()) continue;
+
+        const Segment::Entry entry = segment->getEntry(entryIndex);
+        if (entry.removed) return std::nullopt;
+        return std::string(entry.value);
+    }
+
+    return std::nullopt;
+}
+
+StatusResponse LogStructuredStore::put(const std::string& key, const std::string& value)
+{
+    return append(key, value);
+}
+
+StatusResponse LogStructuredStore::remove(const std::string& key)
+{
+    return append(key, std::nullopt);
+}
+
+StatusResponse LogStructuredStore::scan(const Visitor& visit)
+{
+    std::lock_guard lock(storeMutex);
+
+    mergeSources(std::nullopt, [&visit](const std::string_view key, const std::optional<std::string_view> value)
+    {
+        if (value) visit(std::string(key), std::string(*value));
+        return true;
+    });
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::scanKeys(const std::string_view after, const std::size_t limit, const KeyVisitor& visit)
+{
+    std::lock_guard lock(storeMutex);
+    if (limit == 0) return { true, "" };
+
+    std::size_t visited = 0;
+    mergeSources(after, [&visit, &visited, limit](const std::string_view key, const std::optional<std::string_view> value)
+    {
+        if (!value) return true;
+        visit(std::string(key));
+        return ++visited < limit;
+    });
+
+    return { true, "" };
+}
+
+void LogStructuredStore::mergeSources(const std::optional<std::string_view> after, const MergeVisitor& visit) const
+{
+    // Merges the sorted sources, newest first, so each key is only reported from its newest source.
+    struct Cursor
+    {
+        std::string_view key;
+        std::size_t source; // 0 is the memory table, then segments from newest to oldest.
+    };
+    const auto laterCursor = [](const Cursor& left, const Cursor& right)
+    {
+        return left.key != right.key ? left.key > right.key : left.source > right.source;
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(laterCursor)> cursors(laterCursor);
+
+    const auto segmentAt = [this](const std::size_t source) -> const Segment&
+    {
+        return *segments[segments.size() - source];
+    };
+
+    // Each source starts at its first key after the given one.
+    Memtable::const_iterator memtablePosition = after ? memtable.upper_bound(*after) : memtable.begin();
+    std::vector<std::uint32_t> segmentPositions(segments.size(), 0);
+    if (memtablePosition != memtable.end()) cursors.push({ memtablePosition->first, 0 });
+    for (std::size_t source = 1; source <= segments.size(); ++source)
+    {
+        const Segment& segment = segmentAt(source);
+        std::uint32_t& position = segmentPositions[source - 1];
+        if (after)
+        {
+            position = segment.lowerBound(*after);
+            if (position < segment.getEntryCount() && segment.getEntry(position).key == *after) ++position;
+        }
+        if (position < segment.getEntryCount()) cursors.push({ segment.getEntry(position).key, source });
+    }
+
+    std::string_view lastKey;
+    bool anyKey = false;
+    while (!cursors.empty())
+    {
+        const Cursor cursor = cursors.top();
+        cursors.pop();
+
+        std::optional<std::string_view> value;
+        if (cursor.source == 0)
+        {
+            if (memtablePosition->second) value = *memtablePosition->second;
+            if (++memtablePosition != memtable.end()) cursors.push({ memtablePosition->first, 0 });
+        }
+        else
+        {
+            const Segment& segment = segmentAt(cursor.source);
+            std::uint32_t& position = segmentPositions[cursor.source - 1];
+            const Segment::Entry entry = segment.getEntry(position);
+            if (!entry.removed) value = entry.value;
+            if (++position < segment.getEntryCount()) cursors.push({ segment.getEntry(position).key, cursor.source });
+        }
+
+        if (anyKey && cursor.key == lastKey) continue;
+        lastKey = cursor.key;
+        anyKey = true;
+
+        if (!visit(lastKey, value)) return;
+    }
+}
+
+StatusResponse LogStructuredStore::flush()
+{
+    std::lock_guard lock(storeMutex);
+    if (logFile == nullptr) return { false, "The store is not open" };
+
+    if (!FileUtils::syncFile(logFile))
+    {
+        return { false, "Could not sync " + pathOf(LOG_FILENAME) };
+    }
+
+    return { true, "" };
+}
+
+std::string LogStructuredStore::describe() const
+{
+    return "log-structured store " + directory;
+}
+
+StatusResponse LogStructuredStore::append(const std::string& key, const std::optional<std::string>& value)
+{
+    std::lock_guard lock(storeMutex);
+    if (logFile == nullptr) return { false, "The store is not open" };
+
+    LogRecordHeader header{};
+    header.entry.removed = value ? 0 : 1;
+    header.entry.keyLength = static_cast<std::uint32_t>(key.size());
+    header.entry.valueLength = value ? static_cast<std::uint32_t>(value->size()) : 0;
+    header.checksum = checksum(header.entry, key, value ? *value : std::string_view{});
+
+    std::string record;
+    record.reserve(sizeof(header) + key.size() + header.entry.valueLength);
+    appendRecord(record, header);
+    record += key;
+    if (value) record += *value;
+
+    if (fwrite(record.data(), 1, record.size(), logFile) != record.size())
+    {
+        return { false, "Could not write " + pathOf(LOG_FILENAME) };
+    }
+
+    memtable.insert_or_assign(key, value);
+    memtableBytes += key.size() + header.entry.valueLength + sizeof(EntryHeader);
+
+    if (memtableBytes >= MEMTABLE_LIMIT)
+    {
+        return flushMemtable();
+    }
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::replayLog()
+{
+    memtable.clear();
+    memtableBytes = 0;
+
+    const std::string logPath = pathOf(LOG_FILENAME);
+    std::ifstream log(logPath, std::ios::binary);
+    if (!log.is_open()) return { true, "" };
+
+    std::uintmax_t validBytes = 0;
+    std::string key;
+    std::string value;
+    LogRecordHeader header{};
+
+    while (log.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        key.resize(header.entry.keyLength);
+        value.resize(header.entry.valueLength);
+        if (!log.read(key.data(), static_cast<std::streamsize>(key.size()))
+            || !log.read(value.data(), static_cast<std::streamsize>(value.size()))
+            || checksum(header.entry, key, value) != header.checksum)
+        {
+            break;
+        }
+
+        if (header.entry.removed)
+        {
+            memtable.insert_or_assign(key, std::nullopt);
+        }
+        else
+        {
+            memtable.insert_or_assign(key, value);
+        }
+
+        memtableBytes += key.size() + value.size() + sizeof(EntryHeader);
+        validBytes += sizeof(header) + key.size() + value.size();
+    }
+    log.close();
+
+    // Cuts off a record torn by a crash, so new records aren't appended after it.
+    std::error_code error;
+    if (std::filesystem::file_size(logPath, error) > validBytes && !error)
+    {
+        std::filesystem::resize_file(logPath, validBytes, error);
+        if (error)
+        {
+            return { false, "Could not truncate " + logPath + ": " + error.message() };
+        }
+    }
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::openLog(const char* mode)
+{
+    if (logFile != nullptr)
+    {
+        fclose(logFile);
+    }
+
+    const std::string logPath = pathOf(LOG_FILENAME);
+    logFile = fopen(logPath.c_str(), mode);
+    if (logFile == nullptr)
+    {
+        return { false, "Could not open " + logPath };
+    }
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::flushMemtable()
+{
+    if (memtable.empty()) return { true, "" };
+
+    std::vector<Segment::Entry> entries;
+    entries.reserve(memtable.size());
+    for (const auto& [key, value] : memtable)
+    {
+        entries.push_back({ key, value ? std::string_view(*value) : std::string_view{}, !value });
+    }
+
+    std::shared_ptr<Segment> segment;
+    if (StatusResponse writeResult = writeSegment(segmentFilename(nextSegmentNumber++), entries, segment); !writeResult.success)
+    {
+        return writeResult;
+    }
+
+    std::vector<std::shared_ptr<Segment>> liveSegments = segments;
+    liveSegments.push_back(segment);
+    if (StatusResponse manifestResult = writeManifest(liveSegments); !manifestResult.success)
+    {
+        segment->markObsolete();
+        return manifestResult;
+    }
+
+    // The segment holds everything in the log now.
+    segments = std::move(liveSegments);
+    memtable.clear();
+    memtableBytes = 0;
+
+    if (StatusResponse logResult = openLog("wb"); !logResult.success)
+    {
+        return logResult;
+    }
+
+    if (segments.size() >= COMPACTION_TRIGGER)
+    {
+        compactionRequested = true;
+        compactionCondition.notify_all();
+    }
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::writeSegment(const std::string& filename, const std::vector<Segment::Entry>& entries,
+                                                std::shared_ptr<Segment>& segment)
+{
+    const std::string segmentPath = pathOf(filename);
+
+    std::string data;
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(entries.size());
+
+    SegmentHeader header{};
+    std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header.version = SEGMENT_VERSION;
+    header.entryCount = static_cast<std::uint32_t>(entries.size());
+    appendRecord(data, header);
+
+    for (const Segment::Entry& entry : entries)
+    {
+        offsets.push_back(data.size());
+
+        EntryHeader entryHeader{};
+        entryHeader.removed = entry.removed ? 1 : 0;
+        entryHeader.keyLength = static_cast<std::uint32_t>(entry.key.size());
+        entryHeader.valueLength = static_cast<std::uint32_t>(entry.value.size());
+        appendRecord(data, entryHeader);
+        data += entry.key;
+        data += entry.value;
+    }
+
+    header.indexOffset = data.size();
+    std::memcpy(data.data(), &header, sizeof(header));
+    data.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(std::uint64_t));
+
+    FILE* file = fopen(segmentPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return { false, "Could not create " + segmentPath };
+    }
+
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size() && FileUtils::syncFile(file);
+    fclose(file);
+
+    segment = std::make_shared<Segment>();
+    std::string error;
+    if (!written || !segment->open(segmentPath, error))
+    {
+        segment->markObsolete();
+        segment.reset();
+        return { false, written ? error : "Could not write " + segmentPath };
+    }
+
+    return { true, "" };
+}
+
+StatusResponse LogStructuredStore::writeManifest(const std::vector<std::shared_ptr<Segment>>& liveSegments)
+{
+    std::string contents;
+    for (const auto& segment : liveSegments)
+    {
+        contents += segment->getFilename() + "\n";
+    }
+
+    AtomicFileWriter manifest(pathOf(MANIFEST_FILENAME));
+    if (!manifest.open() || !manifest.write(contents))
+    {
+        return { false, "Could not write " + manifest.getFilename() };
+    }
+
+    return manifest.commit();
+}
+
+void LogStructuredStore::compactionLoop()
+{
+    std::unique_lock lock(storeMutex);
+
+    while (true)
+    {
+        compactionCondition.wait(lock, [this] { return compactionRequested || stopping; });
+        if (stopping) return;
+
+        compactionRequested = false;
+        lock.unlock();
+        compact();
+        lock.lock();
+    }
+}
+
+StatusResponse LogStructuredStore::compact()
+{
+    // Merges the segments that exist now. Segments flushed meanwhile are newer and stay as they are.
+    std::vector<std::shared_ptr<Segment>> inputs;
+    {
+        std::lock_guard lock(storeMutex);
+        if (segments.size() < 2) return { true, "" };
+        inputs = segments;
+    }
+
+    // Keeps the newest entry of each key. Deletions can be dropped, as the oldest segment is merged too.
+    std::vector<Segment::Entry> merged;
+    {
+        std::vector<std::uint32_t> positions(inputs.size(), 0);
+        while (true)
+        {
+            std::optional<std::string_view> smallest;
+            for (std::size_t i = 0; i < inputs.size(); ++i)
+            {
+                if (positions[i] == inputs[i]->getEntryCount()) continue;
+                const std::string_view key = inputs[i]->getEntry(positions[i]).key;
+                if (!smallest || key < *smallest) smallest = key;
+            }
+            if (!smallest) break;
+
+            std::optional<Segment::Entry> newest;
+            for (std::size_t i = 0; i < inputs.size(); ++i)
+            {
+                if (positions[i] == inputs[i]->getEntryCount()) continue;
+                const Segment::Entry entry = inputs[i]->getEntry(positions[i]);
+                if (entry.key != *smallest) continue;
+
+                newest = entry; // Later inputs are newer.
+                ++positions[i];
+            }
+
+            if (!newest->removed) merged.push_back(*newest);
+        }
+    }
+
+    std::string outputFilename;
+    {
+        std::lock_guard lock(storeMutex);
+        if (stopping) return { true, "" };
+        outputFilename = segmentFilename(nextSegmentNumber++);
+    }
+
+    std::shared_ptr<Segment> output;
+    const StatusResponse writeResult = writeSegment(outputFilename, merged, output);
+    if (!writeResult.success) return writeResult;
+
+    std::lock_guard lock(storeMutex);
+
+    // Segments flushed while merging follow the inputs in the list.
+    std::vector<std::shared_ptr<Segment>> liveSegments{ output };
+    liveSegments.insert(liveSegments.end(), segments.begin() + static_cast<std::ptrdiff_t>(inputs.size()), segments.end());
+
+    if (StatusResponse manifestResult = writeManifest(liveSegments); !manifestResult.success)
+    {
+        output->markObsolete();
+        return manifestResult;
+    }
+
+    for (const auto& input : inputs)
+    {
+        input->markObsolete();
+    }
+    segments = std::move(liveSegments);
+
+    return { true, "Merged " + std::to_string(inputs.size()) + " segments into " + output->getFilename() };
+}
+
+std::string LogStructuredStore::pathOf(const std::string& filename) const
+{
+    return (std::filesystem::path(directory) / filename).string();
+}
@@ -0,0 +1,135 @@
+﻿#ifndef LOGSTRUCTUREDSTORE_H
+#define LOGSTRUCTUREDSTORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "KeyValueStore.h"
+#include "../utilities/MappedFile.h"
+
+// An embedded log-structured store. Writes append to a log and land in an in-memory table, which is
+// written out as a sorted, indexed segment file once it grows large. A background thread merges
+// segments so lookups only ever check a few of them.
+//
+// The directory holds:
+//   wal.log          - the changes held in the memory table
+//   MANIFEST         - the live segment files, oldest first
+//   segment-N.dat    - sorted records followed by an offset index
+class LogStructuredStore : public KeyValueStore
+{
+public:
+
+    explicit LogStructuredStore(std::string directory);
+    ~LogStructuredStore() override;
+
+    StatusResponse open() override;
+    void close() override;
+
+    std::optional<std::string> get(const std::string& key) override;
+    StatusResponse put(const std::string& key, const std::string& value) override;
+    StatusResponse remove(const std::string& key) override;
+    StatusResponse scan(const Visitor& visit) override;
+    StatusResponse scanKeys(std::string_view after, std::size_t limit, const KeyVisitor& visit) override;
+    StatusResponse flush() override;
+
+    [[nodiscard]] std::string describe() const override;
+
+private:
+
+    static constexpr std::size_t MEMTABLE_LIMIT = 4 * 1024 * 1024;
+    static constexpr std::size_t COMPACTION_TRIGGER = 4;
+
+    // A sorted, immutable segment file mapped into memory.
+    class Segment
+    {
+    public:
+
+        struct Entry
+        {
+            std::string_view key;
+            std::string_view value;
+            bool removed = false;
+        };
+
+        ~Segment();
+
+        bool open(const std::string& path, std::string& error);
+
+        [[nodiscard]] std::uint32_t getEntryCount() const;
+        [[nodiscard]] Entry getEntry(std::uint32_t index) const;
+
+        // Returns the index of the entry with the key, or the entry count if there isn't one.
+        [[nodiscard]] std::uint32_t find(std::string_view key) const;
+
+        // Returns the index of the first entry whose key is not less than the given one.
+        [[nodiscard]] std::uint32_t lowerBound(std::string_view key) const;
+
+        [[nodiscard]] const std::string& getFilename() const;
+
+        // Deletes the file once the last reader lets go of it.
+        void markObsolete();
+
+    private:
+
+        std::string path;
+        std::string filename;
+        MappedFile file;
+        std::uint32_t entryCount = 0;
+        const char* index = nullptr;
+        bool obsolete = false;
+    };
+
+    // The value of a key in the memory table. A missing value is a deletion.
+    using Memtable = std::map<std::string, std::optional<std::string>, std::less<>>;
+
+    // Visits the newest version of each key after the given one (or of every key) in key order, with no value
+    // for a deletion, until the visitor returns false. Must be called with the lock held.
+    using MergeVisitor = std::function<bool(std::string_view key, std::optional<std::string_view> value)>;
+    void mergeSources(std::optional<std::string_view> after, const MergeVisitor& visit) const;
+
+    StatusResponse append(const std::string& key, const std::optional<std::string>& value);
+    StatusResponse replayLog();
+    StatusResponse openLog(const char* mode);
+
+    // Writes the memory table out as a new segment and starts a fresh log.
+    StatusResponse flushMemtable();
+
+    // Writes sorted records to a new segment file and opens it. Needs no lock.
+    StatusResponse writeSegment(const std::string& filename, const std::vector<Segment::Entry>& entries,
+                                std::shared_ptr<Segment>& segment);
+
+    StatusResponse writeManifest(const std::vector<std::shared_ptr<Segment>>& liveSegments);
+
+    // Merges every segment into one in the background.
+    void compactionLoop();
+    StatusResponse compact();
+
+    [[nodiscard]] std::string pathOf(const std::string& filename) const;
+
+    std::string directory;
+
+    std::mutex storeMutex;
+    Memtable memtable;
+    std::size_t memtableBytes = 0;
+    std::vector<std::shared_ptr<Segment>> segments; // Oldest first.
+    std::uint64_t nextSegmentNumber = 1;
+    FILE* logFile = nullptr;
+    bool opened = false;
+
+    std::thread compactionThread;
+    std::condition_variable compactionCondition;
+    bool compactionRequested = false;
+    bool stopping = false;
+};
+
+#endif //LOGSTRUCTUREDSTORE_H
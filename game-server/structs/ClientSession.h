@@ -0,0 +1,60 @@
+﻿#ifndef CLIENTSESSION_H
+#define CLIENTSESSION_H
+
+#include <winsock2.h>
+#include <chrono>
+#include <optional>
+#include <string>
+
+#include "Item.h"
+#include "../utilities/Compression.h"
+#include "../utilities/WireProtocol.h"
+
+// State kept for a single client connection.
+struct ClientSession
+{
+    int clientId;
+    SOCKET clientSocket;
+    std::string username;
+    bool connectionApproved;
+
+    // How messages are encoded, switched with the set_protocol action.
+    WireProtocol::Format protocol = WireProtocol::Format::Json;
+
+    // Bytes received but not handled yet, and how far the JSON in them has been scanned.
+    std::string messageBuffer;
+    WireProtocol::TextScan messageScan;
+
+    // Responses are written here, so its capacity is reused from one message to the next.
+    std::string responseBuffer;
+
+    // How large responses are compressed, switched with the set_compression action. The context and
+    // the buffer are kept for the whole connection.
+    Compression::Codec responseCodec = Compression::Codec::None;
+    Compression::Context compressionContext;
+    std::string compressedBuffer;
+
+    // The item found on the last adventure, waiting to be stored.
+    std::optional<ItemInstance> pendingItem;
+    std::chrono::steady_clock::time_point pendingItemExpiry;
+
+    ClientSession(const int clientId, const SOCKET clientSocket) : clientId(clientId), clientSocket(clientSocket), connectionApproved(false) {}
+
+    void setPendingItem(const ItemInstance& itemInstance, const std::chrono::seconds timeToLive)
+    {
+        pendingItem = itemInstance;
+        pendingItemExpiry = std::chrono::steady_clock::now() + timeToLive;
+    }
+
+    bool isPendingItemExpired() const
+    {
+        return pendingItem.has_value() && std::chrono::steady_clock::now() >= pendingItemExpiry;
+    }
+
+    void clearPendingItem()
+    {
+        pendingItem.reset();
+    }
+};
+
+#endif //CLIENTSESSION_H
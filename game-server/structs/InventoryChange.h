@@ -0,0 +1,16 @@
+﻿#ifndef INVENTORYCHANGE_H
+#define INVENTORYCHANGE_H
+
+#include <cstdint>
+
+#include "Item.h"
+
+// An item added to or removed from an inventory, and the version the inventory had before it.
+struct InventoryChange
+{
+    std::uint64_t fromVersion;
+    ItemInstance item;
+    bool added;
+};
+
+#endif //INVENTORYCHANGE_H
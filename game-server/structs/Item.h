@@ -1,10 +1,11 @@
 ﻿#ifndef ITEM_H
 #define ITEM_H
 
+#include <cstdint>
 #include <string>
-#include <utility>
 #include <rpc.h>
 
+// An immutable item definition, stored once in the item catalog.
 struct Item
 {
     std::string type;
@@ -23,22 +24,24 @@ struct Item
     }
 };
 
+// A unique item owned by a player. Only the GUID and the catalog index are stored,
+// the definition itself is shared through the item catalog.
 struct ItemInstance
 {
     GUID id{};
-    Item item;
+    std::uint16_t catalogIndex;
 
-    ItemInstance()
+    ItemInstance() : catalogIndex(0)
     {
         UuidCreate(&this->id);
     }
 
-    explicit ItemInstance(Item item): item(std::move(item))
+    explicit ItemInstance(const std::uint16_t catalogIndex) : catalogIndex(catalogIndex)
     {
         UuidCreate(&this->id);
     }
 
-    explicit ItemInstance(Item item, GUID id) : item(std::move(item)), id(id) { }
+    explicit ItemInstance(const std::uint16_t catalogIndex, const GUID id) : id(id), catalogIndex(catalogIndex) { }
 };
 
 #endif //ITEM_H
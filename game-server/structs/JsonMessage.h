@@ -1,20 +1,62 @@
 ﻿#ifndef MESSAGE_H
 #define MESSAGE_H
 
-#include <string>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+// A parsed request. The fields point into the message it was parsed from, which must outlive them.
 struct JsonMessage
 {
-    std::string action;
-    std::string authToken;
-    std::string username;
-    std::string itemId;
-    std::string targetUser;
-    std::string newType;
-    std::string message;
+    std::string_view action;
+    std::string_view authToken;
+    std::string_view username;
+    std::string_view itemId;
+    std::string_view targetUser;
+    std::string_view newType;
+    std::string_view message;
+    std::string_view protocol;
+    std::string_view cursor;
+    std::string_view compression;
     bool success;
+    bool stream;
+    std::uint64_t knownVersion;
+    std::uint64_t limit;
 
-    JsonMessage() : success(false) {}
+    // The steps of a batch request, each read like a request of its own.
+    std::vector<JsonMessage> actions;
+
+    JsonMessage() : success(false), stream(false), knownVersion(0), limit(0) {}
 };
 
+// The keys requests are sent with, in the order they're read.
+inline constexpr std::array<std::pair<std::string_view, std::string_view JsonMessage::*>, 10> JSON_MESSAGE_TEXT_FIELDS = {{
+    {"action", &JsonMessage::action},
+    {"token", &JsonMessage::authToken},
+    {"username", &JsonMessage::username},
+    {"itemId", &JsonMessage::itemId},
+    {"targetUser", &JsonMessage::targetUser},
+    {"newType", &JsonMessage::newType},
+    {"message", &JsonMessage::message},
+    {"protocol", &JsonMessage::protocol},
+    {"cursor", &JsonMessage::cursor},
+    {"compression", &JsonMessage::compression}
+}};
+
+inline constexpr std::array<std::pair<std::string_view, bool JsonMessage::*>, 2> JSON_MESSAGE_FLAG_FIELDS = {{
+    {"success", &JsonMessage::success},
+    {"stream", &JsonMessage::stream}
+}};
+
+// The key holding the steps of a batch request.
+inline constexpr std::string_view JSON_MESSAGE_ACTIONS_KEY = "actions";
+
+// Keys with unsigned integer values, which are zero when missing.
+inline constexpr std::array<std::pair<std::string_view, std::uint64_t JsonMessage::*>, 2> JSON_MESSAGE_NUMBER_FIELDS = {{
+    {"knownVersion", &JsonMessage::knownVersion},
+    {"limit", &JsonMessage::limit}
+}};
+
 #endif //MESSAGE_H
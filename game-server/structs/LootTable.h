@@ -0,0 +1,59 @@
+﻿#ifndef LOOTTABLE_H
+#define LOOTTABLE_H
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "../utilities/AliasTable.h"
+
+// The possible rewards of an adventure for one player tier.
+// Outcome 0 is money, every other outcome is one of the items.
+struct LootTable
+{
+    float moneyWeight;
+    float moneyMin;
+    float moneyMax;
+    std::vector<std::uint16_t> itemIndices;
+    std::vector<float> itemWeights;
+    AliasTable outcomes;
+
+    LootTable() : moneyWeight(0.0f), moneyMin(0.0f), moneyMax(0.0f) {}
+
+    LootTable(const float moneyWeight, const float moneyMin, const float moneyMax,
+              std::vector<std::uint16_t> itemIndices, std::vector<float> itemWeights)
+        : moneyWeight(moneyWeight), moneyMin(moneyMin), moneyMax(moneyMax),
+          itemIndices(std::move(itemIndices)), itemWeights(std::move(itemWeights))
+    {
+        std::vector<double> weights;
+        weights.reserve(this->itemWeights.size() + 1);
+        weights.push_back(moneyWeight);
+        weights.insert(weights.end(), this->itemWeights.begin(), this->itemWeights.end());
+
+        outcomes = AliasTable(weights);
+    }
+
+    // Rolls the reward. Returns the catalog index of the item found, or nothing if money was found instead.
+    template <typename Generator>
+    std::optional<std::uint16_t> rollItem(Generator& generator) const
+    {
+        if (outcomes.empty()) { return std::nullopt; }
+
+        const std::size_t outcome = outcomes.sample(generator);
+        if (outcome == 0) { return std::nullopt; }
+
+        return itemIndices[outcome - 1];
+    }
+
+    // Rolls an amount of money, rounded to cents.
+    template <typename Generator>
+    float rollMoney(Generator& generator) const
+    {
+        std::uniform_real_distribution moneyDist(moneyMin, moneyMax);
+        return std::round(moneyDist(generator) * 100.0f) / 100.0f;
+    }
+};
+
+#endif //LOOTTABLE_H
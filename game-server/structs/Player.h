@@ -1,11 +1,19 @@
 ﻿#ifndef PLAYER_H
 #define PLAYER_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "InventoryChange.h"
 #include "Item.h"
+#include "../ItemCatalog.h"
 #include "../enums/PlayerType.h"
 #include "../utilities/GUIDUtils.h"
 
@@ -18,32 +26,53 @@ struct Player
     std::vector<ItemInstance> inventory;
     bool isAdmin;
 
-    Player() : type(PlayerType::Freemium), balance(0), isAdmin(false) {}
+    // Changes with every item added or removed, so clients can tell whether their copy is current.
+    std::uint64_t inventoryVersion;
+
+    // The latest changes to the inventory, oldest first, for catching clients up.
+    std::vector<InventoryChange> inventoryChanges;
+
+    // How many changes are kept. Clients further behind get the whole inventory again.
+    static constexpr std::size_t MAX_INVENTORY_CHANGES = 32;
+
+    Player() : type(PlayerType::Freemium), balance(0), isAdmin(false), inventoryVersion(takeInventoryVersion()) {}
+
+    // Versions are drawn from one counter that starts at the time in nanoseconds, so a version is never
+    // reused, whether by another player or after a restart.
+    static std::uint64_t takeInventoryVersion()
+    {
+        static std::atomic<std::uint64_t> nextVersion(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count()));
+
+        return nextVersion++;
+    }
 
     int getMaxInventorySpace() const
     {
         return static_cast<int>(type);
     }
 
-    int getUsedInventorySpace() const
+    int getUsedInventorySpace(const ItemCatalog& catalog) const
     {
         int used = 0;
         for (const auto& itemInstance : inventory)
         {
-            used += itemInstance.item.weight;
+            used += catalog.get(itemInstance).weight;
         }
 
         return used;
     }
 
-    bool canAddItem(const Item& item) const
+    bool canAddItem(const ItemCatalog& catalog, const Item& item) const
     {
-        return getUsedInventorySpace() + item.weight <= getMaxInventorySpace();
+        return getUsedInventorySpace(catalog) + item.weight <= getMaxInventorySpace();
     }
 
+    // Adds or removes an item as part of play, recording the change. Loading fills inventory directly.
     void collectItem(const ItemInstance& itemInstance)
     {
         inventory.push_back(itemInstance);
+        recordInventoryChange(itemInstance, true);
     }
 
     bool dropItem(const ItemInstance& itemInstance)
@@ -57,13 +86,14 @@ struct Player
         if (itemIt != inventory.end())
         {
             inventory.erase(itemIt);
+            recordInventoryChange(itemInstance, false);
             return true;
         }
 
         return false;
     }
 
-    std::optional<ItemInstance> getItemFromInventory(const std::string& itemId)
+    std::optional<ItemInstance> getItemFromInventory(const std::string_view itemId)
     {
         // Finds item by GUID in the player's inventory.
         GUID targetGuid = GUIDUtils::stringToGUID(itemId);
@@ -76,6 +106,28 @@ struct Player
         if (itemIt == inventory.end()) { return std::nullopt; }
         return *itemIt;
     }
+
+    // The changes made since the inventory had the given version, or nothing if they aren't all kept.
+    std::optional<std::span<const InventoryChange>> getInventoryChangesSince(const std::uint64_t version) const
+    {
+        const auto changeIt = std::ranges::find(inventoryChanges, version, &InventoryChange::fromVersion);
+        if (changeIt == inventoryChanges.end()) { return std::nullopt; }
+
+        return std::span(changeIt, inventoryChanges.end());
+    }
+
+private:
+
+    void recordInventoryChange(const ItemInstance& itemInstance, const bool added)
+    {
+        if (inventoryChanges.size() == MAX_INVENTORY_CHANGES)
+        {
+            inventoryChanges.erase(inventoryChanges.begin());
+        }
+
+        inventoryChanges.push_back({inventoryVersion, itemInstance, added});
+        inventoryVersion = takeInventoryVersion();
+    }
 };
 
 #endif //PLAYER_H
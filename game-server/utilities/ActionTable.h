@@ -0,0 +1,78 @@
+﻿#ifndef ACTIONTABLE_H
+#define ACTIONTABLE_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Finds actions by name through a perfect hash worked out at compile time, so a lookup is one hash
+// and one comparison. Action can be any type with a std::string_view name. Duplicate names, or a
+// set of names no seed can separate, fail to compile.
+template <typename Action, std::size_t N>
+class ActionTable
+{
+public:
+
+    consteval explicit ActionTable(const std::array<Action, N>& actions) : actions(actions)
+    {
+        for (seed = 0; seed < MAX_SEED; seed++)
+        {
+            if (tryPlaceActions()) return;
+        }
+
+        throw "No perfect hash found for these action names";
+    }
+
+    // Returns the action with the given name, or nullptr if there's none.
+    [[nodiscard]] constexpr const Action* find(const std::string_view name) const
+    {
+        const std::uint8_t index = slots[slotOf(name, seed)];
+        if (index == EMPTY || actions[index].name != name) return nullptr;
+
+        return &actions[index];
+    }
+
+private:
+
+    static_assert(N > 0 && N < 0xFF, "An action table holds between 1 and 254 actions");
+
+    static constexpr std::size_t SLOT_COUNT = std::bit_ceil(N * 2);
+    static constexpr std::uint8_t EMPTY = 0xFF;
+    static constexpr std::uint32_t MAX_SEED = 100000;
+
+    static constexpr std::size_t slotOf(const std::string_view name, const std::uint32_t seed)
+    {
+        // FNV-1a, starting from the seed.
+        std::uint32_t hash = 2166136261u ^ seed;
+        for (const char c : name)
+        {
+            hash ^= static_cast<std::uint8_t>(c);
+            hash *= 16777619u;
+        }
+
+        return hash & (SLOT_COUNT - 1);
+    }
+
+    consteval bool tryPlaceActions()
+    {
+        slots.fill(EMPTY);
+
+        for (std::size_t i = 0; i < N; i++)
+        {
+            const std::size_t slot = slotOf(actions[i].name, seed);
+            if (slots[slot] != EMPTY) return false;
+
+            slots[slot] = static_cast<std::uint8_t>(i);
+        }
+
+        return true;
+    }
+
+    std::array<Action, N> actions;
+    std::array<std::uint8_t, SLOT_COUNT> slots {};
+    std::uint32_t seed = 0;
+};
+
+#endif //ACTIONTABLE_H
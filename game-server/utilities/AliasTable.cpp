@@ -0,0 +1,53 @@
+﻿#include "AliasTable.h"
+
+#include <numeric>
+
+AliasTable::AliasTable(const std::vector<double>& weights)
+{
+    const double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+    if (weights.empty() || total <= 0.0) { return; }
+
+    const std::size_t count = weights.size();
+    probabilities.assign(count, 0.0);
+    aliases.assign(count, 0);
+
+    // Scales the weights so that the average column holds exactly 1.
+    std::vector<double> scaled(count);
+    std::vector<std::size_t> small;
+    std::vector<std::size_t> large;
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        scaled[i] = weights[i] * static_cast<double>(count) / total;
+        (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+
+    // Fills each under-full column with the excess of an over-full one.
+    while (!small.empty() && !large.empty())
+    {
+        const std::size_t less = small.back();
+        small.pop_back();
+        const std::size_t more = large.back();
+        large.pop_back();
+
+        probabilities[less] = scaled[less];
+        aliases[less] = more;
+
+        scaled[more] = scaled[more] + scaled[less] - 1.0;
+        (scaled[more] < 1.0 ? small : large).push_back(more);
+    }
+
+    // Whatever remains is full up to rounding errors.
+    for (const std::size_t i : large) { probabilities[i] = 1.0; }
+    for (const std::size_t i : small) { probabilities[i] = 1.0; }
+}
+
+bool AliasTable::empty() const
+{
+    return probabilities.empty();
+}
+
+std::size_t AliasTable::size() const
+{
+    return probabilities.size();
+}
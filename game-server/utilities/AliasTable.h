@@ -0,0 +1,37 @@
+﻿#ifndef ALIASTABLE_H
+#define ALIASTABLE_H
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// Samples from a discrete weighted distribution in constant time (Vose's alias method).
+// Building the table is linear in the number of weights.
+class AliasTable
+{
+public:
+
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<double>& weights);
+
+    // Picks an outcome index, with a probability proportional to its weight.
+    template <typename Generator>
+    std::size_t sample(Generator& generator) const
+    {
+        std::uniform_int_distribution<std::size_t> columnDist(0, probabilities.size() - 1);
+        std::uniform_real_distribution coinDist(0.0, 1.0);
+
+        const std::size_t column = columnDist(generator);
+        return coinDist(generator) < probabilities[column] ? column : aliases[column];
+    }
+
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] std::size_t size() const;
+
+private:
+
+    std::vector<double> probabilities;
+    std::vector<std::size_t> aliases;
+};
+
+#endif //ALIASTABLE_H
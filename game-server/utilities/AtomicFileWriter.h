@@ -0,0 +1,69 @@
+﻿#ifndef ATOMICFILEWRITER_H
+#define ATOMICFILEWRITER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "Compression.h"
+#include "../structs/StatusResponse.h"
+
+// Writes a file under a temporary name and only moves it into place once it's complete and on disk,
+// so a crash in the middle of a write never replaces a good file with a torn one. The file can be
+// written as compressed blocks.
+class AtomicFileWriter
+{
+public:
+
+    // Appends the items in [begin, end) to the output.
+    using ShardSerializer = std::function<void(std::size_t begin, std::size_t end, std::string& output)>;
+
+    explicit AtomicFileWriter(std::string filename);
+
+    // Discards the temporary file unless it was committed.
+    ~AtomicFileWriter();
+
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    // Compresses everything written from now on. Call it before the first write.
+    void setCompression(Compression::Codec codec);
+
+    bool open();
+    bool write(std::string_view data);
+
+    // Serialises the items on several threads, a batch at a time, and writes them out in order.
+    // Anything serialize throws is rethrown here.
+    bool writeInShards(std::size_t itemCount, const ShardSerializer& serialize);
+
+    // Syncs the temporary file and moves it over the target.
+    StatusResponse commit();
+
+    [[nodiscard]] const std::string& getFilename() const;
+
+    // The compression so far. Empty unless a codec is set.
+    [[nodiscard]] const Compression::Stats& getStats() const;
+
+private:
+
+    bool writeToFile(std::string_view data);
+
+    // Compresses the buffered data into blocks and writes them. Only whole blocks are written unless final.
+    bool writePending(bool final);
+
+    void discard();
+
+    std::string filename;
+    std::string temporaryFilename;
+    FILE* file = nullptr;
+    bool failed = false;
+
+    Compression::Codec codec = Compression::Codec::None;
+    std::string pending; // Written data not compressed yet.
+    std::string blocks;
+    Compression::Stats stats;
+};
+
+#endif //ATOMICFILEWRITER_H
@@ -0,0 +1,31 @@
+﻿#ifndef CANNEDRESPONSE_H
+#define CANNEDRESPONSE_H
+
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "WireProtocol.h"
+
+// A reply that never changes, serialised once in every wire format. Sending it formats, copies and
+// allocates nothing, which keeps the error paths cheap however often they're hit.
+class CannedResponse
+{
+public:
+
+    CannedResponse(bool success, std::string_view message);
+
+    // The whole message, framed if the format is binary.
+    [[nodiscard]] std::string_view getMessage(WireProtocol::Format format) const;
+
+    // The response without its frame, for nesting in another message.
+    [[nodiscard]] std::string_view getBody(WireProtocol::Format format) const;
+
+private:
+
+    static constexpr std::size_t FORMAT_COUNT = 3;
+
+    std::array<std::string, FORMAT_COUNT> messages;
+};
+
+#endif //CANNEDRESPONSE_H
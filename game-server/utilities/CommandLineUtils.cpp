@@ -0,0 +1,23 @@
+﻿#include "CommandLineUtils.h"
+
+std::optional<std::string> CommandLineUtils::getOption(const int argc, char* argv[], const std::string& name)
+{
+    const std::string flag = "--" + name;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+
+        if (argument == flag && i + 1 < argc)
+        {
+            return std::string(argv[i + 1]);
+        }
+
+        if (argument.starts_with(flag + "="))
+        {
+            return argument.substr(flag.length() + 1);
+        }
+    }
+
+    return std::nullopt;
+}
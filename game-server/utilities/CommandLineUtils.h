@@ -0,0 +1,15 @@
+﻿#ifndef COMMANDLINEUTILS_H
+#define COMMANDLINEUTILS_H
+
+#include <optional>
+#include <string>
+
+class CommandLineUtils
+{
+public:
+
+    // Gets the value of an option given as '--name value' or '--name=value'.
+    static std::optional<std::string> getOption(int argc, char* argv[], const std::string& name);
+};
+
+#endif //COMMANDLINEUTILS_H
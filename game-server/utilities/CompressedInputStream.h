@@ -0,0 +1,50 @@
+#ifndef COMPRESSEDINPUTSTREAM_H
+#define COMPRESSEDINPUTSTREAM_H
+
+#include <fstream>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+#include "Compression.h"
+
+// Reads a file that may be plain or block-compressed, decompressing one block at a time.
+// A torn or corrupt block ends the stream early and sets hasCorruptBlock().
+class CompressedInputStream : public std::istream
+{
+public:
+
+    explicit CompressedInputStream(const std::string& filename);
+
+    [[nodiscard]] bool is_open() const;
+    [[nodiscard]] bool isCompressed() const;
+    [[nodiscard]] bool hasCorruptBlock() const;
+    [[nodiscard]] const Compression::Stats& getStats() const;
+
+private:
+
+    class BlockBuffer : public std::streambuf
+    {
+    public:
+
+        explicit BlockBuffer(const std::string& filename);
+
+        std::ifstream file;
+        bool compressed = false;
+        bool corrupt = false;
+        Compression::Stats stats;
+
+    protected:
+
+        int_type underflow() override;
+
+    private:
+
+        std::string buffer;
+        std::string block;
+    };
+
+    BlockBuffer blockBuffer;
+};
+
+#endif //COMPRESSEDINPUTSTREAM_H
@@ -0,0 +1,87 @@
+﻿#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Block compression for snapshots and journals. A compressed file is a run of self-describing blocks,
+// each with its own codec and checksum, so plain and compressed data can be told apart and a torn
+// block at the end of a log is detected. zstd and LZ4 are used when the build found them; the
+// built-in LZ77 codec is always available.
+class Compression
+{
+public:
+
+    enum class Codec : std::uint8_t
+    {
+        None = 0,
+        Builtin = 1,
+        Lz4 = 2,
+        Zstd = 3
+    };
+
+    // Bytes in and out of a codec, and the time spent in it.
+    struct Stats
+    {
+        std::uint64_t rawBytes = 0;
+        std::uint64_t storedBytes = 0;
+        std::chrono::nanoseconds codecTime { 0 };
+
+        void add(const Stats& other);
+
+        // Describes the ratio and throughput, e.g. "1048576 -> 262144 bytes (4.00x, 310 MB/s)".
+        [[nodiscard]] std::string describe() const;
+    };
+
+    // What the codecs keep from one block to the next, so a stream of small blocks, such as the
+    // responses on a connection, doesn't pay to set their tables up for each one.
+    struct Context
+    {
+        std::vector<std::uint32_t> builtinTable; // Positions, offset by builtinBase plus one.
+        std::uint32_t builtinBase = 0;
+        std::vector<char> lz4State;
+    };
+
+    // Blocks never hold more than this much uncompressed data.
+    static constexpr std::size_t BLOCK_SIZE = 1024 * 1024;
+    static constexpr std::size_t BLOCK_HEADER_SIZE = 20;
+
+    // Parses a codec name. "auto" picks the best codec available.
+    static std::optional<Codec> parseCodec(const std::string& name);
+    static std::string codecName(Codec codec);
+    static bool isAvailable(Codec codec);
+
+    // Appends one block holding data, at most BLOCK_SIZE bytes. Stored uncompressed if the codec doesn't make it smaller.
+    static void appendBlock(Codec codec, std::string_view data, std::string& output, Stats* stats = nullptr);
+    static void appendBlock(Codec codec, std::string_view data, std::string& output, Context& context, Stats* stats = nullptr);
+
+    // Appends lines of a log as blocks, split between lines so no line straddles two blocks.
+    // A line too long for a block is appended as it is.
+    static void appendLineBlocks(Codec codec, std::string_view lines, std::string& output, Stats* stats = nullptr);
+
+    // Checks whether data starts with a block.
+    static bool isBlock(std::string_view data);
+
+    // Works out the size of a whole block from its header, or returns 0 if it isn't a sane block header.
+    static std::size_t blockSizeFromHeader(std::string_view header);
+
+    // Reads the block at the start of data, appending its contents to output.
+    // Returns the number of bytes the block took up, or 0 if it's torn or corrupt.
+    static std::size_t readBlock(std::string_view data, std::string& output, Stats* stats = nullptr);
+
+    // Decodes a whole file held in memory, which may be plain or made of blocks.
+    static bool decodeFile(std::string_view data, std::string& output, Stats* stats = nullptr);
+
+    // Reads a log of lines, where each write may have been a compressed block holding several lines.
+    // onLine gets every whole line and returns false to stop. Returns how many bytes of the file were
+    // read up to the last line accepted, counting a missing final line break as one byte.
+    static std::uintmax_t readLogLines(std::istream& file, const std::function<bool(std::string_view line)>& onLine);
+};
+
+#endif //COMPRESSION_H
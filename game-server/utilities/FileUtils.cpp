@@ -0,0 +1,52 @@
+﻿#include "FileUtils.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool FileUtils::syncFile(FILE* file)
+{
+    if (fflush(file) != 0) return false;
+
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+StatusResponse FileUtils::replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    // Write-through only returns once the move is on disk.
+    if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        return { false, "Could not replace " + to + " (error " + std::to_string(GetLastError()) + ")" };
+    }
+#else
+    std::error_code error;
+    std::filesystem::rename(from, to, error);
+    if (error)
+    {
+        return { false, "Could not replace " + to + ": " + error.message() };
+    }
+
+    // The rename lives in the directory, which has to be synced too.
+    std::string directory = std::filesystem::path(to).parent_path().string();
+    if (directory.empty()) directory = ".";
+
+    if (const int directoryDescriptor = ::open(directory.c_str(), O_RDONLY); directoryDescriptor >= 0)
+    {
+        fsync(directoryDescriptor);
+        ::close(directoryDescriptor);
+    }
+#endif
+
+    return { true, "Replaced " + to };
+}
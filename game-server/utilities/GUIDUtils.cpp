@@ -1,9 +1,13 @@
 ﻿#include "GUIDUtils.h"
 
-GUID GUIDUtils::stringToGUID(const std::string& str)
+GUID GUIDUtils::stringToGUID(const std::string_view str)
 {
+    // sscanf needs a terminated string, so the text is copied into a buffer first.
+    char buffer[STRING_LENGTH + 1] = {};
+    str.copy(buffer, STRING_LENGTH);
+
     GUID guid = {};
-    sscanf_s(str.c_str(),
+    sscanf_s(buffer,
              "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
              &guid.Data1, &guid.Data2, &guid.Data3,
              &guid.Data4[0], &guid.Data4[1], &guid.Data4[2], &guid.Data4[3],
@@ -13,13 +17,39 @@ GUID GUIDUtils::stringToGUID(const std::string& str)
 
 std::string GUIDUtils::GUIDToString(const GUID& guid)
 {
-    char guidStr[40];
-    sprintf_s(guidStr, sizeof(guidStr),
+    char guidStr[STRING_LENGTH + 1];
+    GUIDToChars(guid, guidStr);
+
+    return guidStr;
+}
+
+void GUIDUtils::GUIDToChars(const GUID& guid, char (&buffer)[STRING_LENGTH + 1])
+{
+    sprintf_s(buffer, sizeof(buffer),
         "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
         guid.Data1, guid.Data2, guid.Data3,
         guid.Data4[0], guid.Data4[1], guid.Data4[2],
         guid.Data4[3], guid.Data4[4], guid.Data4[5],
         guid.Data4[6], guid.Data4[7]);
+}
 
-    return guidStr;
+void GUIDUtils::GUIDToBytes(const GUID& guid, std::uint8_t* bytes)
+{
+    const auto data1 = static_cast<std::uint32_t>(guid.Data1);
+    for (int i = 0; i < 4; ++i) { bytes[i] = static_cast<std::uint8_t>(data1 >> (8 * i)); }
+    for (int i = 0; i < 2; ++i) { bytes[4 + i] = static_cast<std::uint8_t>(guid.Data2 >> (8 * i)); }
+    for (int i = 0; i < 2; ++i) { bytes[6 + i] = static_cast<std::uint8_t>(guid.Data3 >> (8 * i)); }
+    for (int i = 0; i < 8; ++i) { bytes[8 + i] = guid.Data4[i]; }
+}
+
+GUID GUIDUtils::bytesToGUID(const std::uint8_t* bytes)
+{
+    GUID guid = {};
+    std::uint32_t data1 = 0;
+    for (int i = 0; i < 4; ++i) { data1 |= static_cast<std::uint32_t>(bytes[i]) << (8 * i); }
+    guid.Data1 = data1;
+    guid.Data2 = static_cast<unsigned short>(bytes[4] | bytes[5] << 8);
+    guid.Data3 = static_cast<unsigned short>(bytes[6] | bytes[7] << 8);
+    for (int i = 0; i < 8; ++i) { guid.Data4[i] = bytes[8 + i]; }
+    return guid;
 }
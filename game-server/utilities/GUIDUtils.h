@@ -1,15 +1,27 @@
 ﻿#ifndef GUIDUTILS_H
 #define GUIDUTILS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <rpc.h>
 
 class GUIDUtils
 {
 public:
 
-    static GUID stringToGUID(const std::string& str);
+    static constexpr std::size_t STRING_LENGTH = 36;
+
+    static GUID stringToGUID(std::string_view str);
     static std::string GUIDToString(const GUID& guid);
+
+    // Formats a GUID into a buffer without allocating. The buffer is null-terminated.
+    static void GUIDToChars(const GUID& guid, char (&buffer)[STRING_LENGTH + 1]);
+
+    // Converts to and from 16 bytes in a fixed little-endian layout, for binary files.
+    static void GUIDToBytes(const GUID& guid, std::uint8_t* bytes);
+    static GUID bytesToGUID(const std::uint8_t* bytes);
 };
 
 #endif //GUIDUTILS_H
@@ -0,0 +1,167 @@
+﻿#include "JsonArrayReader.h"
+
+JsonArrayReader::JsonArrayReader(ElementCallback onElement) : onElement(std::move(onElement))
+{
+}
+
+bool JsonArrayReader::read(std::istream& stream)
+{
+    return json::sax_parse(stream, this) && error.empty();
+}
+
+const std::string& JsonArrayReader::getError() const
+{
+    return error;
+}
+
+bool JsonArrayReader::null()
+{
+    return addValue(nullptr);
+}
+
+bool JsonArrayReader::boolean(const bool value)
+{
+    return addValue(value);
+}
+
+bool JsonArrayReader::number_integer(const number_integer_t value)
+{
+    return addValue(value);
+}
+
+bool JsonArrayReader::number_unsigned(const number_unsigned_t value)
+{
+    return addValue(value);
+}
+
+bool JsonArrayReader::number_float(const number_float_t value, const string_t&)
+{
+    return addValue(value);
+}
+
+bool JsonArrayReader::string(string_t& value)
+{
+    return addValue(std::move(value));
+}
+
+bool JsonArrayReader::binary(binary_t& value)
+{
+    return addValue(json::binary(std::move(value)));
+}
+
+bool JsonArrayReader::start_object(std::size_t)
+{
+    return startContainer(json::object());
+}
+
+bool JsonArrayReader::key(string_t& value)
+{
+    pendingKey = std::move(value);
+    return true;
+}
+
+bool JsonArrayReader::end_object()
+{
+    endContainer();
+    return true;
+}
+
+bool JsonArrayReader::start_array(std::size_t)
+{
+    if (!rootSeen)
+    {
+        rootSeen = true;
+        insideRootArray = true;
+        return true;
+    }
+
+    return startContainer(json::array());
+}
+
+bool JsonArrayReader::end_array()
+{
+    if (openContainers.empty())
+    {
+        insideRootArray = false;
+        return true;
+    }
+
+    endContainer();
+    return true;
+}
+
+bool JsonArrayReader::parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& exception)
+{
+    error = exception.what();
+    return false;
+}
+
+bool JsonArrayReader::addValue(json&& value)
+{
+    if (!insideRootArray)
+    {
+        error = "Invalid JSON format: expected array";
+        return false;
+    }
+
+    if (openContainers.empty())
+    {
+        onElement(value);
+        return true;
+    }
+
+    json& container = *openContainers.back();
+    if (container.is_array())
+    {
+        container.push_back(std::move(value));
+    }
+    else
+    {
+        container[pendingKey] = std::move(value);
+    }
+
+    return true;
+}
+
+bool JsonArrayReader::startContainer(json&& container)
+{
+    if (!insideRootArray)
+    {
+        error = "Invalid JSON format: expected array";
+        return false;
+    }
+
+    if (openContainers.empty())
+    {
+        element = std::move(container);
+        openContainers.push_back(&element);
+        return true;
+    }
+
+    // Only the ancestors of the new container are kept, and they don't move while it's filled in.
+    json& parent = *openContainers.back();
+    if (parent.is_array())
+    {
+        parent.push_back(std::move(container));
+        openContainers.push_back(&parent.back());
+    }
+    else
+    {
+        json& child = parent[pendingKey];
+        child = std::move(container);
+        openContainers.push_back(&child);
+    }
+
+    return true;
+}
+
+void JsonArrayReader::endContainer()
+{
+    openContainers.pop_back();
+
+    if (openContainers.empty())
+    {
+        onElement(element);
+        element = nullptr;
+    }
+}
@@ -0,0 +1,62 @@
+﻿#ifndef JSONARRAYREADER_H
+#define JSONARRAYREADER_H
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// A SAX handler for files holding one top-level array. Each element is built on its own and handed
+// to the callback as soon as it's complete, so only one element is ever held in memory.
+class JsonArrayReader : public nlohmann::json_sax<json>
+{
+public:
+
+    using ElementCallback = std::function<void(json& element)>;
+
+    explicit JsonArrayReader(ElementCallback onElement);
+
+    // Reads the whole stream. Returns false if it isn't valid JSON or isn't an array.
+    bool read(std::istream& stream);
+
+    [[nodiscard]] const std::string& getError() const;
+
+    bool null() override;
+    bool boolean(bool value) override;
+    bool number_integer(number_integer_t value) override;
+    bool number_unsigned(number_unsigned_t value) override;
+    bool number_float(number_float_t value, const string_t& text) override;
+    bool string(string_t& value) override;
+    bool binary(binary_t& value) override;
+    bool start_object(std::size_t elements) override;
+    bool key(string_t& value) override;
+    bool end_object() override;
+    bool start_array(std::size_t elements) override;
+    bool end_array() override;
+    bool parse_error(std::size_t position, const std::string& lastToken, const nlohmann::detail::exception& exception) override;
+
+private:
+
+    // Adds a value to the open container, or hands it over if it's a whole element.
+    bool addValue(json&& value);
+
+    // Opens a container inside the current element.
+    bool startContainer(json&& container);
+
+    // Closes the innermost container, handing the element over once it's complete.
+    void endContainer();
+
+    ElementCallback onElement;
+    json element;
+    std::vector<json*> openContainers; // The containers of the current element that are still being read.
+    std::string pendingKey;
+    bool insideRootArray = false;
+    bool rootSeen = false;
+    std::string error;
+};
+
+#endif //JSONARRAYREADER_H
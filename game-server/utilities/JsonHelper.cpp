@@ -1,68 +1,134 @@
 ﻿#include "JsonHelper.h"
+#include "AtomicFileWriter.h"
+#include "CompressedInputStream.h"
+#include "JsonArrayReader.h"
+#include "RequestParser.h"
+#include <array>
 #include <fstream>
 #include <iostream>
+#include <limits>
 
-JsonMessage JsonHelper::parseMessage(const std::string& jsonStr)
+JsonMessage JsonHelper::parseMessage(std::string& message, const WireProtocol::Format format)
 {
     JsonMessage msg;
 
-    try
+    if (format == WireProtocol::Format::Json && RequestParser::parse(message, msg))
     {
-        const json j = json::parse(jsonStr);
+        return msg;
+    }
+
+    // Anything the fast parser can't read is decoded in full. The values are copied over the
+    // message, so the fields can point into it the same way. A batch's steps follow the request's own.
+    msg = JsonMessage();
+    std::vector<std::string> values;
 
-        msg.action = j.value("action", "");
-        msg.authToken = j.value("token", "");
-        msg.username = j.value("username", "");
-        msg.itemId = j.value("itemId", "");
-        msg.targetUser = j.value("targetUser", "");
-        msg.newType = j.value("newType", "");
-        msg.message = j.value("message", "");
-        msg.success = j.value("success", false);
+    try
+    {
+        const json j = WireProtocol::decode(message, format);
+        readMessageFields(j, msg, values);
 
+        if (const auto stepsIt = j.find(JSON_MESSAGE_ACTIONS_KEY); stepsIt != j.end() && stepsIt->is_array())
+        {
+            for (const json& step : *stepsIt)
+            {
+                JsonMessage stepMessage;
+                readMessageFields(step, stepMessage, values);
+                msg.actions.push_back(stepMessage);
+            }
+        }
     }
-    catch (const json::parse_error& e)
+    catch (const json::exception& e)
     {
-        std::cout << "JSON parse error: " << e.what() << std::endl;
+        std::cout << "Message parse error: " << e.what() << std::endl;
+
+        // A malformed batch runs none of its steps.
+        msg.actions.clear();
+        values.resize(JSON_MESSAGE_TEXT_FIELDS.size());
     }
 
+    message.clear();
+    for (const std::string& value : values) { message += value; }
+
+    std::size_t offset = 0;
+    std::size_t index = 0;
+    const auto pointFields = [&message, &values, &offset, &index](JsonMessage& target)
+    {
+        for (const auto& [key, field] : JSON_MESSAGE_TEXT_FIELDS)
+        {
+            target.*field = std::string_view(message).substr(offset, values[index].size());
+            offset += values[index++].size();
+        }
+    };
+
+    pointFields(msg);
+    for (JsonMessage& step : msg.actions) { pointFields(step); }
+
     return msg;
 }
 
-std::string JsonHelper::createResponse(bool success, const std::string& message, const json& data)
+void JsonHelper::readMessageFields(const json& j, JsonMessage& msg, std::vector<std::string>& values)
 {
-    json response;
-    response["success"] = success;
-    response["message"] = message;
+    std::array<std::string, JSON_MESSAGE_TEXT_FIELDS.size()> texts;
+    for (std::size_t i = 0; i < JSON_MESSAGE_TEXT_FIELDS.size(); i++)
+    {
+        texts[i] = j.value(JSON_MESSAGE_TEXT_FIELDS[i].first, "");
+    }
 
-    if (!data.empty()) { response["data"] = data; }
-    return response.dump();
+    for (const auto& [key, field] : JSON_MESSAGE_FLAG_FIELDS)
+    {
+        msg.*field = j.value(key, false);
+    }
+
+    for (const auto& [key, field] : JSON_MESSAGE_NUMBER_FIELDS)
+    {
+        msg.*field = j.value(key, std::uint64_t{0});
+    }
+
+    // The values are only kept once they've all been read.
+    values.insert(values.end(), std::make_move_iterator(texts.begin()), std::make_move_iterator(texts.end()));
 }
 
-json JsonHelper::itemToJson(const ItemInstance& itemInstance)
+void JsonHelper::writeItem(ResponseWriter& response, const ItemInstance& itemInstance, const ItemCatalog& catalog)
+{
+    const Item& item = catalog.get(itemInstance);
+    char id[GUIDUtils::STRING_LENGTH + 1];
+    GUIDUtils::GUIDToChars(itemInstance.id, id);
+
+    response.field("id", std::string_view(id, GUIDUtils::STRING_LENGTH))
+        .field("type", item.type)
+        .field("name", item.name)
+        .field("weight", item.weight)
+        .field("value", item.value);
+}
+
+json JsonHelper::inventoryEntryToJson(const ItemInstance& itemInstance)
 {
     json j;
 
     j["id"] = GUIDUtils::GUIDToString(itemInstance.id);
-    j["type"] = itemInstance.item.type;
-    j["name"] = itemInstance.item.name;
-    j["weight"] = itemInstance.item.weight;
-    j["value"] = itemInstance.item.value;
+    j["catalog_index"] = itemInstance.catalogIndex;
 
     return j;
 }
 
-ItemInstance JsonHelper::jsonToItem(const json& j)
+std::optional<ItemInstance> JsonHelper::jsonToInventoryEntry(const json& j)
 {
-    Item item;
+    const GUID id = GUIDUtils::stringToGUID(j.value("id", ""));
+    const std::shared_ptr<const ItemCatalog> catalog = ItemCatalog::current();
+
+    if (j.contains("catalog_index"))
+    {
+        const auto catalogIndex = j["catalog_index"].get<ItemCatalog::Index>();
+        if (!catalog->contains(catalogIndex)) { return std::nullopt; }
+
+        return ItemInstance(catalogIndex, id);
+    }
 
-    item.type = j.value("type", "");
-    item.name = j.value("name", "");
-    item.weight = j.value("weight", 0);
-    item.value = j.value("value", 0.0f);
-    const std::string guidStr = j.value("id", "");
+    // Older data files store the whole item, so it is matched by name instead.
+    const std::optional<ItemCatalog::Index> catalogIndex = catalog->findByName(j.value("name", ""));
+    if (!catalogIndex.has_value()) { return std::nullopt; }
 
-    ItemInstance itemInstance(item, GUIDUtils::stringToGUID(guidStr));
-    return itemInstance;
+    return ItemInstance(catalogIndex.value(), id);
 }
 
 json JsonHelper::playerToJson(const Player& player)
@@ -76,7 +142,7 @@ json JsonHelper::playerToJson(const Player& player)
     j["inventory"] = json::array();
     for (const auto& itemInstance : player.inventory)
     {
-        j["inventory"].push_back(itemToJson(itemInstance));
+        j["inventory"].push_back(inventoryEntryToJson(itemInstance));
     }
 
     return j;
@@ -94,17 +160,25 @@ Player JsonHelper::jsonToPlayer(const json& j)
     {
         for (const auto& itemJson : j["inventory"])
         {
-            ItemInstance itemInstance = jsonToItem(itemJson);
-            player.collectItem(itemInstance);
+            if (const std::optional<ItemInstance> itemInstance = jsonToInventoryEntry(itemJson); itemInstance.has_value())
+            {
+                // Loading isn't a change to the inventory, so it doesn't go through collectItem.
+                player.inventory.push_back(itemInstance.value());
+            }
+            else
+            {
+                std::cout << "Skipping unknown item in the inventory of " << player.username << std::endl;
+            }
         }
     }
 
     return player;
 }
 
-StatusResponse JsonHelper::loadGameDataFromFile(const std::string& filename, std::map<std::string, Player>& players)
+StatusResponse JsonHelper::loadGameDataFromFile(const std::string& filename, std::map<std::string, Player, std::less<>>& players)
 {
-    std::ifstream file(filename);
+    // The file may have been exported compressed.
+    CompressedInputStream file(filename);
 
     if (!file.is_open())
     {
@@ -113,72 +187,253 @@ StatusResponse JsonHelper::loadGameDataFromFile(const std::string& filename, std
 
     try
     {
-        json j;
-        file >> j;
-        file.close();
-
         players.clear();
 
-        if (!j.is_array())
-        {
-            return { false, "Invalid JSON format: expected array" };
-        }
-
-        for (const auto& playerJson : j)
+        // Builds each player as soon as it has been read, rather than parsing the whole file first.
+        JsonArrayReader reader([&players](const json& playerJson)
         {
-            if (playerJson.is_null() || !playerJson.is_object())
-            {
-                continue;
-            }
+            if (!playerJson.is_object()) return;
 
             try
             {
                 if (Player player = jsonToPlayer(playerJson); !player.username.empty())
                 {
-                    players[player.username] = player;
+                    std::string username = player.username;
+                    players.insert_or_assign(std::move(username), std::move(player));
                 }
             }
             catch (const std::exception& e)
             {
                 std::cout << e.what() << std::endl;
             }
+        });
+
+        const bool parsed = reader.read(file);
+
+        // A corrupt block cuts the stream short, which the reader would only see as a parse error.
+        if (file.hasCorruptBlock())
+        {
+            players.clear();
+            return { false, "Error loading game data file: corrupt compressed block" };
         }
 
-        return { true, "Loaded " + std::to_string(players.size()) + " players from file" };
-    }
-    catch (const json::parse_error& e)
-    {
-        return { false, "Error parsing game data file: " + std::string(e.what()) };
+        if (!parsed)
+        {
+            players.clear();
+            return { false, "Error parsing game data file: " + reader.getError() };
+        }
+
+        const std::string decompression = file.isCompressed() ? ", decompressed " + file.getStats().describe() : "";
+        return { true, "Loaded " + std::to_string(players.size()) + " players from file" + decompression };
     }
     catch (const std::exception& e)
     {
+        players.clear();
         return { false, "Error loading game data file: " + std::string(e.what()) };
     }
 }
 
-StatusResponse JsonHelper::saveGameDataToFile(const std::string& filename, const std::map<std::string, Player>& players)
+StatusResponse JsonHelper::saveGameDataToFile(const std::string& filename, const std::map<std::string, Player, std::less<>>& players,
+                                              const Compression::Codec codec)
 {
     try
     {
-        json j = json::array();
-        for (const auto& player : players | std::views::values)
+        AtomicFileWriter file(filename);
+        file.setCompression(codec);
+        if (!file.open())
         {
-            j.push_back(playerToJson(player));
+            return { false, "Error: Could not save players to file!" };
         }
 
-        std::ofstream file(filename);
-        if (!file.is_open())
+        std::vector<const Player*> orderedPlayers;
+        orderedPlayers.reserve(players.size());
+        for (const Player& player : players | std::views::values) { orderedPlayers.push_back(&player); }
+
+        // Only one batch of players is serialised at a time, so the whole array is never built in memory.
+        file.write("[");
+        file.writeInShards(orderedPlayers.size(), [&orderedPlayers](const std::size_t begin, const std::size_t end, std::string& output)
         {
-            return { false, "Error: Could not save players to file!" };
-        }
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                output += i == 0 ? "\n" : ",\n";
+                output += playerToJson(*orderedPlayers[i]).dump(2);
+            }
+        });
+        file.write(orderedPlayers.empty() ? "]" : "\n]");
 
-        file << j.dump(2);
-        file.close();
+        if (const StatusResponse status = file.commit(); !status.success)
+        {
+            return { false, "Error: Could not save players to file! " + status.message };
+        }
 
-        return { true, "Saved " + std::to_string(players.size()) + " players to file" };
+        const std::string compression = codec == Compression::Codec::None
+            ? ""
+            : ", " + Compression::codecName(codec) + " " + file.getStats().describe();
+        return { true, "Saved " + std::to_string(players.size()) + " players to file" + compression };
     }
     catch (const std::exception& e)
     {
         return { false, "Error saving players: " + std::string(e.what()) };
     }
 }
+
+StatusResponse JsonHelper::loadItemCatalogFromFile(const std::string& filename, std::vector<std::optional<Item>>& items,
+                                                   std::set<ItemCatalog::Index>& retiredIndices, std::map<PlayerType, LootTable>& lootTables)
+{
+    std::ifstream file(filename);
+
+    if (!file.is_open())
+    {
+        return { false, "Could not open the item catalog file " + filename };
+    }
+
+    try
+    {
+        json j;
+        file >> j;
+        file.close();
+
+        if (!j.is_object() || !j.contains("items") || !j["items"].is_array())
+        {
+            return { false, "Invalid item catalog format: expected an 'items' array" };
+        }
+
+        items.clear();
+        retiredIndices.clear();
+
+        for (const auto& itemJson : j["items"])
+        {
+            const int index = itemJson.value("index", -1);
+            if (index < 0 || index > std::numeric_limits<ItemCatalog::Index>::max())
+            {
+                return { false, "Invalid item catalog index: " + std::to_string(index) };
+            }
+
+            if (static_cast<std::size_t>(index) >= items.size())
+            {
+                items.resize(index + 1);
+            }
+
+            if (items[index].has_value())
+            {
+                return { false, "Duplicate item catalog index: " + std::to_string(index) };
+            }
+
+            items[index] = Item(
+                itemJson.value("type", ""),
+                itemJson.value("name", ""),
+                itemJson.value("weight", 0),
+                itemJson.value("value", 0.0f));
+
+            if (itemJson.value("retired", false)) { retiredIndices.insert(static_cast<ItemCatalog::Index>(index)); }
+        }
+
+        lootTables.clear();
+
+        if (j.contains("loot_tables") && j["loot_tables"].is_object())
+        {
+            for (const auto& [typeName, tableJson] : j["loot_tables"].items())
+            {
+                const std::optional<PlayerType> playerType = stringToPlayerType(typeName);
+                if (!playerType.has_value())
+                {
+                    return { false, "Unknown player type in loot tables: " + typeName };
+                }
+
+                const float moneyWeight = tableJson.value("money_weight", 0.0f);
+                const float moneyMin = tableJson.value("money_min", 15.0f);
+                const float moneyMax = tableJson.value("money_max", 75.0f);
+                if (moneyWeight < 0.0f || moneyMin < 0.0f || moneyMax < moneyMin)
+                {
+                    return { false, "Invalid money settings in the " + typeName + " loot table" };
+                }
+
+                std::vector<std::uint16_t> itemIndices;
+                std::vector<float> itemWeights;
+
+                if (tableJson.contains("items") && tableJson["items"].is_array())
+                {
+                    for (const auto& entryJson : tableJson["items"])
+                    {
+                        const float weight = entryJson.value("weight", 0.0f);
+                        if (weight < 0.0f)
+                        {
+                            return { false, "Negative item weight in the " + typeName + " loot table" };
+                        }
+
+                        const int index = entryJson.value("index", -1);
+                        if (index < 0 || index > std::numeric_limits<ItemCatalog::Index>::max())
+                        {
+                            return { false, "Invalid item index in the " + typeName + " loot table: " + std::to_string(index) };
+                        }
+
+                        itemIndices.push_back(static_cast<ItemCatalog::Index>(index));
+                        itemWeights.push_back(weight);
+                    }
+                }
+
+                lootTables[playerType.value()] = LootTable(
+                    moneyWeight, moneyMin, moneyMax,
+                    std::move(itemIndices), std::move(itemWeights));
+            }
+        }
+
+        return { true, "Loaded " + std::to_string(j["items"].size()) + " item definitions" };
+    }
+    catch (const json::exception& e)
+    {
+        return { false, "Error parsing item catalog file: " + std::string(e.what()) };
+    }
+}
+
+StatusResponse JsonHelper::saveItemCatalogToFile(const std::string& filename, const std::vector<std::optional<Item>>& items,
+                                                 const std::set<ItemCatalog::Index>& retiredIndices,
+                                                 const std::map<PlayerType, LootTable>& lootTables)
+{
+    json j;
+    j["items"] = json::array();
+
+    for (std::size_t i = 0; i < items.size(); i++)
+    {
+        if (!items[i].has_value()) { continue; }
+
+        json itemJson;
+        itemJson["index"] = i;
+        itemJson["type"] = items[i]->type;
+        itemJson["name"] = items[i]->name;
+        itemJson["weight"] = items[i]->weight;
+        itemJson["value"] = items[i]->value;
+        if (retiredIndices.contains(static_cast<ItemCatalog::Index>(i))) { itemJson["retired"] = true; }
+
+        j["items"].push_back(itemJson);
+    }
+
+    if (!lootTables.empty())
+    {
+        j["loot_tables"] = json::object();
+
+        for (const auto& [playerType, lootTable] : lootTables)
+        {
+            json tableJson;
+            tableJson["money_weight"] = lootTable.moneyWeight;
+            tableJson["money_min"] = lootTable.moneyMin;
+            tableJson["money_max"] = lootTable.moneyMax;
+            tableJson["items"] = json::array();
+
+            for (std::size_t i = 0; i < lootTable.itemIndices.size(); i++)
+            {
+                tableJson["items"].push_back({ {"index", lootTable.itemIndices[i]}, {"weight", lootTable.itemWeights[i]} });
+            }
+
+            j["loot_tables"][playerTypeToString(playerType)] = tableJson;
+        }
+    }
+
+    AtomicFileWriter file(filename);
+    if (!file.open() || !file.write(j.dump(2)) || !file.commit().success)
+    {
+        return { false, "Error: Could not save the item catalog to " + filename };
+    }
+
+    return { true, "Saved " + std::to_string(j["items"].size()) + " item definitions" };
+}
@@ -2,12 +2,20 @@
 #define JSONHELPER_H
 
 #include <map>
+#include <optional>
+#include <set>
+#include <vector>
 #include <nlohmann/json.hpp>
 
+#include "../ItemCatalog.h"
 #include "../structs/JsonMessage.h"
 #include "../structs/Item.h"
+#include "../structs/LootTable.h"
 #include "../structs/Player.h"
 #include "../structs/StatusResponse.h"
+#include "Compression.h"
+#include "ResponseWriter.h"
+#include "WireProtocol.h"
 
 using json = nlohmann::json;
 
@@ -15,17 +23,18 @@ class JsonHelper
 {
 public:
 
-    // Parses an incoming message.
-    static JsonMessage parseMessage(const std::string& jsonStr);
+    // Parses an incoming message in the connection's format. The fields point into message, which
+    // is overwritten with their values if the request had to be decoded in full.
+    static JsonMessage parseMessage(std::string& message, WireProtocol::Format format = WireProtocol::Format::Json);
 
-    // Creates a response.
-    static std::string createResponse(bool success, const std::string& message, const json& data = json::object());
+    // Writes an item's fields into the object the response has open.
+    static void writeItem(ResponseWriter& response, const ItemInstance& item, const ItemCatalog& catalog);
 
-    // Converts Item to JSON.
-    static json itemToJson(const ItemInstance& item);
+    // Converts an inventory entry to its compact JSON form for storage.
+    static json inventoryEntryToJson(const ItemInstance& item);
 
-    // Converts JSON to Item.
-    static ItemInstance jsonToItem(const json& j);
+    // Converts a stored inventory entry back to an item instance.
+    static std::optional<ItemInstance> jsonToInventoryEntry(const json& j);
 
     // Converts Player to JSON.
     static json playerToJson(const Player& player);
@@ -33,11 +42,27 @@ public:
     // Converts JSON to Player.
     static Player jsonToPlayer(const json& j);
 
-    // Loads game data from a file.
-    static StatusResponse loadGameDataFromFile(const std::string& filename, std::map<std::string, Player>& players);
+    // Loads game data from a file, which may be compressed.
+    static StatusResponse loadGameDataFromFile(const std::string& filename, std::map<std::string, Player, std::less<>>& players);
 
     // Saves game data to a file.
-    static StatusResponse saveGameDataToFile(const std::string& filename, const std::map<std::string, Player>& players);
+    static StatusResponse saveGameDataToFile(const std::string& filename, const std::map<std::string, Player, std::less<>>& players,
+                                             Compression::Codec codec = Compression::Codec::None);
+
+    // Loads the item definitions and loot tables from a file. Each item is placed at its catalog index.
+    // Retired items are still defined, for the players who own them, but no longer found.
+    static StatusResponse loadItemCatalogFromFile(const std::string& filename, std::vector<std::optional<Item>>& items,
+                                                  std::set<ItemCatalog::Index>& retiredIndices, std::map<PlayerType, LootTable>& lootTables);
+
+    // Saves the item definitions, and the loot tables if there are any, to a file.
+    static StatusResponse saveItemCatalogToFile(const std::string& filename, const std::vector<std::optional<Item>>& items,
+                                                const std::set<ItemCatalog::Index>& retiredIndices = {},
+                                                const std::map<PlayerType, LootTable>& lootTables = {});
+
+private:
+
+    // Reads a decoded request's flags and numbers into msg, appending its text values to values.
+    static void readMessageFields(const json& j, JsonMessage& msg, std::vector<std::string>& values);
 };
 
 #endif //JSONHELPER_H
@@ -0,0 +1,136 @@
+﻿#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+#ifdef _WIN32
+    const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    viewSize = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    fileDescriptor = ::open(filename.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) return false;
+
+    struct stat fileStat{};
+    if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close();
+        return false;
+    }
+
+    void* mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mapped == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    view = static_cast<const char*>(mapped);
+    viewSize = static_cast<std::size_t>(fileStat.st_size);
+#endif
+
+    // A compressed file is decoded into memory once and read from there instead.
+    if (Compression::isBlock({ view, viewSize }))
+    {
+        std::string contents;
+        Compression::Stats stats;
+        const bool decoded = Compression::decodeFile({ view, viewSize }, contents, &stats);
+
+        close();
+        if (!decoded || contents.empty()) return false;
+
+        decodedContents = std::move(contents);
+        decodeStats = stats;
+        view = decodedContents.data();
+        viewSize = decodedContents.size();
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (decodeStats.has_value())
+    {
+        decodedContents = std::string();
+        decodeStats.reset();
+        view = nullptr;
+        viewSize = 0;
+        return;
+    }
+
+#ifdef _WIN32
+    if (view != nullptr) { UnmapViewOfFile(view); }
+    if (mappingHandle != nullptr) { CloseHandle(mappingHandle); }
+    if (fileHandle != nullptr) { CloseHandle(fileHandle); }
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (view != nullptr) { munmap(const_cast<char*>(view), viewSize); }
+    if (fileDescriptor >= 0) { ::close(fileDescriptor); }
+    fileDescriptor = -1;
+#endif
+
+    view = nullptr;
+    viewSize = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+    return view != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+    return view;
+}
+
+std::size_t MappedFile::size() const
+{
+    return viewSize;
+}
+
+const std::optional<Compression::Stats>& MappedFile::getDecodeStats() const
+{
+    return decodeStats;
+}
@@ -0,0 +1,48 @@
+﻿#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include "Compression.h"
+
+// A read-only view of a whole file mapped into memory. A block-compressed file is decoded into
+// memory instead, behind the same view.
+class MappedFile
+{
+public:
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps a file. Any previously mapped file is released first.
+    bool open(const std::string& filename);
+    void close();
+
+    [[nodiscard]] bool isOpen() const;
+    [[nodiscard]] const char* data() const;
+    [[nodiscard]] std::size_t size() const;
+
+    // How the file was decompressed, if it was compressed.
+    [[nodiscard]] const std::optional<Compression::Stats>& getDecodeStats() const;
+
+private:
+
+    const char* view = nullptr;
+    std::size_t viewSize = 0;
+    std::string decodedContents;
+    std::optional<Compression::Stats> decodeStats;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
+
+#endif //MAPPEDFILE_H
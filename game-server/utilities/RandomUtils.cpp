@@ -0,0 +1,83 @@
+﻿#include "RandomUtils.h"
+
+#include <atomic>
+
+namespace
+{
+    std::atomic<std::uint64_t> rootSeed{0};
+
+    // Streams of threads that were never seeded explicitly, kept apart from the client ids.
+    std::atomic<std::uint64_t> nextUnseededStream{1ULL << 32};
+
+    // Spreads a seed over the whole state (splitmix64).
+    std::uint64_t splitMix(std::uint64_t& x)
+    {
+        std::uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t rotateLeft(const std::uint64_t x, const int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    struct ThreadGenerator
+    {
+        Xoshiro256 generator;
+        bool seeded = false;
+    };
+
+    thread_local ThreadGenerator threadGenerator;
+}
+
+Xoshiro256::Xoshiro256(std::uint64_t seed)
+{
+    for (std::uint64_t& word : state)
+    {
+        word = splitMix(seed);
+    }
+}
+
+Xoshiro256::result_type Xoshiro256::operator()()
+{
+    const std::uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+    const std::uint64_t t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotateLeft(state[3], 45);
+
+    return result;
+}
+
+void RandomUtils::setRootSeed(const std::uint64_t seed)
+{
+    rootSeed.store(seed);
+}
+
+std::uint64_t RandomUtils::getRootSeed()
+{
+    return rootSeed.load();
+}
+
+void RandomUtils::seedThread(const std::uint64_t stream)
+{
+    std::uint64_t mixer = rootSeed.load() ^ (stream * 0xD1B54A32D192ED03ULL);
+    threadGenerator.generator = Xoshiro256(splitMix(mixer));
+    threadGenerator.seeded = true;
+}
+
+Xoshiro256& RandomUtils::generator()
+{
+    if (!threadGenerator.seeded)
+    {
+        seedThread(nextUnseededStream.fetch_add(1));
+    }
+
+    return threadGenerator.generator;
+}
@@ -0,0 +1,207 @@
+﻿#include "RequestParser.h"
+#include "StructuralScanner.h"
+
+#include <charconv>
+
+bool RequestParser::parse(const std::string_view text, JsonMessage& msg)
+{
+    std::size_t position = 0;
+
+    skipWhitespace(text, position);
+    if (!readObject(text, position, msg, true)) return false;
+
+    skipWhitespace(text, position);
+    return position == text.size();
+}
+
+bool RequestParser::readObject(const std::string_view text, std::size_t& position, JsonMessage& msg, const bool allowSteps)
+{
+    if (position >= text.size() || text[position] != '{') return false;
+    position++;
+
+    skipWhitespace(text, position);
+    if (position < text.size() && text[position] == '}')
+    {
+        position++;
+    }
+    else
+    {
+        while (true)
+        {
+            std::string_view key;
+            if (!readString(text, position, key)) return false;
+
+            skipWhitespace(text, position);
+            if (position >= text.size() || text[position] != ':') return false;
+            position++;
+            skipWhitespace(text, position);
+
+            if (position >= text.size()) return false;
+
+            // A later duplicate key wins, the same as with the generic parser.
+            bool known = false;
+            for (const auto& [name, field] : JSON_MESSAGE_TEXT_FIELDS)
+            {
+                if (key != name) continue;
+
+                if (!readString(text, position, msg.*field)) return false;
+                known = true;
+                break;
+            }
+
+            for (const auto& [name, field] : JSON_MESSAGE_FLAG_FIELDS)
+            {
+                if (known || key != name) continue;
+
+                if (!readBool(text, position, msg.*field)) return false;
+                known = true;
+                break;
+            }
+
+            for (const auto& [name, field] : JSON_MESSAGE_NUMBER_FIELDS)
+            {
+                if (known || key != name) continue;
+
+                if (!readUnsigned(text, position, msg.*field)) return false;
+                known = true;
+                break;
+            }
+
+            if (!known && allowSteps && key == JSON_MESSAGE_ACTIONS_KEY && text[position] == '[')
+            {
+                if (!readSteps(text, position, msg.actions)) return false;
+                known = true;
+            }
+
+            // Unknown keys are skipped, as long as their values are simple.
+            if (!known)
+            {
+                std::string_view ignoredText;
+                bool ignoredFlag;
+
+                if (text[position] == '"')
+                {
+                    if (!readString(text, position, ignoredText)) return false;
+                }
+                else if (!readBool(text, position, ignoredFlag))
+                {
+                    return false;
+                }
+            }
+
+            skipWhitespace(text, position);
+            if (position >= text.size()) return false;
+
+            if (text[position] == ',')
+            {
+                position++;
+                skipWhitespace(text, position);
+                continue;
+            }
+
+            if (text[position] != '}') return false;
+            position++;
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool RequestParser::readSteps(const std::string_view text, std::size_t& position, std::vector<JsonMessage>& steps)
+{
+    // A later duplicate key wins here too.
+    steps.clear();
+    position++;
+
+    skipWhitespace(text, position);
+    if (position < text.size() && text[position] == ']')
+    {
+        position++;
+        return true;
+    }
+
+    while (true)
+    {
+        if (!readObject(text, position, steps.emplace_back(), false)) return false;
+
+        skipWhitespace(text, position);
+        if (position >= text.size()) return false;
+
+        if (text[position] == ',')
+        {
+            position++;
+            skipWhitespace(text, position);
+            continue;
+        }
+
+        if (text[position] != ']') return false;
+        position++;
+        return true;
+    }
+}
+
+void RequestParser::skipWhitespace(const std::string_view text, std::size_t& position)
+{
+    while (position < text.size())
+    {
+        const char c = text[position];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return;
+
+        position++;
+    }
+}
+
+bool RequestParser::readString(const std::string_view text, std::size_t& position, std::string_view& value)
+{
+    if (position >= text.size() || text[position] != '"') return false;
+
+    // Escapes need decoding, control characters are invalid and anything else has to be checked as
+    // UTF-8, so only a closing quote ends a string here.
+    const std::size_t start = position + 1;
+    const std::size_t end = StructuralScanner::findStringEnd(text, start);
+    if (end >= text.size() || text[end] != '"') return false;
+
+    value = text.substr(start, end - start);
+    position = end + 1;
+    return true;
+}
+
+bool RequestParser::readBool(const std::string_view text, std::size_t& position, bool& value)
+{
+    const std::string_view rest = text.substr(position);
+
+    if (rest.starts_with("true"))
+    {
+        value = true;
+        position += 4;
+        return true;
+    }
+
+    if (rest.starts_with("false"))
+    {
+        value = false;
+        position += 5;
+        return true;
+    }
+
+    return false;
+}
+
+bool RequestParser::readUnsigned(const std::string_view text, std::size_t& position, std::uint64_t& value)
+{
+    const char* first = text.data() + position;
+    const char* last = text.data() + text.size();
+
+    // JSON allows no leading zeros.
+    if (first < last && *first == '0' && first + 1 < last && *(first + 1) >= '0' && *(first + 1) <= '9') return false;
+
+    const auto [end, error] = std::from_chars(first, last, value);
+    if (error != std::errc() || end == first) return false;
+
+    // Fractions, exponents and signs are left to the generic parser.
+    if (end < last && (*end == '.' || *end == 'e' || *end == 'E')) return false;
+
+    position = static_cast<std::size_t>(end - text.data());
+    return true;
+}
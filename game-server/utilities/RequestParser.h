@@ -0,0 +1,42 @@
+﻿#ifndef REQUESTPARSER_H
+#define REQUESTPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "../structs/JsonMessage.h"
+
+// Reads a JSON request straight into a JsonMessage without building a json object. The fields are
+// left pointing into the text, so nothing is copied or allocated. Only flat objects of plain ASCII
+// strings, booleans and unsigned integers are read, along with the array of such objects a batch
+// request holds its steps in; anything else is left to the generic parser.
+class RequestParser
+{
+public:
+
+    // Returns false if the text has to go through the generic parser instead. msg is then incomplete.
+    static bool parse(std::string_view text, JsonMessage& msg);
+
+private:
+
+    // Reads an object, leaving position after its closing brace. Only a request's own object may hold steps.
+    static bool readObject(std::string_view text, std::size_t& position, JsonMessage& msg, bool allowSteps);
+
+    // Reads the array of a batch's steps, leaving position after its closing bracket.
+    static bool readSteps(std::string_view text, std::size_t& position, std::vector<JsonMessage>& steps);
+
+    static void skipWhitespace(std::string_view text, std::size_t& position);
+
+    // Reads a string without escapes or non-ASCII bytes, leaving position after its closing quote.
+    static bool readString(std::string_view text, std::size_t& position, std::string_view& value);
+
+    // Reads true or false, leaving position after it.
+    static bool readBool(std::string_view text, std::size_t& position, bool& value);
+
+    // Reads an unsigned integer that fits in 64 bits, leaving position after it.
+    static bool readUnsigned(std::string_view text, std::size_t& position, std::uint64_t& value);
+};
+
+#endif //REQUESTPARSER_H
@@ -0,0 +1,528 @@
+﻿#include "ResponseWriter.h"
+#include "CannedResponse.h"
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    // MessagePack maps and arrays are opened with a 4-byte count and shrunk to fit once closed.
+    constexpr std::size_t MSGPACK_CONTAINER_HEADER_SIZE = 5;
+}
+
+ResponseWriter::ResponseWriter(std::string& output, const WireProtocol::Format format) : output(output), format(format)
+{
+    restart();
+}
+
+WireProtocol::Format ResponseWriter::getFormat() const
+{
+    return format;
+}
+
+void ResponseWriter::restart()
+{
+    output.clear();
+    depth = 0;
+    cannedMessage = {};
+
+    // The frame length is filled in by finish().
+    if (format != WireProtocol::Format::Json)
+    {
+        output.append(WireProtocol::FRAME_HEADER_SIZE, '\0');
+    }
+}
+
+ResponseWriter& ResponseWriter::begin(const bool success, const std::string_view message)
+{
+    return begin(success, { message });
+}
+
+ResponseWriter& ResponseWriter::begin(const bool success, const std::initializer_list<std::string_view> messageParts)
+{
+    // A response nested in another one, as in a batch, is an element of an array.
+    if (depth > 0) { beforeElement(); }
+    open(false, true);
+
+    field("success", success);
+    writeKey("message");
+    writeStringParts(messageParts);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::beginData()
+{
+    return beginObject("data");
+}
+
+ResponseWriter& ResponseWriter::end()
+{
+    while (depth > 0)
+    {
+        const bool isResponse = containers[depth - 1].isResponse;
+        close();
+        if (isResponse) break;
+    }
+
+    return *this;
+}
+
+void ResponseWriter::reply(const bool success, const std::string_view message)
+{
+    begin(success, { message }).end();
+}
+
+void ResponseWriter::reply(const bool success, const std::initializer_list<std::string_view> messageParts)
+{
+    begin(success, messageParts).end();
+}
+
+void ResponseWriter::reply(const CannedResponse& canned)
+{
+    if (depth == 0)
+    {
+        cannedMessage = canned.getMessage(format);
+        return;
+    }
+
+    // Nested in another response, it's copied in as an element.
+    beforeElement();
+    output.append(canned.getBody(format));
+}
+
+ResponseWriter& ResponseWriter::field(const std::string_view key, const std::string_view value)
+{
+    writeKey(key);
+    writeString(value);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::field(const std::string_view key, const char* value)
+{
+    return field(key, std::string_view(value));
+}
+
+ResponseWriter& ResponseWriter::field(const std::string_view key, const bool value)
+{
+    writeKey(key);
+    writeBool(value);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::field(const std::string_view key, const double value)
+{
+    writeKey(key);
+    writeDouble(value);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::beginObject(const std::string_view key)
+{
+    writeKey(key);
+    open(false, false);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::beginArray(const std::string_view key)
+{
+    writeKey(key);
+    open(true, false);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::beginObject()
+{
+    beforeElement();
+    open(false, false);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::element(const std::string_view value)
+{
+    beforeElement();
+    writeString(value);
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::endObject()
+{
+    close();
+    return *this;
+}
+
+ResponseWriter& ResponseWriter::endArray()
+{
+    close();
+    return *this;
+}
+
+std::string_view ResponseWriter::finish()
+{
+    if (!cannedMessage.empty()) return cannedMessage;
+
+    while (depth > 0) { close(); }
+
+    if (format != WireProtocol::Format::Json)
+    {
+        const std::size_t bodySize = output.size() - WireProtocol::FRAME_HEADER_SIZE;
+        for (std::size_t i = 0; i < WireProtocol::FRAME_HEADER_SIZE; i++)
+        {
+            output[i] = static_cast<char>((bodySize >> (8 * (WireProtocol::FRAME_HEADER_SIZE - 1 - i))) & 0xFF);
+        }
+    }
+
+    return output;
+}
+
+void ResponseWriter::open(const bool isArray, const bool isResponse)
+{
+    if (depth == MAX_DEPTH)
+    {
+        throw std::logic_error("Response nested too deeply");
+    }
+
+    containers[depth++] = { output.size(), 0, isArray, isResponse };
+
+    switch (format)
+    {
+    case WireProtocol::Format::Json:
+        output += isArray ? '[' : '{';
+        break;
+    case WireProtocol::Format::MessagePack:
+        output += static_cast<char>(isArray ? 0xDD : 0xDF);
+        output.append(MSGPACK_CONTAINER_HEADER_SIZE - 1, '\0');
+        break;
+    case WireProtocol::Format::Cbor:
+        // Indefinite length, ended by a break byte.
+        output += static_cast<char>(isArray ? 0x9F : 0xBF);
+        break;
+    }
+}
+
+void ResponseWriter::close()
+{
+    const Container& container = containers[--depth];
+
+    switch (format)
+    {
+    case WireProtocol::Format::Json:
+        output += container.isArray ? ']' : '}';
+        break;
+    case WireProtocol::Format::Cbor:
+        output += static_cast<char>(0xFF);
+        break;
+    case WireProtocol::Format::MessagePack:
+    {
+        // Everything after the header is closed already, so shifting it left moves nothing still open.
+        const std::size_t offset = container.headerOffset;
+        if (container.count < 16)
+        {
+            output[offset] = static_cast<char>((container.isArray ? 0x90 : 0x80) | container.count);
+            output.erase(offset + 1, 4);
+        }
+        else if (container.count <= std::numeric_limits<std::uint16_t>::max())
+        {
+            output[offset] = static_cast<char>(container.isArray ? 0xDC : 0xDE);
+            output[offset + 1] = static_cast<char>(container.count >> 8);
+            output[offset + 2] = static_cast<char>(container.count & 0xFF);
+            output.erase(offset + 3, 2);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < 4; i++)
+            {
+                output[offset + 1 + i] = static_cast<char>((container.count >> (8 * (3 - i))) & 0xFF);
+            }
+        }
+        break;
+    }
+    }
+}
+
+void ResponseWriter::writeKey(const std::string_view key)
+{
+    beforeElement();
+    writeString(key);
+    if (format == WireProtocol::Format::Json) { output += ':'; }
+}
+
+void ResponseWriter::beforeElement()
+{
+    if (depth == 0) return;
+
+    Container& container = containers[depth - 1];
+    if (format == WireProtocol::Format::Json && container.count > 0) { output += ','; }
+    container.count++;
+}
+
+void ResponseWriter::writeString(const std::string_view value)
+{
+    writeStringParts({ value });
+}
+
+void ResponseWriter::writeStringParts(const std::initializer_list<std::string_view> parts)
+{
+    if (format != WireProtocol::Format::Json)
+    {
+        std::size_t length = 0;
+        for (const std::string_view part : parts) { length += part.size(); }
+
+        if (format == WireProtocol::Format::Cbor)
+        {
+            writeCborHead(3, length);
+        }
+        else if (length < 32)
+        {
+            output += static_cast<char>(0xA0 | length);
+        }
+        else if (length <= std::numeric_limits<std::uint8_t>::max())
+        {
+            output += static_cast<char>(0xD9);
+            writeBigEndian(length, 1);
+        }
+        else if (length <= std::numeric_limits<std::uint16_t>::max())
+        {
+            output += static_cast<char>(0xDA);
+            writeBigEndian(length, 2);
+        }
+        else
+        {
+            output += static_cast<char>(0xDB);
+            writeBigEndian(length, 4);
+        }
+
+        for (const std::string_view part : parts) { output.append(part); }
+        return;
+    }
+
+    output += '"';
+
+    for (const std::string_view part : parts)
+    {
+        // Copies runs of plain characters at once, escaping only what JSON requires.
+        std::size_t runStart = 0;
+        for (std::size_t i = 0; i < part.size(); i++)
+        {
+            const auto c = static_cast<unsigned char>(part[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+            output.append(part.data() + runStart, i - runStart);
+            runStart = i + 1;
+
+            switch (c)
+            {
+            case '"': output += "\\\""; break;
+            case '\\': output += "\\\\"; break;
+            case '\b': output += "\\b"; break;
+            case '\f': output += "\\f"; break;
+            case '\n': output += "\\n"; break;
+            case '\r': output += "\\r"; break;
+            case '\t': output += "\\t"; break;
+            default:
+                output += "\\u00";
+                output += HEX_DIGITS[c >> 4];
+                output += HEX_DIGITS[c & 0x0F];
+                break;
+            }
+        }
+
+        output.append(part.data() + runStart, part.size() - runStart);
+    }
+
+    output += '"';
+}
+
+void ResponseWriter::writeInteger(const std::int64_t value)
+{
+    if (value >= 0)
+    {
+        writeUnsigned(static_cast<std::uint64_t>(value));
+        return;
+    }
+
+    switch (format)
+    {
+    case WireProtocol::Format::Json:
+    {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        output.append(digits, result.ptr);
+        break;
+    }
+    case WireProtocol::Format::Cbor:
+        writeCborHead(1, static_cast<std::uint64_t>(-1 - value));
+        break;
+    case WireProtocol::Format::MessagePack:
+        if (value >= -32)
+        {
+            output += static_cast<char>(value);
+        }
+        else if (value >= std::numeric_limits<std::int8_t>::min())
+        {
+            output += static_cast<char>(0xD0);
+            writeBigEndian(static_cast<std::uint64_t>(value), 1);
+        }
+        else if (value >= std::numeric_limits<std::int16_t>::min())
+        {
+            output += static_cast<char>(0xD1);
+            writeBigEndian(static_cast<std::uint64_t>(value), 2);
+        }
+        else if (value >= std::numeric_limits<std::int32_t>::min())
+        {
+            output += static_cast<char>(0xD2);
+            writeBigEndian(static_cast<std::uint64_t>(value), 4);
+        }
+        else
+        {
+            output += static_cast<char>(0xD3);
+            writeBigEndian(static_cast<std::uint64_t>(value), 8);
+        }
+        break;
+    }
+}
+
+void ResponseWriter::writeUnsigned(const std::uint64_t value)
+{
+    switch (format)
+    {
+    case WireProtocol::Format::Json:
+    {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        output.append(digits, result.ptr);
+        break;
+    }
+    case WireProtocol::Format::Cbor:
+        writeCborHead(0, value);
+        break;
+    case WireProtocol::Format::MessagePack:
+        if (value < 128)
+        {
+            output += static_cast<char>(value);
+        }
+        else if (value <= std::numeric_limits<std::uint8_t>::max())
+        {
+            output += static_cast<char>(0xCC);
+            writeBigEndian(value, 1);
+        }
+        else if (value <= std::numeric_limits<std::uint16_t>::max())
+        {
+            output += static_cast<char>(0xCD);
+            writeBigEndian(value, 2);
+        }
+        else if (value <= std::numeric_limits<std::uint32_t>::max())
+        {
+            output += static_cast<char>(0xCE);
+            writeBigEndian(value, 4);
+        }
+        else
+        {
+            output += static_cast<char>(0xCF);
+            writeBigEndian(value, 8);
+        }
+        break;
+    }
+}
+
+void ResponseWriter::writeDouble(const double value)
+{
+    if (format == WireProtocol::Format::Json)
+    {
+        // JSON has no infinities or NaN.
+        if (!std::isfinite(value))
+        {
+            output += "null";
+            return;
+        }
+
+        char digits[32];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        const std::string_view text(digits, result.ptr - digits);
+        output.append(text);
+
+        // Keeps whole numbers recognisable as floating point, as nlohmann does.
+        if (text.find_first_of(".e") == std::string_view::npos) { output += ".0"; }
+        return;
+    }
+
+    // A value that survives the round trip through a float is written in half the bytes.
+    const auto single = static_cast<float>(value);
+    const bool fitsFloat = static_cast<double>(single) == value;
+
+    if (format == WireProtocol::Format::Cbor)
+    {
+        output += static_cast<char>(fitsFloat ? 0xFA : 0xFB);
+    }
+    else
+    {
+        output += static_cast<char>(fitsFloat ? 0xCA : 0xCB);
+    }
+
+    if (fitsFloat)
+    {
+        writeBigEndian(std::bit_cast<std::uint32_t>(single), 4);
+    }
+    else
+    {
+        writeBigEndian(std::bit_cast<std::uint64_t>(value), 8);
+    }
+}
+
+void ResponseWriter::writeBool(const bool value)
+{
+    switch (format)
+    {
+    case WireProtocol::Format::Json:
+        output += value ? "true" : "false";
+        break;
+    case WireProtocol::Format::MessagePack:
+        output += static_cast<char>(value ? 0xC3 : 0xC2);
+        break;
+    case WireProtocol::Format::Cbor:
+        output += static_cast<char>(value ? 0xF5 : 0xF4);
+        break;
+    }
+}
+
+void ResponseWriter::writeCborHead(const std::uint8_t majorType, const std::uint64_t argument)
+{
+    const auto major = static_cast<std::uint8_t>(majorType << 5);
+
+    if (argument < 24)
+    {
+        output += static_cast<char>(major | argument);
+    }
+    else if (argument <= std::numeric_limits<std::uint8_t>::max())
+    {
+        output += static_cast<char>(major | 24);
+        writeBigEndian(argument, 1);
+    }
+    else if (argument <= std::numeric_limits<std::uint16_t>::max())
+    {
+        output += static_cast<char>(major | 25);
+        writeBigEndian(argument, 2);
+    }
+    else if (argument <= std::numeric_limits<std::uint32_t>::max())
+    {
+        output += static_cast<char>(major | 26);
+        writeBigEndian(argument, 4);
+    }
+    else
+    {
+        output += static_cast<char>(major | 27);
+        writeBigEndian(argument, 8);
+    }
+}
+
+void ResponseWriter::writeBigEndian(const std::uint64_t value, const std::size_t bytes)
+{
+    for (std::size_t i = bytes; i > 0; i--)
+    {
+        output += static_cast<char>((value >> (8 * (i - 1))) & 0xFF);
+    }
+}
@@ -0,0 +1,122 @@
+﻿#ifndef RESPONSEWRITER_H
+#define RESPONSEWRITER_H
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include "WireProtocol.h"
+
+class CannedResponse;
+
+// Writes a response straight into a connection's output buffer, as JSON text or as a framed
+// MessagePack or CBOR message, without building a json object first. The buffer keeps its capacity
+// from one response to the next, so a steady stream of replies allocates nothing.
+//
+//     response.begin(true, "Inventory retrieved successfully").beginData()
+//         .field("used_space", usedSpace)
+//         .field("max_space", maxSpace);
+//     response.end();
+class ResponseWriter
+{
+public:
+
+    // Starts a new message in output, replacing whatever it held.
+    ResponseWriter(std::string& output, WireProtocol::Format format);
+
+    [[nodiscard]] WireProtocol::Format getFormat() const;
+
+    // Discards the message, so the next one can be written in the same buffer once this one is sent.
+    void restart();
+
+    // Opens a response with its success flag and message. A message given in parts is joined as it's written.
+    ResponseWriter& begin(bool success, std::string_view message);
+    ResponseWriter& begin(bool success, std::initializer_list<std::string_view> messageParts);
+
+    // Opens the data object of the response.
+    ResponseWriter& beginData();
+
+    // Closes the response, along with its data and anything else still open in it.
+    ResponseWriter& end();
+
+    // Writes a whole response that has no data.
+    void reply(bool success, std::string_view message);
+    void reply(bool success, std::initializer_list<std::string_view> messageParts);
+
+    // Replies with a response serialised in advance. As the whole message, it's sent without being copied.
+    void reply(const CannedResponse& canned);
+
+    ResponseWriter& field(std::string_view key, std::string_view value);
+    ResponseWriter& field(std::string_view key, const char* value);
+    ResponseWriter& field(std::string_view key, bool value);
+    ResponseWriter& field(std::string_view key, double value);
+
+    template <std::integral T>
+    ResponseWriter& field(const std::string_view key, const T value)
+    {
+        writeKey(key);
+        if constexpr (std::is_signed_v<T>) { writeInteger(value); }
+        else { writeUnsigned(value); }
+        return *this;
+    }
+
+    // Opens an object or array as the value of a field.
+    ResponseWriter& beginObject(std::string_view key);
+    ResponseWriter& beginArray(std::string_view key);
+
+    // Opens an object as the next element of an array.
+    ResponseWriter& beginObject();
+
+    // Writes a string as the next element of an array.
+    ResponseWriter& element(std::string_view value);
+
+    ResponseWriter& endObject();
+    ResponseWriter& endArray();
+
+    // Finishes the message, filling in the frame length for binary formats, and returns its bytes.
+    // They belong to the output buffer, or to a canned response.
+    std::string_view finish();
+
+private:
+
+    struct Container
+    {
+        std::size_t headerOffset;
+        std::uint32_t count;
+        bool isArray;
+        bool isResponse;
+    };
+
+    static constexpr std::size_t MAX_DEPTH = 16;
+
+    void open(bool isArray, bool isResponse);
+    void close();
+
+    void writeKey(std::string_view key);
+    void beforeElement();
+
+    void writeString(std::string_view value);
+    void writeStringParts(std::initializer_list<std::string_view> parts);
+    void writeInteger(std::int64_t value);
+    void writeUnsigned(std::uint64_t value);
+    void writeDouble(double value);
+    void writeBool(bool value);
+
+    // Writes a CBOR head: the major type and an argument in as few bytes as it fits.
+    void writeCborHead(std::uint8_t majorType, std::uint64_t argument);
+    void writeBigEndian(std::uint64_t value, std::size_t bytes);
+
+    std::string& output;
+    WireProtocol::Format format;
+    std::array<Container, MAX_DEPTH> containers {};
+    std::size_t depth = 0;
+
+    // Set when the whole message is a canned response.
+    std::string_view cannedMessage;
+};
+
+#endif //RESPONSEWRITER_H
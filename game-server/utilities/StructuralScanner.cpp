@@ -0,0 +1,149 @@
+﻿#include "StructuralScanner.h"
+
+#include <bit>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STRUCTURAL_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using FindStringEnd = std::size_t (*)(const char* data, std::size_t size, std::size_t position);
+
+    std::size_t findStringEndScalar(const char* data, const std::size_t size, std::size_t position)
+    {
+        for (; position < size; position++)
+        {
+            const auto c = static_cast<unsigned char>(data[position]);
+            if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) return position;
+        }
+
+        return size;
+    }
+
+#ifdef STRUCTURAL_SCANNER_X86
+    __attribute__((target("sse4.2")))
+    std::size_t findStringEndSse42(const char* data, const std::size_t size, std::size_t position)
+    {
+        // Ranges of bytes to stop at, in pairs: control characters, the quote, the backslash and non-ASCII bytes.
+        const __m128i ranges = _mm_setr_epi8(0x00, 0x1F, '"', '"', '\\', '\\', static_cast<char>(0x80), static_cast<char>(0xFF),
+                                             0, 0, 0, 0, 0, 0, 0, 0);
+
+        for (; position + 16 <= size; position += 16)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+            const int index = _mm_cmpestri(ranges, 8, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+
+            if (index < 16) return position + index;
+        }
+
+        return findStringEndScalar(data, size, position);
+    }
+
+    __attribute__((target("avx2")))
+    std::size_t findStringEndAvx2(const char* data, const std::size_t size, std::size_t position)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i space = _mm256_set1_epi8(' ');
+
+        for (; position + 32 <= size; position += 32)
+        {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + position));
+
+            // Compared as signed bytes, control characters and non-ASCII bytes are both below a space.
+            const __m256i special = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+                _mm256_cmpgt_epi8(space, block));
+
+            if (const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(special)); mask != 0)
+            {
+                return position + std::countr_zero(mask);
+            }
+        }
+
+        // Most strings in requests are short, so what's left still gets a 16-byte step.
+        if (position + 16 <= size)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+            const __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm256_castsi256_si128(quote)), _mm_cmpeq_epi8(block, _mm256_castsi256_si128(backslash))),
+                _mm_cmpgt_epi8(_mm256_castsi256_si128(space), block));
+
+            if (const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(special)); mask != 0)
+            {
+                return position + std::countr_zero(mask);
+            }
+
+            position += 16;
+        }
+
+        return findStringEndScalar(data, size, position);
+    }
+#endif
+
+    StructuralScanner::Level detectLevel()
+    {
+#ifdef STRUCTURAL_SCANNER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return StructuralScanner::Level::Avx2;
+        if (__builtin_cpu_supports("sse4.2")) return StructuralScanner::Level::Sse42;
+#endif
+        return StructuralScanner::Level::Scalar;
+    }
+
+    FindStringEnd implementationFor(const StructuralScanner::Level level)
+    {
+#ifdef STRUCTURAL_SCANNER_X86
+        switch (level)
+        {
+        case StructuralScanner::Level::Avx2: return findStringEndAvx2;
+        case StructuralScanner::Level::Sse42: return findStringEndSse42;
+        default: break;
+        }
+#endif
+        return findStringEndScalar;
+    }
+
+    const StructuralScanner::Level supportedLevel = detectLevel();
+    StructuralScanner::Level currentLevel = supportedLevel;
+    FindStringEnd findStringEndImplementation = implementationFor(supportedLevel);
+}
+
+std::size_t StructuralScanner::findStringEnd(const std::string_view text, const std::size_t position)
+{
+    return findStringEndImplementation(text.data(), text.size(), position);
+}
+
+StructuralScanner::Level StructuralScanner::getLevel()
+{
+    return currentLevel;
+}
+
+const char* StructuralScanner::levelName(const Level level)
+{
+    switch (level)
+    {
+    case Level::Avx2: return "AVX2";
+    case Level::Sse42: return "SSE4.2";
+    case Level::Scalar: return "scalar";
+    }
+
+    return "unknown";
+}
+
+bool StructuralScanner::setLevel(const Level level)
+{
+    if (!isSupported(level)) return false;
+
+    currentLevel = level;
+    findStringEndImplementation = implementationFor(level);
+    return true;
+}
+
+bool StructuralScanner::isSupported(const Level level)
+{
+    return level <= supportedLevel;
+}
@@ -0,0 +1,130 @@
+﻿#include "WireProtocol.h"
+
+std::optional<WireProtocol::Format> WireProtocol::parseFormat(const std::string_view name)
+{
+    if (name == "json") return Format::Json;
+    if (name == "msgpack") return Format::MessagePack;
+    if (name == "cbor") return Format::Cbor;
+
+    return std::nullopt;
+}
+
+std::string WireProtocol::formatName(const Format format)
+{
+    switch (format)
+    {
+    case Format::Json: return "json";
+    case Format::MessagePack: return "msgpack";
+    case Format::Cbor: return "cbor";
+    }
+
+    return "unknown";
+}
+
+std::string WireProtocol::encode(const json& message, const Format format)
+{
+    if (format == Format::Json)
+    {
+        return message.dump();
+    }
+
+    // The length is filled in once the body is written after it.
+    std::string frame(FRAME_HEADER_SIZE, '\0');
+    if (format == Format::MessagePack)
+    {
+        json::to_msgpack(message, frame);
+    }
+    else
+    {
+        json::to_cbor(message, frame);
+    }
+
+    const std::size_t bodySize = frame.size() - FRAME_HEADER_SIZE;
+    for (std::size_t i = 0; i < FRAME_HEADER_SIZE; i++)
+    {
+        frame[i] = static_cast<char>((bodySize >> (8 * (FRAME_HEADER_SIZE - 1 - i))) & 0xFF);
+    }
+
+    return frame;
+}
+
+WireProtocol::FrameResult WireProtocol::takeMessage(std::string& buffer, const Format format, std::string& message, TextScan& scan)
+{
+    if (format == Format::Json)
+    {
+        // A message ends with the brace that closes its outermost object. Braces in strings don't count.
+        // The scan picks up where the last call stopped, so a message arriving in pieces is only read once.
+        std::size_t& position = scan.position;
+        while (position < buffer.size())
+        {
+            if (scan.escaped)
+            {
+                // Passes over the escaped character.
+                scan.escaped = false;
+                position++;
+            }
+            else if (scan.inString)
+            {
+                // Skips to the closing quote or the next escape.
+                position = buffer.find_first_of("\"\\", position);
+                if (position == std::string::npos) break;
+
+                scan.escaped = buffer[position] == '\\';
+                scan.inString = scan.escaped;
+                position++;
+            }
+            else
+            {
+                position = buffer.find_first_of("\"{}[]", position);
+                if (position == std::string::npos) break;
+
+                const char token = buffer[position++];
+                if (token == '"')
+                {
+                    scan.inString = true;
+                }
+                else if (token == '{' || token == '[')
+                {
+                    scan.depth++;
+                }
+                else if (--scan.depth <= 0)
+                {
+                    message.assign(buffer, 0, position);
+                    buffer.erase(0, position);
+                    scan = {};
+                    return FrameResult::Complete;
+                }
+            }
+        }
+
+        position = buffer.size();
+
+        // Text is held to the same limit as frames.
+        return buffer.size() > MAX_FRAME_SIZE ? FrameResult::TooLarge : FrameResult::Incomplete;
+    }
+
+    if (buffer.size() < FRAME_HEADER_SIZE) return FrameResult::Incomplete;
+
+    std::size_t bodySize = 0;
+    for (std::size_t i = 0; i < FRAME_HEADER_SIZE; i++)
+    {
+        bodySize = (bodySize << 8) | static_cast<unsigned char>(buffer[i]);
+    }
+
+    if (bodySize > MAX_FRAME_SIZE) return FrameResult::TooLarge;
+    if (buffer.size() < FRAME_HEADER_SIZE + bodySize) return FrameResult::Incomplete;
+
+    message.assign(buffer, FRAME_HEADER_SIZE, bodySize);
+    buffer.erase(0, FRAME_HEADER_SIZE + bodySize);
+    return FrameResult::Complete;
+}
+
+json WireProtocol::decode(const std::string_view message, const Format format)
+{
+    switch (format)
+    {
+    case Format::MessagePack: return json::from_msgpack(message.begin(), message.end());
+    case Format::Cbor: return json::from_cbor(message.begin(), message.end());
+    default: return json::parse(message);
+    }
+}
@@ -0,0 +1,62 @@
+﻿#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+// How messages are encoded on a connection. Every connection starts out as JSON text. Sending
+// {"action": "set_protocol", "protocol": "msgpack"} (or "cbor") switches both directions to that
+// binary encoding once the reply has been sent. Binary messages are framed by a 4-byte big-endian
+// length, since they can contain any byte.
+class WireProtocol
+{
+public:
+
+    enum class Format : std::uint8_t
+    {
+        Json,
+        MessagePack,
+        Cbor
+    };
+
+    enum class FrameResult
+    {
+        Incomplete,
+        Complete,
+        TooLarge
+    };
+
+    // How far takeMessage got through the JSON text in a buffer, so the bytes it already looked at
+    // aren't scanned again each time more arrive. Keep one next to each buffer.
+    struct TextScan
+    {
+        std::size_t position = 0;
+        int depth = 0;
+        bool inString = false;
+        bool escaped = false;
+    };
+
+    static constexpr std::size_t FRAME_HEADER_SIZE = 4;
+
+    // Larger messages are refused, so a corrupt length or an unclosed object can't make the reader buffer without end.
+    static constexpr std::size_t MAX_FRAME_SIZE = 1024 * 1024;
+
+    static std::optional<Format> parseFormat(std::string_view name);
+    static std::string formatName(Format format);
+
+    // Encodes a message, framing it if the format is binary.
+    static std::string encode(const json& message, Format format);
+
+    // Takes the next whole message off the front of buffer.
+    static FrameResult takeMessage(std::string& buffer, Format format, std::string& message, TextScan& scan);
+
+    // Decodes one message. Throws json::exception if it's malformed.
+    static json decode(std::string_view message, Format format);
+};
+
+#endif //WIREPROTOCOL_H
@@ -33,6 +33,7 @@ bool GameClient::connectToAuthServer()
     }
 
     std::cout << "Connected to the authentication server" << std::endl;
+    authProtocol = negotiateProtocol(authSocket, "authentication");
     return true;
 }
 
@@ -59,41 +60,106 @@ bool GameClient::connectToGameServer()
     }
 
     std::cout << "Connected to the game server" << std::endl;
+    gameProtocol = negotiateProtocol(gameSocket, "game");
     return true;
 }
 
-std::string GameClient::sendRequest(const SOCKET socket, const json &request, const std::string &serverType)
+void GameClient::setProtocol(const WireProtocol::Format format)
+{
+    protocol = format;
+}
+
+std::string GameClient::sendRequest(const SOCKET socket, const json &request, const WireProtocol::Format format, const std::string &serverType)
 {
     if (socket == INVALID_SOCKET)
     {
         return "ERROR: Not connected to the " + serverType + " server";
     }
 
-    const std::string jsonStr = request.dump();
+    const std::string encoded = WireProtocol::encode(request, format);
 
-    if (send(socket, jsonStr.c_str(), static_cast<int>(jsonStr.length()), 0) == SOCKET_ERROR)
+    if (send(socket, encoded.c_str(), static_cast<int>(encoded.length()), 0) == SOCKET_ERROR)
     {
         return "ERROR: Failed to send to the " + serverType + " server";
     }
 
     char buffer[2048];
-    if (const int bytesReceived = recv(socket, buffer, sizeof(buffer) - 1, 0); bytesReceived > 0)
+
+    if (format == WireProtocol::Format::Json)
+    {
+        if (const int bytesReceived = recv(socket, buffer, sizeof(buffer) - 1, 0); bytesReceived > 0)
+        {
+            buffer[bytesReceived] = '\0';
+            return { buffer };
+        }
+
+        return "ERROR: No response from the " + serverType + " server";
+    }
+
+    // Binary responses are framed, so they're read until the whole frame is in.
+    std::string received;
+    WireProtocol::TextScan scan;
+    std::string message;
+    while (true)
+    {
+        const WireProtocol::FrameResult frame = WireProtocol::takeMessage(received, format, message, scan);
+        if (frame == WireProtocol::FrameResult::Complete) break;
+        if (frame == WireProtocol::FrameResult::TooLarge) return "ERROR: Response from the " + serverType + " server is too large";
+
+        const int bytesReceived = recv(socket, buffer, sizeof(buffer), 0);
+        if (bytesReceived <= 0) return "ERROR: No response from the " + serverType + " server";
+
+        received.append(buffer, bytesReceived);
+    }
+
+    try
+    {
+        return WireProtocol::decode(message, format).dump();
+    }
+    catch (const json::exception& e)
+    {
+        return "ERROR: Unreadable response from the " + serverType + " server: " + e.what();
+    }
+}
+
+WireProtocol::Format GameClient::negotiateProtocol(const SOCKET socket, const std::string &serverType) const
+{
+    if (protocol == WireProtocol::Format::Json)
+    {
+        return protocol;
+    }
+
+    json request;
+    request["action"] = "set_protocol";
+    request["protocol"] = WireProtocol::formatName(protocol);
+
+    // The reply to the switch still comes back as JSON.
+    const std::string response = sendRequest(socket, request, WireProtocol::Format::Json, serverType);
+
+    try
+    {
+        if (json::parse(response).value("success", false))
+        {
+            std::cout << "Using " << WireProtocol::formatName(protocol) << " with the " << serverType << " server" << std::endl;
+            return protocol;
+        }
+    }
+    catch (const json::parse_error&)
     {
-        buffer[bytesReceived] = '\0';
-        return { buffer };
     }
 
-    return "ERROR: No response from the " + serverType + " server";
+    std::cout << "The " << serverType << " server refused " << WireProtocol::formatName(protocol) << ", staying on JSON" << std::endl;
+    return WireProtocol::Format::Json;
 }
 
 std::string GameClient::sendAuthRequest(const json &request) const
 {
-    return sendRequest(authSocket, request, "authentication");
+    return sendRequest(authSocket, request, authProtocol, "authentication");
 }
 
 std::string GameClient::sendGameRequest(const json &request) const
 {
-    return sendRequest(gameSocket, request, "game");
+    return sendRequest(gameSocket, request, gameProtocol, "game");
 }
 
 bool GameClient::authenticate()
@@ -163,6 +229,7 @@ void GameClient::gameMode()
         std::cout << ":: list_users                    - Show all users with details" << std::endl;
         std::cout << ":: modify_type <username> <type> - Change user type (Freemium, Bronze, Silver, Gold, Platinum)" << std::endl;
         std::cout << ":: remove_user <username>        - Remove user from system" << std::endl;
+        std::cout << ":: reload_items                  - Reload the item catalog file" << std::endl;
         std::cout << ":: help                          - Show this help menu" << std::endl;
         std::cout << ":: quit                          - Exit" << std::endl;
     }
@@ -210,6 +277,7 @@ void GameClient::gameMode()
                 std::cout << ":: list_users              - Show all users with details" << std::endl;
                 std::cout << ":: modify_type <username> <type> - Change user type" << std::endl;
                 std::cout << ":: remove_user <username>  - Remove user from system" << std::endl;
+                std::cout << ":: reload_items            - Reload the item catalog file" << std::endl;
                 std::cout << ":: help                    - Show this help" << std::endl;
                 std::cout << ":: quit                    - Exit" << std::endl;
             }
@@ -239,6 +307,10 @@ void GameClient::gameMode()
             {
                 request["action"] = "list_users";
             }
+            else if (command == "reload_items")
+            {
+                request["action"] = "reload_items";
+            }
             else if (command.substr(0, 11) == "modify_type" && command.length() > 12)
             {
                 std::istringstream iss(command.substr(12));
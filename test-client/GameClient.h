@@ -5,6 +5,8 @@
 #include <string>
 #include <nlohmann/json.hpp>
 
+#include "utilities/WireProtocol.h"
+
 using json = nlohmann::json;
 
 class GameClient
@@ -13,6 +15,9 @@ public:
 
     ~GameClient();
 
+    // Picks the encoding asked for from both servers once connected. JSON needs no negotiation.
+    void setProtocol(WireProtocol::Format format);
+
     bool connectToAuthServer();
     bool connectToGameServer();
 
@@ -30,8 +35,15 @@ private:
     SOCKET gameSocket = INVALID_SOCKET;
     std::string authToken;
     std::string username;
+    WireProtocol::Format protocol = WireProtocol::Format::Json;
+    WireProtocol::Format authProtocol = WireProtocol::Format::Json;
+    WireProtocol::Format gameProtocol = WireProtocol::Format::Json;
+
+    // Sends a request and returns the response as JSON text, whichever format it came in.
+    static std::string sendRequest(SOCKET socket, const json &request, WireProtocol::Format format, const std::string &serverType);
 
-    static std::string sendRequest(SOCKET socket, const json &request, const std::string &serverType);
+    // Switches a connection to the chosen protocol, leaving it on JSON if the server refuses.
+    WireProtocol::Format negotiateProtocol(SOCKET socket, const std::string &serverType) const;
 };
 
 #endif //GAMECLIENT_H
@@ -1,13 +1,14 @@
 ﻿#include <iostream>
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <optional>
 #include <string>
 
 #include "GameClient.h"
 
 #pragma comment(lib, "Ws2_32.lib")
 
-int main()
+int main(int argc, char* argv[])
 {
     // Initialises Winsock (version 2.2).
     WSADATA wsaData;
@@ -18,6 +19,22 @@ int main()
     }
 
     GameClient client;
+
+    // "--protocol msgpack" or "--protocol cbor" talks to the servers in a binary encoding instead of JSON.
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) != "--protocol") continue;
+
+        if (const std::optional<WireProtocol::Format> format = WireProtocol::parseFormat(argv[i + 1]); format.has_value())
+        {
+            client.setProtocol(format.value());
+        }
+        else
+        {
+            std::cout << "Unknown protocol '" << argv[i + 1] << "', using JSON" << std::endl;
+        }
+    }
+
     client.run();
 
     // Cleanup.